@@ -14,4 +14,18 @@ void sandbox_eth_disable_response(int index, bool disable);
 
 void sandbox_eth_skip_timeout(void);
 
+/*
+ * A tx handler sees every packet sent by the device, before the mock ARP and
+ * ping responses. It returns true if it consumed the packet, usually after
+ * queueing the responses with sandbox_eth_recv_packet().
+ */
+struct udevice;
+typedef bool sandbox_eth_tx_hand_f(struct udevice *dev, void *packet,
+				   unsigned int length);
+
+void sandbox_eth_set_tx_handler(int index, sandbox_eth_tx_hand_f *handler);
+
+int sandbox_eth_recv_packet(struct udevice *dev, const void *packet,
+			    unsigned int length);
+
 #endif /* __ETH_H */
@@ -79,4 +79,28 @@ long sandbox_i2c_rtc_get_set_base_time(struct udevice *dev, long base_time);
 
 int sandbox_usb_keyb_add_string(struct udevice *dev, const char *str);
 
+/**
+ * sandbox_mmc_get_cmd_count() - Get how often the card received a command
+ *
+ * @dev:	MMC device
+ * @cmdidx:	Command index, e.g. MMC_CMD_SET_BLOCK_COUNT
+ * @return number of times the command was sent
+ */
+int sandbox_mmc_get_cmd_count(struct udevice *dev, int cmdidx);
+
+/**
+ * sandbox_mmc_get_packed_count() - Get the number of packed writes
+ *
+ * @dev:	MMC device
+ * @return number of packed write commands the emulated eMMC carried out
+ */
+int sandbox_mmc_get_packed_count(struct udevice *dev);
+
+/**
+ * sandbox_mmc_reset_counts() - Reset the command and packed write counts
+ *
+ * @dev:	MMC device
+ */
+void sandbox_mmc_reset_counts(struct udevice *dev);
+
 #endif
@@ -0,0 +1,352 @@
+/*
+ *  Copyright (C) 2018 by Digi International Inc.
+ *  All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version2  as published by
+ *  the Free Software Foundation.
+*/
+#include <common.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <u-boot/sha256.h>
+#include "bdelta.h"
+
+/*
+ * Block delta updates (see include/bdelta_format.h).
+ *
+ * The delta is consumed as a stream so that it can be applied from RAM or
+ * on the fly. Every block carried in the delta is checked against its
+ * digest, compared with the media and only written if it differs. The
+ * blocks that are not carried are checked against their digest on the
+ * media, as they are passed by, unless bdelta_check_base() already did it
+ * before the first write.
+ */
+
+bool bdelta_is_image(const void *buf)
+{
+	const struct bdelta_header *hdr = buf;
+
+	return le32_to_cpu(hdr->magic) == BDELTA_MAGIC;
+}
+
+/* Bytes of block blk that belong to the new image */
+static size_t blk_bytes(struct bdelta *bd, u32 blk)
+{
+	u32 blk_sz = le32_to_cpu(bd->hdr.blk_sz);
+
+	return min_t(u64, blk_sz,
+		     le64_to_cpu(bd->hdr.image_sz) - (u64)blk * blk_sz);
+}
+
+/* Reads block blk from the media into bd->media */
+static int read_block(struct bdelta *bd, u32 blk)
+{
+	u64 off = (u64)blk * le32_to_cpu(bd->hdr.blk_sz);
+
+	if (bd->ops.read(bd->ops.priv, off, bd->media,
+			 roundup(blk_bytes(bd, blk), bd->ops.blksz))) {
+		printf("\n[Error]: cannot read block %u\n", blk);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Checks that block blk of the media matches the new image */
+static int check_block(struct bdelta *bd, u32 blk)
+{
+	u8 digest[SHA256_SUM_LEN];
+
+	if (read_block(bd, blk))
+		return -1;
+
+	sha256_csum_wd(bd->media, blk_bytes(bd, blk), digest, CHUNKSZ_SHA256);
+	if (memcmp(digest, bd->digests + blk * SHA256_SUM_LEN,
+		   SHA256_SUM_LEN)) {
+		printf("\n[Error]: block %u does not match the base of the delta\n",
+		       blk);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Checks the blocks not carried in the delta up to block upto */
+static int check_range(struct bdelta *bd, u32 upto)
+{
+	if (bd->base_checked) {
+		bd->checked = upto;
+		return 0;
+	}
+
+	for (; bd->checked < upto; bd->checked++)
+		if (check_block(bd, bd->checked))
+			return -1;
+
+	return 0;
+}
+
+/* Writes the block just received, if the media does not hold it already */
+static int apply_block(struct bdelta *bd)
+{
+	u32 blk = bd->index[bd->rec];
+	size_t bytes = blk_bytes(bd, blk);
+	u64 off = (u64)blk * le32_to_cpu(bd->hdr.blk_sz);
+	u8 digest[SHA256_SUM_LEN];
+
+	if (check_range(bd, blk))
+		return -1;
+
+	sha256_csum_wd(bd->blk, bytes, digest, CHUNKSZ_SHA256);
+	if (memcmp(digest, bd->digests + blk * SHA256_SUM_LEN,
+		   SHA256_SUM_LEN)) {
+		printf("\n[Error]: block %u of the delta is corrupted\n", blk);
+		return -1;
+	}
+
+	if (read_block(bd, blk))
+		return -1;
+
+	if (!memcmp(bd->media, bd->blk, bytes)) {
+		bd->unchanged++;
+	} else {
+		if (bd->ops.write(bd->ops.priv, off, bd->blk,
+				  roundup(bytes, bd->ops.blksz))) {
+			printf("\n[Error]: cannot write block %u\n", blk);
+			return -1;
+		}
+		if (read_block(bd, blk))
+			return -1;
+		if (memcmp(bd->media, bd->blk, bytes)) {
+			printf("\n[Error]: block %u verification failed\n", blk);
+			return -1;
+		}
+		bd->written++;
+	}
+
+	bd->checked = blk + 1;
+	bd->rec++;
+
+	return 0;
+}
+
+/* Validates the header and allocates the buffers for the delta */
+static int setup(struct bdelta *bd)
+{
+	struct bdelta_header *hdr = &bd->hdr;
+	u32 blk_sz = le32_to_cpu(hdr->blk_sz);
+	u32 total = le32_to_cpu(hdr->total_blks);
+	u32 delta = le32_to_cpu(hdr->delta_blks);
+	u64 image_sz = le64_to_cpu(hdr->image_sz);
+
+	if (le32_to_cpu(hdr->magic) != BDELTA_MAGIC ||
+	    le16_to_cpu(hdr->version) != BDELTA_VERSION ||
+	    le16_to_cpu(hdr->hdr_sz) < sizeof(*hdr)) {
+		printf("\n[Error]: unsupported delta image\n");
+		return -1;
+	}
+
+	if (!blk_sz || blk_sz % bd->ops.blksz || !total || delta > total ||
+	    total > U32_MAX / SHA256_SUM_LEN ||
+	    (u64)(total - 1) * blk_sz >= image_sz ||
+	    (u64)total * blk_sz < image_sz) {
+		printf("\n[Error]: invalid delta image header\n");
+		return -1;
+	}
+
+	if (image_sz > bd->ops.size) {
+		printf("\n[Error]: delta image does not fit in the partition\n");
+		return -1;
+	}
+
+	bd->digests_off = le16_to_cpu(hdr->hdr_sz);
+	bd->index_off = bd->digests_off + (u64)total * SHA256_SUM_LEN;
+	bd->data_off = bd->index_off + (u64)delta * sizeof(*bd->index);
+	bd->end = bd->data_off + (u64)delta * blk_sz;
+
+	bd->digests = malloc(total * SHA256_SUM_LEN);
+	bd->index = malloc(max(delta, 1U) * sizeof(*bd->index));
+	bd->blk = malloc_cache_aligned(blk_sz);
+	bd->media = malloc_cache_aligned(blk_sz);
+	if (!bd->digests || !bd->index || !bd->blk || !bd->media) {
+		printf("\n[Error]: cannot allocate delta buffers\n");
+		return -1;
+	}
+
+	printf("Applying block delta (%u of %u blocks of %u bytes)\n",
+	       delta, total, blk_sz);
+
+	return 0;
+}
+
+/* Validates the index of the blocks carried in the delta */
+static int check_index(struct bdelta *bd)
+{
+	u32 total = le32_to_cpu(bd->hdr.total_blks);
+	u32 delta = le32_to_cpu(bd->hdr.delta_blks);
+	u32 i;
+
+	for (i = 0; i < delta; i++) {
+		bd->index[i] = le32_to_cpu(bd->index[i]);
+		if (bd->index[i] >= total ||
+		    (i && bd->index[i] <= bd->index[i - 1])) {
+			printf("\n[Error]: invalid delta image index\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Copies the part of the stream in section [start, start + size) to dst */
+static size_t copy_section(struct bdelta *bd, u64 start, u64 size, void *dst,
+			   const u8 *data, size_t len)
+{
+	size_t n = min_t(u64, len, start + size - bd->pos);
+
+	if (dst)
+		memcpy(dst + (bd->pos - start), data, n);
+	bd->pos += n;
+
+	return n;
+}
+
+void bdelta_start(struct bdelta *bd, const struct bdelta_ops *ops)
+{
+	memset(bd, 0, sizeof(*bd));
+	bd->ops = *ops;
+}
+
+/* Consumes the next len bytes of the delta */
+int bdelta_feed(struct bdelta *bd, const void *data, size_t len)
+{
+	u32 blk_sz = le32_to_cpu(bd->hdr.blk_sz);
+	const u8 *p = data;
+	u64 start;
+	size_t n;
+
+	while (len) {
+		if (bd->pos < sizeof(bd->hdr)) {
+			n = copy_section(bd, 0, sizeof(bd->hdr), &bd->hdr,
+					 p, len);
+			if (bd->pos == sizeof(bd->hdr) && setup(bd))
+				return -1;
+			blk_sz = le32_to_cpu(bd->hdr.blk_sz);
+		} else if (bd->pos < bd->digests_off) {
+			/* header fields of later revisions */
+			n = copy_section(bd, sizeof(bd->hdr),
+					 bd->digests_off - sizeof(bd->hdr),
+					 NULL, p, len);
+		} else if (bd->pos < bd->index_off) {
+			n = copy_section(bd, bd->digests_off,
+					 bd->index_off - bd->digests_off,
+					 bd->digests, p, len);
+		} else if (bd->pos < bd->data_off) {
+			n = copy_section(bd, bd->index_off,
+					 bd->data_off - bd->index_off,
+					 bd->index, p, len);
+			if (bd->pos == bd->data_off && check_index(bd))
+				return -1;
+		} else if (bd->pos < bd->end) {
+			start = bd->data_off + (u64)bd->rec * blk_sz;
+			n = copy_section(bd, start, blk_sz, bd->blk, p, len);
+			if (bd->pos == start + blk_sz && apply_block(bd))
+				return -1;
+		} else {
+			/* padding past the end of the delta */
+			n = len;
+			bd->pos += n;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Checks all the blocks not carried in the delta, so that nothing is
+ * written if the partition does not hold the base of the delta. The index
+ * must have been received.
+ */
+int bdelta_check_base(struct bdelta *bd)
+{
+	u32 total = le32_to_cpu(bd->hdr.total_blks);
+	u32 delta = le32_to_cpu(bd->hdr.delta_blks);
+	u32 blk, rec = 0;
+
+	printf("Checking base of the delta...\n");
+	for (blk = 0; blk < total; blk++) {
+		if (rec < delta && bd->index[rec] == blk) {
+			rec++;
+			continue;
+		}
+		if (check_block(bd, blk))
+			return -1;
+	}
+	bd->base_checked = true;
+
+	return 0;
+}
+
+void bdelta_abort(struct bdelta *bd)
+{
+	free(bd->digests);
+	free(bd->index);
+	free(bd->blk);
+	free(bd->media);
+	bd->digests = NULL;
+	bd->index = NULL;
+	bd->blk = NULL;
+	bd->media = NULL;
+}
+
+/* Checks the blocks after the last one carried and releases the delta */
+int bdelta_finish(struct bdelta *bd)
+{
+	u32 total = le32_to_cpu(bd->hdr.total_blks);
+	int ret = -1;
+
+	if (bd->pos < sizeof(bd->hdr) || bd->pos < bd->end) {
+		printf("\n[Error]: delta image is truncated\n");
+	} else if (!check_range(bd, total)) {
+		printf("Delta applied: %u blocks written, %u unchanged, %u kept\n",
+		       bd->written, bd->unchanged,
+		       total - bd->written - bd->unchanged);
+		ret = 0;
+	}
+	bdelta_abort(bd);
+
+	return ret;
+}
+
+/* Applies a delta held in RAM, checking the base before writing */
+int bdelta_write_image(const struct bdelta_ops *ops, const void *buf,
+		       size_t len)
+{
+	const u8 *p = buf;
+	struct bdelta bd;
+	size_t n;
+
+	bdelta_start(&bd, ops);
+	if (len < sizeof(bd.hdr))
+		return bdelta_finish(&bd);
+
+	if (bdelta_feed(&bd, p, sizeof(bd.hdr)))
+		goto abort;
+
+	n = min_t(u64, len, bd.data_off);
+	if (bdelta_feed(&bd, p + sizeof(bd.hdr), n - sizeof(bd.hdr)))
+		goto abort;
+	if (n == bd.data_off && bdelta_check_base(&bd))
+		goto abort;
+	if (bdelta_feed(&bd, p + n, len - n))
+		goto abort;
+
+	return bdelta_finish(&bd);
+
+abort:
+	bdelta_abort(&bd);
+	return -1;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2018 by Digi International Inc.
+ *  All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version2  as published by
+ *  the Free Software Foundation.
+*/
+
+#ifndef __DIGI_BDELTA_H
+#define __DIGI_BDELTA_H
+
+#include <bdelta_format.h>
+
+/* Access to the partition a block delta is applied to */
+struct bdelta_ops {
+	/* read/write len bytes at byte offset off of the partition */
+	int (*read)(void *priv, u64 off, void *buf, size_t len);
+	int (*write)(void *priv, u64 off, const void *buf, size_t len);
+	void *priv;
+	unsigned long blksz;	/* media block size, len is a multiple */
+	u64 size;		/* partition size in bytes */
+};
+
+struct bdelta {
+	struct bdelta_ops ops;
+	struct bdelta_header hdr;
+	u8 *digests;		/* digests of the blocks of the new image */
+	u32 *index;		/* blocks carried in the delta */
+	u8 *blk;		/* block being received */
+	u8 *media;		/* block read from the media */
+	u64 pos;		/* bytes of the delta received */
+	u64 digests_off;	/* offsets of the sections in the delta */
+	u64 index_off;
+	u64 data_off;
+	u64 end;
+	u32 rec;		/* next block of the delta to receive */
+	u32 checked;		/* blocks before this one are done */
+	bool base_checked;	/* bdelta_check_base() succeeded */
+	u32 written;
+	u32 unchanged;
+};
+
+/* State of the operations on an MMC partition, see bdelta_mmc_ops() */
+struct bdelta_mmc {
+	struct blk_desc *mmc_dev;
+	lbaint_t start;		/* first block of the partition */
+};
+
+bool bdelta_is_image(const void *buf);
+void bdelta_start(struct bdelta *bd, const struct bdelta_ops *ops);
+int bdelta_feed(struct bdelta *bd, const void *data, size_t len);
+int bdelta_check_base(struct bdelta *bd);
+int bdelta_finish(struct bdelta *bd);
+void bdelta_abort(struct bdelta *bd);
+int bdelta_write_image(const struct bdelta_ops *ops, const void *buf,
+		       size_t len);
+void bdelta_mmc_ops(struct bdelta_ops *ops, struct bdelta_mmc *bm,
+		    struct blk_desc *mmc_dev, disk_partition_t *part);
+
+#endif  /* __DIGI_BDELTA_H */
@@ -12,10 +12,13 @@
 #include <asm/imx-common/boot_mode.h>
 #ifdef CONFIG_FASTBOOT_FLASH
 #include <image-sparse.h>
+#include <mmc.h>
 #endif
 #include <otf_update.h>
 #include <part.h>
+#include "bdelta.h"
 #include "helper.h"
+#include "otf_decomp.h"
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -87,6 +90,14 @@ static lbaint_t fb_mmc_sparse_reserve(struct sparse_storage *info,
 {
 	return blkcnt;
 }
+
+static lbaint_t fb_mmc_sparse_erase(struct sparse_storage *info,
+				    lbaint_t blk, lbaint_t blkcnt)
+{
+	struct fb_mmc_sparse *sparse = info->priv;
+
+	return mmc_erase_zeroes(sparse->dev_desc, blk, blkcnt);
+}
 #endif
 
 enum {
@@ -95,11 +106,26 @@ enum {
 	ERR_VERIFY,
 };
 
+/* Reads back consecutive blocks of the MMC, starting at *priv */
+static int verify_read_mmc(void *priv, void *buf, size_t len)
+{
+	lbaint_t *blk = priv;
+	lbaint_t cnt = DIV_ROUND_UP(len, mmc_dev->blksz);
+
+	if (blk_dread(mmc_dev, *blk, cnt, buf) != cnt)
+		return -1;
+	*blk += cnt;
+
+	return 0;
+}
+
 static int write_firmware(char *partname, unsigned long loadaddr,
 			  unsigned long filesize, disk_partition_t *info)
 {
 	char cmd[CONFIG_SYS_CBSIZE] = "";
-	unsigned long size_blks, verifyaddr, u, m;
+	unsigned long size_blks;
+	lbaint_t blk;
+	int ret;
 
 #ifdef CONFIG_FASTBOOT_FLASH
 	if (is_sparse_image((void *)loadaddr)) {
@@ -112,6 +138,7 @@ static int write_firmware(char *partname, unsigned long loadaddr,
 			.size = info->size,
 			.write = fb_mmc_sparse_write,
 			.reserve = fb_mmc_sparse_reserve,
+			.erase = fb_mmc_sparse_erase,
 			.priv = &sparse_priv,
 		};
 
@@ -119,6 +146,42 @@ static int write_firmware(char *partname, unsigned long loadaddr,
 					  filesize) ? ERR_WRITE : 0;
 	}
 #endif
+	if (bdelta_is_image((void *)loadaddr) ||
+	    otf_decomp_detect((void *)loadaddr, filesize) != OTF_DECOMP_NONE) {
+		struct bdelta_ops ops;
+		struct bdelta_mmc bm;
+		otf_data_t otfd = {
+			.loadaddr = (void *)loadaddr,
+			.len = filesize,
+			.part = info,
+			.flags = OTF_FLAG_INIT | OTF_FLAG_FLUSH,
+		};
+
+		if (!strcmp(partname, "uboot")) {
+			printf("Delta and compressed images are not supported for U-Boot\n");
+			return -1;
+		}
+
+		/* Change to storage device */
+		sprintf(cmd, "%s dev %d", CONFIG_SYS_STORAGE_MEDIA,
+			mmc_dev_index);
+		if (run_command(cmd, 0)) {
+			debug("Cannot change to storage device\n");
+			return -1;
+		}
+
+		if (bdelta_is_image((void *)loadaddr)) {
+			bdelta_mmc_ops(&ops, &bm, mmc_dev, info);
+			if (bdelta_write_image(&ops, (void *)loadaddr, filesize))
+				return ERR_WRITE;
+		} else if (update_chunk(&otfd)) {
+			/* decompressed as it would be on the fly */
+			return ERR_WRITE;
+		}
+		printf("Update was successful\n");
+		return 0;
+	}
+
 	size_blks = (filesize / mmc_dev->blksz) + (filesize % mmc_dev->blksz != 0);
 
 	if (size_blks > info->size) {
@@ -152,59 +215,15 @@ static int write_firmware(char *partname, unsigned long loadaddr,
 	if (run_command(cmd, 0))
 		return ERR_WRITE;
 
-	/* If there is enough RAM to hold two copies of the firmware,
-	 * verify written firmware.
-	 * +--------|---------------------|------------------|--------------+
-	 * |        L                     V                  | U-Boot+Stack |
-	 * +--------|---------------------|------------------|--------------+
-	 * P                                                 U              M
-	 *
-	 *  P = PHYS_SDRAM (base address of SDRAM)
-	 *  L = $loadaddr
-	 *  V = $verifyaddr
-	 *  M = last address of SDRAM ((size of SDRAM) + P)
-	 *  U = SDRAM address where U-Boot is located (plus margin)
-	 */
-	verifyaddr = getenv_ulong("verifyaddr", 16, 0);
-	m = PHYS_SDRAM + gd->ram_size;
-	u = m - CONFIG_UBOOT_RESERVED;
-
-	/* ($loadaddr + firmware size) must not exceed $verifyaddr
-	 * ($verifyaddr + firmware size) must not exceed U
-	 */
-	if ((loadaddr + size_blks * mmc_dev->blksz) < verifyaddr &&
-	    (verifyaddr + size_blks * mmc_dev->blksz) < u) {
-		unsigned long filesize_padded;
-		int i;
-
-		/* Read back data... */
-		printf("Reading back firmware...\n");
-		sprintf(cmd, "%s read %lx %lx %lx", CONFIG_SYS_STORAGE_MEDIA,
-			verifyaddr, info->start, size_blks);
-		if (run_command(cmd, 0))
-			return ERR_READ;
-		/* ...then compare by 32-bit words (faster than by bytes)
-		 * padding with zeros any bytes at the end to make the size
-		 * be a multiple of 4.
-		 *
-		 * Reference: http://stackoverflow.com/a/2022252
-		 */
-		printf("Verifying firmware...\n");
-		filesize_padded = (filesize + (4 - 1)) & ~(4 - 1);
-
-		for (i = filesize; i < filesize_padded; i++) {
-			*((char *)loadaddr + i) = 0;
-			*((char *)verifyaddr + i) = 0;
-		}
-		sprintf(cmd, "cmp.l %lx %lx %lx", loadaddr, verifyaddr,
-			(filesize_padded / 4));
-		if (run_command(cmd, 0))
-			return ERR_VERIFY;
-		printf("Update was successful\n");
-	} else {
-		printf("Firmware updated but not verified "
-		       "(not enough available RAM to verify)\n");
-	}
+	/* Verify written firmware */
+	printf("Verifying firmware...\n");
+	blk = info->start;
+	ret = hash_verify(verify_read_mmc, &blk, (void *)loadaddr, filesize);
+	if (ret == -EIO)
+		return ERR_READ;
+	else if (ret)
+		return ERR_VERIFY;
+	printf("Update was successful\n");
 
 	return 0;
 }
@@ -354,9 +373,6 @@ static int do_update(cmd_tbl_t* cmdtp, int flag, int argc, char * const argv[])
 		return CMD_RET_FAILURE;
 
 	loadaddr = getenv_ulong("update_addr", 16, CONFIG_DIGI_UPDATE_ADDR );
-	/* If undefined, calculate 'verifyaddr' */
-	if (NULL == getenv("verifyaddr"))
-		set_verifyaddr(loadaddr);
 
 	if (fwinfo.src == SRC_RAM) {
 		/* Get address in RAM where firmware file is */
@@ -492,6 +508,10 @@ U_BOOT_CMD(
 	"Digi modules update command",
 	"<partition>  [source] [extra-args...]\n"
 	" Description: updates (raw writes) <partition> in $mmcdev via <source>\n"
+	"              Block delta images (made with mkbdelta) only write the\n"
+	"              blocks that differ from the installed image\n"
+	"              gzip and LZ4 compressed images are decompressed as they\n"
+	"              are written\n"
 	" Arguments:\n"
 	"   - partition:    a partition index, a GUID partition name, or one\n"
 	"                   of the reserved names: uboot\n"
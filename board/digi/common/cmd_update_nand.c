@@ -9,6 +9,7 @@
 #include <asm/imx-common/boot_mode.h>
 #include <common.h>
 #include <jffs2/load_kernel.h>
+#include <linux/sizes.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
 #include <mapmem.h>
@@ -17,6 +18,7 @@
 #include <ubi_uboot.h>
 
 #include "helper.h"
+#include "otf_decomp.h"
 #ifdef CONFIG_CMD_BOOTSTREAM
 #include "cmd_bootstream/cmd_bootstream.h"
 #endif
@@ -60,24 +62,49 @@ static int ubi_attach_getcreatevol(char *partname, const char **volname)
 	return ret;
 }
 
-static int write_firmware(unsigned long loadaddr, unsigned long filesize,
-			  struct part_info *part)
+struct verify_pos_nand {
+	struct mtd_info *mtd;
+	loff_t off;		/* next offset to read, bad blocks included */
+	loff_t end;		/* end of the partition */
+};
+
+/* Reads back data written with bad block skipping */
+static int verify_read_nand(void *priv, void *buf, size_t len)
 {
-	uint32_t *magic;
-	const char *ubivolname = NULL;
-	char cmd[CONFIG_SYS_CBSIZE] = "";
-	unsigned long verifyaddr, u, m;
+	struct verify_pos_nand *pos = priv;
+	size_t actual;
 
-	if (filesize > part->size) {
-		printf("File size (%lu bytes) exceeds partition size (%lu bytes)!\n",
-			filesize, (unsigned long)part->size);
+	if (nand_read_skip_bad(pos->mtd, pos->off, &len, &actual,
+			       pos->end - pos->off, buf))
 		return -1;
-	}
+	pos->off += actual;
+
+	return 0;
+}
+
+static void print_write_rate(unsigned long bytes, unsigned long ms)
+{
+	printf("Written %lu bytes in %lu ms", bytes, ms);
+	if (ms)
+		printf(" (%lu KiB/s)", bytes / ms * 1000 / 1024);
+	printf("\n");
+}
+
+/*
+ * Gets the partition ready for an image that starts with data: attaches or
+ * creates the UBI volume of the partition for a UBIFS image, and erases the
+ * partition otherwise. *ubivolname is only set for a UBIFS image.
+ */
+static int prepare_partition(struct part_info *part, const void *data,
+			     const char **ubivolname)
+{
+	char cmd[CONFIG_SYS_CBSIZE] = "";
+
+	*ubivolname = NULL;
 
 #ifdef CONFIG_DIGI_UBI
 	/* Check if the file to write is UBIFS */
-	magic = (uint32_t *)map_sysmem(loadaddr, 0);
-	if (*magic == UBIFS_MAGIC) {
+	if (*(const uint32_t *)data == UBIFS_MAGIC) {
 		/*
 		 * If the partition is not U-Boot (whose sectors must be raw-read),
 		 * ensure the partition is UBI formatted.
@@ -88,19 +115,19 @@ static int write_firmware(unsigned long loadaddr, unsigned long filesize,
 
 			if (is_ubi_partition(part)) {
 				/* Attach partition and get volume name */
-				ubi_attach_getcreatevol(part->name, &ubivolname);
+				ubi_attach_getcreatevol(part->name, ubivolname);
 			}
 
 			/*
 			 * If the partition does not have a valid UBI volume,
 			 * erase the partition and create the UBI volume.
 			 */
-			if (!ubivolname) {
+			if (!*ubivolname) {
 				sprintf(cmd, "nand erase.part %s", part->name);
 				if (run_command(cmd, 0))
 					return ERR_WRITE;
 				/* Attach partition and get volume name */
-				ubi_attach_getcreatevol(part->name, &ubivolname);
+				ubi_attach_getcreatevol(part->name, ubivolname);
 			}
 		}
 	}
@@ -115,87 +142,220 @@ static int write_firmware(unsigned long loadaddr, unsigned long filesize,
 	}
 #endif /* CONFIG_DIGI_UBI */
 
-	if (ubivolname) {
-		/* A UBI volume exists in the partition, use 'ubi write' */
-		sprintf(cmd, "ubi write %lx %s %lx", loadaddr, ubivolname,
-			filesize);
-	} else {
-		/* raw-write firmware command */
-		sprintf(cmd, "nand write %lx %s %lx;fi", loadaddr, part->name,
-			filesize);
+	return 0;
+}
+
+/*
+ * A compressed image is decompressed into two windows of RAM past the
+ * compressed data. A full window is written while the other one fills, so
+ * that the last write of the image is known when it is made.
+ */
+#define DECOMP_WINDOW	SZ_4M
+
+struct nand_decomp {
+	struct part_info *part;
+	u8 *window[2];
+	int fill;		/* window being decompressed to */
+	size_t pending;		/* bytes of the other window to write */
+	bool started;		/* partition prepared for the image */
+	bool first;		/* nothing written yet */
+	const char *ubivolname;
+	loff_t off;		/* next offset to write, bad blocks included */
+	struct verify_pos_nand pos;
+	struct hash_verify hv;
+	int err;
+};
+
+/* Writes len bytes of a window to the partition */
+static int decomp_write(struct nand_decomp *nd, u8 *buf, size_t len,
+			bool last)
+{
+	struct mtd_info *mtd = nand_info[nd->part->dev->id->num];
+	size_t actual;
+	int ret;
+
+	if (!nd->started) {
+		nd->err = prepare_partition(nd->part, buf, &nd->ubivolname);
+		if (nd->err)
+			return -1;
+		nd->started = true;
 	}
-	if (run_command(cmd, 0))
-		return ERR_WRITE;
 
 #ifdef CONFIG_DIGI_UBI
-	/* If it is a UBIFS file system, verify it using a special function */
-	if (ubivolname) {
-		printf("Verifying firmware...\n");
-		if (ubi_volume_verify(part->name, (char *)loadaddr, 0,
-				      filesize, 0))
-			return ERR_VERIFY;
-		printf("Update was successful\n");
-
+	if (nd->ubivolname) {
+		/* UBI checks the VID header of every LEB written */
+		if (ubi_volume_off_write((char *)nd->ubivolname, buf, len,
+					 nd->first, last))
+			return -1;
+		nd->first = false;
 		return 0;
 	}
 #endif
 
-	/*
-	 * If there is enough RAM to hold two copies of the firmware,
-	 * verify written firmware.
-	 * +--------|---------------------|------------------|--------------+
-	 * |        L                     V                  | U-Boot+Stack |
-	 * +--------|---------------------|------------------|--------------+
-	 * P                                                 U              M
-	 *
-	 *  P = PHYS_SDRAM (base address of SDRAM)
-	 *  L = $loadaddr
-	 *  V = $verifyaddr
-	 *  M = last address of SDRAM ((size of SDRAM) + P)
-	 *  U = SDRAM address where U-Boot is located (plus margin)
-	 */
-	verifyaddr = getenv_ulong("verifyaddr", 16, 0);
-	m = PHYS_SDRAM + gd->ram_size;
-	u = m - CONFIG_UBOOT_RESERVED;
-
-	/*
-	 * ($loadaddr + firmware size) must not exceed $verifyaddr
-	 * ($verifyaddr + firmware size) must not exceed U.
-	 */
-	if ((loadaddr + filesize) < verifyaddr &&
-	    (verifyaddr + filesize) < u) {
-		unsigned long filesize_padded;
-		int i;
-
-		/* Read back data... */
-		printf("Reading back firmware...\n");
-		sprintf(cmd, "nand read %lx %s %lx", verifyaddr, part->name,
-			filesize);
-		if (run_command(cmd, 0))
-			return ERR_READ;
+	nd->first = false;
+	if (nand_write_skip_bad(mtd, nd->off, &len, &actual,
+				nd->pos.end - nd->off, buf, 0))
+		return -1;
+	nd->off += actual;
+
+	ret = hash_verify_update(&nd->hv, verify_read_nand, &nd->pos, buf, len);
+	if (ret) {
+		nd->err = ERR_READ;
+		return -1;
+	}
+	if (last && hash_verify_finish(&nd->hv)) {
+		nd->err = ERR_VERIFY;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *decomp_get_buf(void *priv, size_t *size)
+{
+	struct nand_decomp *nd = priv;
+
+	*size = DECOMP_WINDOW;
+
+	return nd->window[nd->fill];
+}
+
+static int decomp_put_buf(void *priv, size_t len, bool last)
+{
+	struct nand_decomp *nd = priv;
+
+	if (nd->pending &&
+	    decomp_write(nd, nd->window[!nd->fill], nd->pending, last && !len))
+		return -1;
+	nd->pending = 0;
+
+	if (last)
+		return len ? decomp_write(nd, nd->window[nd->fill], len, true) : 0;
+
+	nd->pending = len;
+	nd->fill = !nd->fill;
+
+	return 0;
+}
+
+static int write_compressed(unsigned long loadaddr, unsigned long filesize,
+			    struct part_info *part,
+			    enum otf_decomp_type type)
+{
+	struct otf_decomp dc;
+	struct nand_decomp nd = {
+		.part = part,
+		.first = true,
+		.off = part->offset,
+		.pos = {
+			.mtd = nand_info[part->dev->id->num],
+			.off = part->offset,
+			.end = part->offset + part->size,
+		},
+	};
+	struct otf_decomp_ops ops = {
+		.get_buf = decomp_get_buf,
+		.put_buf = decomp_put_buf,
+		.priv = &nd,
+	};
+	ulong start;
+	int ret;
+
+	nd.window[0] = (u8 *)loadaddr + ALIGN(filesize, SZ_1M);
+	nd.window[1] = nd.window[0] + DECOMP_WINDOW;
+	/* Keep the windows clear of the stack, leaving it 1 MiB to grow */
+	if ((ulong)nd.window[1] + DECOMP_WINDOW > gd->start_addr_sp - SZ_1M) {
+		printf("\n[Error]: No RAM left to decompress the image past "
+		       "0x%lx\n", (ulong)nd.window[0]);
+		return ERR_WRITE;
+	}
+
+	ret = hash_verify_start(&nd.hv);
+	if (ret)
+		return ERR_WRITE;
+
+	start = get_timer(0);
+	if (otf_decomp_start(&dc, type, &ops) ||
+	    otf_decomp_feed(&dc, (void *)loadaddr, filesize)) {
+		otf_decomp_abort(&dc);
+		ret = -1;
+	} else {
+		ret = otf_decomp_finish(&dc);
+	}
+	/* a raw image finished the verification with its last write */
+	if (nd.hv.buf)
+		hash_verify_finish(&nd.hv);
+	if (ret)
+		return nd.err ? nd.err : ERR_WRITE;
+	print_write_rate(dc.total, get_timer(start));
+	printf("Update was successful\n");
+
+	return 0;
+}
+
+static int write_firmware(unsigned long loadaddr, unsigned long filesize,
+			  struct part_info *part)
+{
+	enum otf_decomp_type type;
+	const char *ubivolname;
+	char cmd[CONFIG_SYS_CBSIZE] = "";
+	struct verify_pos_nand pos;
+	ulong start;
+	int ret;
+
+	if (filesize > part->size) {
+		printf("File size (%lu bytes) exceeds partition size (%lu bytes)!\n",
+			filesize, (unsigned long)part->size);
+		return -1;
+	}
+
+	/* Compressed images are decompressed as they are written */
+	type = otf_decomp_detect((void *)loadaddr, filesize);
+	if (type != OTF_DECOMP_NONE)
+		return write_compressed(loadaddr, filesize, part, type);
+
+	ret = prepare_partition(part, map_sysmem(loadaddr, 0), &ubivolname);
+	if (ret)
+		return ret;
+
+#ifdef CONFIG_DIGI_UBI
+	if (ubivolname) {
 		/*
-		 * ...then compare by 32-bit words (faster than by bytes)
-		 * padding with zeros any bytes at the end to make the size
-		 * be a multiple of 4.
-		 *
-		 * Reference: http://stackoverflow.com/a/2022252
+		 * A UBI volume exists in the partition. Write it in one go;
+		 * UBI relies on the program status of the data pages and
+		 * reads back the VID header that records their CRC.
 		 */
-		printf("Verifying firmware...\n");
-		filesize_padded = (filesize + (4 - 1)) & ~(4 - 1);
-
-		for (i = filesize; i < filesize_padded; i++) {
-			*((char *)loadaddr + i) = 0;
-			*((char *)verifyaddr + i) = 0;
-		}
-		sprintf(cmd, "cmp.l %lx %lx %lx", loadaddr, verifyaddr,
-			(filesize_padded / 4));
-		if (run_command(cmd, 0))
-			return ERR_VERIFY;
+		start = get_timer(0);
+		ret = ubi_volume_off_write((char *)ubivolname, (void *)loadaddr,
+					   filesize, 1, 1);
+		if (ret)
+			return ret == -EBADMSG ? ERR_VERIFY : ERR_WRITE;
+		print_write_rate(filesize, get_timer(start));
 		printf("Update was successful\n");
-	} else {
-		printf("Firmware updated but not verified "
-		       "(not enough available RAM to verify)\n");
+
+		return 0;
 	}
+#endif
+
+	/* raw-write firmware command */
+	sprintf(cmd, "nand write %lx %s %lx;fi", loadaddr, part->name,
+		filesize);
+	start = get_timer(0);
+	if (run_command(cmd, 0))
+		return ERR_WRITE;
+	print_write_rate(filesize, get_timer(start));
+
+	/* Verify written firmware */
+	printf("Verifying firmware...\n");
+	pos.mtd = nand_info[part->dev->id->num];
+	pos.off = part->offset;
+	pos.end = part->offset + part->size;
+	ret = hash_verify(verify_read_nand, &pos, (void *)loadaddr, filesize);
+	if (ret == -EIO)
+		return ERR_READ;
+	else if (ret)
+		return ERR_VERIFY;
+	printf("Update was successful\n");
 
 	return 0;
 }
@@ -254,9 +414,6 @@ static int do_update(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 		return CMD_RET_FAILURE;
 
 	loadaddr = getenv_ulong("update_addr", 16, CONFIG_DIGI_UPDATE_ADDR);
-	/* If undefined, calculate 'verifyaddr' */
-	if (NULL == getenv("verifyaddr"))
-		set_verifyaddr(loadaddr);
 
 	if (fwinfo.src == SRC_RAM) {
 		/* Get address in RAM where firmware file is */
@@ -345,6 +502,8 @@ U_BOOT_CMD(
 	"              If the partition is UBI formatted, or a filename with\n"
 	"              extension *.ubifs is passed, writing a UBIFS is assumed\n"
 	"              Otherwise, this command raw-writes the file to the partition.\n"
+	"              gzip and LZ4 compressed images are decompressed as they\n"
+	"              are written\n"
 	"\n"
 	" Arguments:\n"
 	"   - partition:    a partition index, a GUID partition name, or one\n"
@@ -8,11 +8,14 @@
 */
 #include <common.h>
 #include <console.h>
+#include <fs.h>
 #include <linux/errno.h>
 #include <fsl_sec.h>
 #include <asm/imx-common/hab.h>
+#include <linux/sizes.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <memalign.h>
 #include <nand.h>
 #include <version.h>
 #include <watchdog.h>
@@ -116,24 +119,30 @@ void unregister_fs_otf_update_hook(void)
 }
 
 /* On-the-fly update for files in a filesystem on mass storage media
+ * The file is opened once and read chunk after chunk, so that neither the
+ * partition is probed nor the path resolved again for every chunk.
  * The function returns:
  *	0 if the file was loaded successfully
  *	-1 on error
  */
 static int write_file_fs_otf(int src, char *filename, char *devpartno)
 {
-	char cmd[CONFIG_SYS_CBSIZE] = "";
-	unsigned long filesize;
-	unsigned long remaining;
-	unsigned long offset = 0;
+	loff_t filesize;
+	loff_t remaining;
+	loff_t actread;
+	int ret = -1;
+
+	if (fs_set_blk_dev(src_strings[src], devpartno, FS_TYPE_ANY)) {
+		printf("Couldn't access %s %s\n", src_strings[src], devpartno);
+		return -1;
+	}
 
-	/* Obtain file size */
-	sprintf(cmd, "size %s %s %s", src_strings[src], devpartno, filename);
-	if (run_command(cmd, 0)) {
+	/* Open file and obtain its size */
+	if (fs_open_file(filename, &filesize)) {
 		printf("Couldn't determine file size\n");
 		return -1;
 	}
-	filesize = getenv_ulong("filesize", 16, 0);
+	setenv_hex("filesize", filesize);
 	remaining = filesize;
 
 	/* Init otf data */
@@ -142,7 +151,7 @@ static int write_file_fs_otf(int src, char *filename, char *devpartno)
 	while (remaining > 0) {
 		unsigned long max_length = CONFIG_OTF_CHUNK - otfd.offset;
 
-		debug("%lu remaining bytes\n", remaining);
+		debug("%llu remaining bytes\n", remaining);
 		/* Determine chunk length to write */
 		if (remaining > max_length) {
 			otfd.len = max_length;
@@ -151,28 +160,27 @@ static int write_file_fs_otf(int src, char *filename, char *devpartno)
 			otfd.len = remaining;
 		}
 
-		/* Load 'len' bytes from file[offset] into RAM */
-		sprintf(cmd, "load %s %s 0x%p %s %x %x", src_strings[src],
-			devpartno, otfd.loadaddr + otfd.offset, filename,
-			otfd.len, (unsigned int) offset);
-		if (run_command(cmd, 0)) {
+		/* Load the next 'len' bytes of the file into RAM */
+		if (fs_read_next((ulong)otfd.loadaddr + otfd.offset, otfd.len,
+				 &actread) || actread != otfd.len) {
 			printf("Couldn't load file\n");
-			return -1;
+			goto out;
 		}
 
 		/* Write chunk */
 		if (otf_update_hook(&otfd)) {
 			printf("Error writing on-the-fly. Aborting\n");
-			return -1;
+			goto out;
 		}
 
-		/* Update local target offset */
-		offset += otfd.len;
 		/* Update remaining bytes */
 		remaining -= otfd.len;
 	}
+	ret = 0;
 
-	return 0;
+out:
+	fs_close_file();
+	return ret;
 }
 #endif /* CONFIG_CMD_UPDATE */
 
@@ -813,27 +821,79 @@ u64 memsize_parse(const char *const ptr, const char **retptr)
 	return ret;
 }
 
+#ifdef CONFIG_CMD_UPDATE
+#define VERIFY_BLOCK_SIZE	SZ_64K
+
 /*
- * Calculate a RAM address for verification during update command.
- * To make the better use of RAM, calculate it around half way through the
- * available RAM, but skipping reserved areas.
+ * Written data is verified by reading it back VERIFY_BLOCK_SIZE bytes at a
+ * time and comparing the SHA-256 digest of what was read with the digest of
+ * the data that was written, so no RAM is needed for a copy of the image.
  */
-void set_verifyaddr(unsigned long loadaddr)
+int hash_verify_start(struct hash_verify *hv)
 {
-	 unsigned long verifyaddr;
+	hv->buf = malloc_cache_aligned(VERIFY_BLOCK_SIZE);
+	if (!hv->buf)
+		return -ENOMEM;
 
-	 verifyaddr = loadaddr + ((gd->ram_size - (loadaddr - PHYS_SDRAM)) / 2);
+	sha256_starts(&hv->data);
+	sha256_starts(&hv->media);
 
-	 /* Skip reserved memory area */
-#if defined(RESERVED_MEM_START) && defined(RESERVED_MEM_END)
-	if (verifyaddr >= RESERVED_MEM_START && verifyaddr < RESERVED_MEM_END)
-		verifyaddr = RESERVED_MEM_END;
-#endif
+	return 0;
+}
+
+/*
+ * Add len bytes of written data to the verification, reading back the same
+ * amount of data from the media with read().
+ */
+int hash_verify_update(struct hash_verify *hv, verify_read_t read, void *priv,
+		       const void *data, size_t len)
+{
+	size_t n;
+
+	sha256_update(&hv->data, data, len);
 
-	 if (verifyaddr > loadaddr &&
-	     verifyaddr < (PHYS_SDRAM + gd->ram_size))
-		 setenv_hex("verifyaddr", verifyaddr);
- }
+	while (len) {
+		n = min_t(size_t, len, VERIFY_BLOCK_SIZE);
+		if (read(priv, hv->buf, n))
+			return -EIO;
+		sha256_update(&hv->media, hv->buf, n);
+		len -= n;
+		WATCHDOG_RESET();
+	}
+
+	return 0;
+}
+
+/* Returns 0 if the data read back matches the data written */
+int hash_verify_finish(struct hash_verify *hv)
+{
+	u8 data[SHA256_SUM_LEN];
+	u8 media[SHA256_SUM_LEN];
+
+	free(hv->buf);
+	hv->buf = NULL;
+
+	sha256_finish(&hv->data, data);
+	sha256_finish(&hv->media, media);
+
+	return memcmp(data, media, SHA256_SUM_LEN) ? -EBADMSG : 0;
+}
+
+int hash_verify(verify_read_t read, void *priv, const void *data, size_t len)
+{
+	struct hash_verify hv;
+	int ret, err;
+
+	ret = hash_verify_start(&hv);
+	if (ret)
+		return ret;
+
+	ret = hash_verify_update(&hv, read, priv, data, len);
+	err = hash_verify_finish(&hv);
+
+	return ret ? ret : err;
+}
+#endif /* CONFIG_CMD_UPDATE */
 
 #ifdef CONFIG_HAS_TRUSTFENCE
 #define RNG_FAIL_EVENT_SIZE 36
@@ -11,6 +11,7 @@
 #define __DIGI_HELPER_H
 
 #include <jffs2/load_kernel.h>
+#include <u-boot/sha256.h>
 
 enum {
 	SRC_UNDEFINED = -2,
@@ -46,6 +47,16 @@ struct load_fw {
 	struct part_info *part;
 };
 
+/* Verification of written data against the SHA-256 digest of the source */
+struct hash_verify {
+	sha256_context data;	/* digest of the data written */
+	sha256_context media;	/* digest of the data read back */
+	void *buf;		/* read-back buffer */
+};
+
+/* Reads the next len bytes of written data back from the media */
+typedef int (*verify_read_t)(void *priv, void *buf, size_t len);
+
 #define SW_RNG_TEST_FAILED 	1
 #define SW_RNG_TEST_PASSED 	2
 #define SW_RNG_TEST_NA 		3
@@ -78,7 +89,11 @@ size_t media_get_block_size(void);
 unsigned int get_filesystem_key_offset(void);
 uint get_env_hwpart(void);
 u64 memsize_parse(const char *const ptr, const char **retptr);
-void set_verifyaddr(unsigned long loadaddr);
+int hash_verify_start(struct hash_verify *hv);
+int hash_verify_update(struct hash_verify *hv, verify_read_t read, void *priv,
+		       const void *data, size_t len);
+int hash_verify_finish(struct hash_verify *hv);
+int hash_verify(verify_read_t read, void *priv, const void *data, size_t len);
 int hab_event_warning_check(uint8_t *event, size_t *bytes);
 #ifdef CONFIG_AUTHENTICATE_SQUASHFS_ROOTFS
 int read_squashfs_rootfs(unsigned long addr, unsigned long *size);
@@ -7,6 +7,7 @@
  *  the Free Software Foundation.
 */
 #include <common.h>
+#include <div64.h>
 #ifdef CONFIG_FSL_ESDHC
 #include <fsl_esdhc.h>
 #endif
@@ -14,9 +15,15 @@
 #include <mmc.h>
 #include <malloc.h>
 #include <otf_update.h>
+#include <linux/sizes.h>
+#include "bdelta.h"
+#include "helper.h"
+#include "otf_decomp.h"
 
 #define ALIGN_SUP(x, a) (((x) + (a - 1)) & ~(a - 1))
 
+DECLARE_GLOBAL_DATA_PTR;
+
 extern int mmc_get_bootdevindex(void);
 
 /*
@@ -199,21 +206,166 @@ uint get_env_hwpart(void)
 	return mmc_get_env_part(mmc);
 }
 
+static int bdelta_mmc_read(void *priv, u64 off, void *buf, size_t len)
+{
+	struct bdelta_mmc *bm = priv;
+	lbaint_t blk = bm->start + lldiv(off, bm->mmc_dev->blksz);
+	lbaint_t cnt = len / bm->mmc_dev->blksz;
+
+	return blk_dread(bm->mmc_dev, blk, cnt, buf) != cnt;
+}
+
+static int bdelta_mmc_write(void *priv, u64 off, const void *buf, size_t len)
+{
+	struct bdelta_mmc *bm = priv;
+	lbaint_t blk = bm->start + lldiv(off, bm->mmc_dev->blksz);
+	lbaint_t cnt = len / bm->mmc_dev->blksz;
+
+	return blk_dwrite(bm->mmc_dev, blk, cnt, buf) != cnt;
+}
+
+/*
+ * Get the operations to apply a block delta to a partition of mmc_dev.
+ * They keep their state in 'bm', which must outlive the delta.
+ */
+void bdelta_mmc_ops(struct bdelta_ops *ops, struct bdelta_mmc *bm,
+		    struct blk_desc *mmc_dev, disk_partition_t *part)
+{
+	bm->mmc_dev = mmc_dev;
+	bm->start = part->start;
+
+	ops->read = bdelta_mmc_read;
+	ops->write = bdelta_mmc_write;
+	ops->priv = bm;
+	ops->blksz = mmc_dev->blksz;
+	ops->size = (u64)part->size * mmc_dev->blksz;
+}
+
 #ifdef CONFIG_FSL_ESDHC
 extern int mmc_get_bootdevindex(void);
 
+/*
+ * The RAM at the OTF load address is split in two chunk slots. While the
+ * chunk in one slot is written to the media, the next chunk is received into
+ * the other slot. The write is done in slices from the idle calls of the
+ * hook (OTF_FLAG_IDLE), one slice for every slice of data received, so that
+ * it completes by the time the next slot is full.
+ */
+#define OTF_SLOTS	2
+#define OTF_SLOT_SIZE	(CONFIG_OTF_CHUNK + SZ_128K)
+#define OTF_SLICE	SZ_256K
+
+static struct {
+	void *base;		/* start of the first slot */
+	int slot;		/* slot being filled */
+	void *buf;		/* data of the pending write */
+	lbaint_t blk;		/* next block of the pending write */
+	lbaint_t blkcnt;	/* blocks left of the pending write */
+	unsigned int credit;	/* bytes received since the last slice */
+	struct hash_verify hv;	/* verification of the pending write */
+	lbaint_t vblk;		/* next block to read back */
+} otf_ring;
+
+/* Block delta being received, written as it arrives instead of by chunks */
+static struct bdelta otf_bdelta;
+static struct bdelta_mmc otf_bdelta_mmc;
+
+/*
+ * A compressed image is decompressed as it is received. The decompressed
+ * data goes through the chunk slots as if it was the image received, and
+ * the slots are moved past the compressed data loaded at the start of the
+ * RAM, a chunk of it or the whole image if it was loaded before the update.
+ */
+static struct otf_decomp otf_decomp;
+static otf_data_t otf_plain;	/* the decompressed image */
+
+/* Reads back the blocks just written by write_blocks() */
+static int verify_read_otf(void *priv, void *buf, size_t len)
+{
+	struct blk_desc *mmc_dev = priv;
+	lbaint_t cnt = DIV_ROUND_UP(len, mmc_dev->blksz);
+
+	if (blk_dread(mmc_dev, otf_ring.vblk, cnt, buf) != cnt)
+		return -1;
+	otf_ring.vblk += cnt;
+
+	return 0;
+}
+
+/* Write blocks to media and add them to the verification of the chunk */
+static int write_blocks(struct blk_desc *mmc_dev, void *buf, lbaint_t blk,
+			lbaint_t blkcnt)
+{
+	unsigned long written;
+
+	debug("writing 0x" LBAFU " blocks from 0x%p to block " LBAFU "\n",
+	      blkcnt, buf, blk);
+	written = blk_dwrite(mmc_dev, blk, blkcnt, buf);
+	if (written != blkcnt) {
+		printf("[Error]: written sectors != sectors to write\n");
+		return -1;
+	}
+
+	otf_ring.vblk = blk;
+	if (hash_verify_update(&otf_ring.hv, verify_read_otf, mmc_dev, buf,
+			       blkcnt * mmc_dev->blksz)) {
+		printf("[Error]: read sectors != sectors to read\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Make progress on the pending chunk write: one slice if enough new data
+ * arrived since the last one, or all of it if 'all' is set.
+ */
+static int write_pending(struct blk_desc *mmc_dev, int all)
+{
+	lbaint_t cnt;
+
+	while (otf_ring.blkcnt) {
+		if (!all && otf_ring.credit < OTF_SLICE)
+			return 0;
+
+		cnt = min_t(lbaint_t, otf_ring.blkcnt,
+			    OTF_SLICE / mmc_dev->blksz);
+		if (write_blocks(mmc_dev, otf_ring.buf, otf_ring.blk, cnt)) {
+			otf_ring.blkcnt = 0;
+			hash_verify_finish(&otf_ring.hv);
+			return -1;
+		}
+
+		otf_ring.buf += cnt * mmc_dev->blksz;
+		otf_ring.blk += cnt;
+		otf_ring.blkcnt -= cnt;
+		if (!otf_ring.blkcnt) {
+			if (hash_verify_finish(&otf_ring.hv)) {
+				printf("\n[Error]: chunk verification failed\n");
+				return -1;
+			}
+			printf("\nWriting chunk...[OK]\n");
+		}
+
+		if (!all) {
+			otf_ring.credit -= OTF_SLICE;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* Queue the chunk at otfd->loadaddr to be written to dstblk */
 static int write_chunk(struct mmc *mmc, struct blk_desc *mmc_dev,
 		       otf_data_t *otfd, lbaint_t dstblk,
 		       unsigned int chunklen)
 {
 	int sectors;
-	unsigned long written, read;
-	void *verifyaddr;
 
-	printf("\nWriting chunk...");
 	/* Check WP */
 	if (mmc_getwp(mmc) == 1) {
-		printf("[Error]: card is write protected!\n");
+		printf("\n[Error]: card is write protected!\n");
 		return -1;
 	}
 
@@ -226,51 +378,21 @@ static int write_chunk(struct mmc *mmc, struct blk_desc *mmc_dev,
 
 	/* Check if chunk fits */
 	if (sectors + dstblk > otfd->part->start + otfd->part->size) {
-		printf("[Error]: length of data exceeds partition size\n");
+		printf("\n[Error]: length of data exceeds partition size\n");
 		return -1;
 	}
 
-	/* Write chunklen bytes of chunk to media */
-	debug("writing chunk of 0x%x bytes (0x%x sectors) "
-		"from 0x%p to block " LBAFU "\n",
-		chunklen, sectors, otfd->loadaddr, dstblk);
-	written = mmc->block_dev.block_write(mmc_dev, dstblk, sectors,
-					     otfd->loadaddr);
-	if (written != sectors) {
-		printf("[Error]: written sectors != sectors to write\n");
+	if (hash_verify_start(&otf_ring.hv)) {
+		printf("\n[Error]: cannot allocate verification buffer\n");
 		return -1;
 	}
-	printf("[OK]\n");
 
-	/* Verify written chunk if $loadaddr + chunk size does not overlap
-	 * $verifyaddr (where the read-back copy will be placed)
-	 */
-	verifyaddr = (void *) getenv_ulong("verifyaddr", 16, 0);
-	if (otfd->loadaddr + sectors * mmc_dev->blksz < verifyaddr) {
-		/* Read back data... */
-		printf("Reading back chunk...");
-		read = mmc->block_dev.block_read(mmc_dev, dstblk, sectors,
-						 verifyaddr);
-		if (read != sectors) {
-			printf("[Error]: read sectors != sectors to read\n");
-			return -1;
-		}
-		printf("[OK]\n");
-		/* ...then compare */
-		printf("Verifying chunk...");
-		if (memcmp(otfd->loadaddr, verifyaddr,
-			      sectors * mmc_dev->blksz)) {
-			printf("[Error]\n");
-			return -1;
-		} else {
-			printf("[OK]\n");
-			return 0;
-		}
-	} else {
-		printf("[Warning]: Cannot verify chunk. "
-			"It overlaps $verifyaddr!\n");
-		return 0;
-	}
+	otf_ring.buf = otfd->loadaddr;
+	otf_ring.blk = dstblk;
+	otf_ring.blkcnt = sectors;
+	otf_ring.credit = 0;
+
+	return 0;
 }
 
 #ifdef CONFIG_FASTBOOT_FLASH
@@ -288,6 +410,14 @@ static lbaint_t sparse_reserve(struct sparse_storage *info, lbaint_t blk,
        return blkcnt;
 }
 
+static lbaint_t sparse_erase(struct sparse_storage *info, lbaint_t blk,
+			     lbaint_t blkcnt)
+{
+	otf_sparse_data_t *data = info->priv;
+
+	return mmc_erase_zeroes(data->mmc_dev, blk, blkcnt);
+}
+
 static int sparse_write_bytes(otf_sparse_data_t *sparse_data, lbaint_t *dstblk,
 			      void *data, uint32_t data_length)
 {
@@ -471,7 +601,7 @@ static uint32_t write_sparse_chunks(otf_data_t *otfd, lbaint_t *dstblk,
 #endif
 
 /* writes a chunk of data from RAM to main storage media (eMMC) */
-int update_chunk(otf_data_t *otfd)
+static int write_otf_chunk(otf_data_t *otfd)
 {
 	static unsigned int chunk_len = 0;
 	static lbaint_t dstblk = 0;
@@ -494,6 +624,12 @@ int update_chunk(otf_data_t *otfd)
 		}
 	}
 
+	/* No new data, make progress on the chunk being written */
+	if (otfd->flags & OTF_FLAG_IDLE) {
+		otfd->flags &= ~OTF_FLAG_IDLE;
+		return write_pending(mmc_dev, 0);
+	}
+
 	/*
 	 * There are two variants:
 	 *  - otfd.buf == NULL
@@ -518,6 +654,32 @@ int update_chunk(otf_data_t *otfd)
 		dstblk = otfd->part->start;
 		otfd->flags &= ~OTF_FLAG_INIT;
 
+		/* Drop what an aborted update may have left behind */
+		if (otf_ring.blkcnt)
+			hash_verify_finish(&otf_ring.hv);
+		otf_ring.blkcnt = 0;
+		bdelta_abort(&otf_bdelta);
+
+		/* Keep the slots clear of the stack, leaving it 1 MiB to grow */
+		if ((ulong)otfd->loadaddr + OTF_SLOTS * OTF_SLOT_SIZE >
+		    gd->start_addr_sp - SZ_1M) {
+			printf("\n[Error]: No RAM left for the update buffers "
+			       "past 0x%lx\n", (ulong)otfd->loadaddr);
+			return -1;
+		}
+
+		otf_ring.base = otfd->loadaddr;
+		otf_ring.slot = 0;
+
+		if (bdelta_is_image(otfd->loadaddr)) {
+			struct bdelta_ops ops;
+
+			otfd->flags |= OTF_FLAG_BDELTA;
+			bdelta_mmc_ops(&ops, &otf_bdelta_mmc, mmc_dev,
+				       otfd->part);
+			bdelta_start(&otf_bdelta, &ops);
+		}
+
 #ifdef CONFIG_FASTBOOT_FLASH
 		if (is_sparse_image(otfd->loadaddr)) {
 			const sparse_header_t *hdr = (sparse_header_t *) otfd->loadaddr;
@@ -537,13 +699,36 @@ int update_chunk(otf_data_t *otfd)
 				.size = otfd->part->size,
 				.write = sparse_write,
 				.reserve = sparse_reserve,
+				.erase = sparse_erase,
 				.priv = &otfd->sparse_data,
 			};
 			otfd->sparse_data.mmc_dev = mmc_dev;
 		}
 #endif
 	}
+
+	/*
+	 * A block delta is applied as it arrives, so the data can always be
+	 * received at the start of the RAM slot.
+	 */
+	if (otfd->flags & OTF_FLAG_BDELTA) {
+		if (bdelta_feed(&otf_bdelta, otfd->loadaddr + otfd->offset,
+				otfd->len)) {
+			bdelta_abort(&otf_bdelta);
+			return -1;
+		}
+		otfd->offset = 0;
+		if (!(otfd->flags & OTF_FLAG_FLUSH))
+			return 0;
+
+		mmc_dev = NULL;
+		mmc_dev_index = -1;
+		mmc = NULL;
+		return bdelta_finish(&otf_bdelta);
+	}
+
 	chunk_len += otfd->len;
+	otf_ring.credit += otfd->len;
 
 	/*
 	 * If the chunk is completed or if it is the last chunk (OTF_FLAG_FLUSH
@@ -551,6 +736,7 @@ int update_chunk(otf_data_t *otfd)
 	 */
 	if (chunk_len >= CONFIG_OTF_CHUNK || (otfd->flags & OTF_FLAG_FLUSH)) {
 		unsigned int remaining;
+		void *next;
 
 #ifdef CONFIG_FASTBOOT_FLASH
 		if (otfd->flags & OTF_FLAG_SPARSE) {
@@ -589,20 +775,31 @@ int update_chunk(otf_data_t *otfd)
 				/* chunk_len is now multiple of blksz */
 			}
 
+			/* The previous chunk must be out of the other slot */
+			if (write_pending(mmc_dev, 1))
+				return -1;
+
 			if (write_chunk(mmc, mmc_dev, otfd, dstblk, chunk_len))
 				return -1;
 
+			/* The last chunk is written right away */
+			if ((otfd->flags & OTF_FLAG_FLUSH) &&
+			    write_pending(mmc_dev, 1))
+				return -1;
+
 			/* increment destiny block */
 			dstblk += (chunk_len / mmc_dev->blksz);
 		}
 
-		/* copy excess of bytes from previous chunk to offset 0 */
+		/* copy excess of bytes from previous chunk to the next slot */
+		otf_ring.slot = (otf_ring.slot + 1) % OTF_SLOTS;
+		next = otf_ring.base + otf_ring.slot * OTF_SLOT_SIZE;
 		if (remaining) {
-			memcpy(otfd->loadaddr, otfd->loadaddr + chunk_len,
-			       remaining);
-			debug("Copying excess of %d bytes to offset 0\n",
-			      remaining);
+			memcpy(next, otfd->loadaddr + chunk_len, remaining);
+			debug("Copying excess of %d bytes to slot %d\n",
+			      remaining, otf_ring.slot);
 		}
+		otfd->loadaddr = next;
 		/* reset chunk_len to excess of bytes from previous chunk
 		 * (or zero, if that's the case) */
 		chunk_len = remaining;
@@ -645,11 +842,109 @@ int update_chunk(otf_data_t *otfd)
 	 * Set otfd offset pointer to offset in RAM where new bytes would
 	 * be written. Data in the interval
 	 * [otfd->loadaddr, otfd->loadaddr + otfd->offset) shall not be
-	 * replaced with new data. The rest of the buffer may be reused
-	 * by the caller
+	 * replaced with new data. The rest of the slot may be reused by
+	 * the caller, the other slot may still be being written to media.
 	 */
 	otfd->offset = chunk_len;
 
 	return 0;
 }
+
+/* Decompresses to the end of the free part of the current slot */
+static void *decomp_get_buf(void *priv, size_t *size)
+{
+	otf_data_t *plain = priv;
+
+	*size = CONFIG_OTF_CHUNK - plain->offset;
+
+	return plain->loadaddr + plain->offset;
+}
+
+static int decomp_put_buf(void *priv, size_t len, bool last)
+{
+	otf_data_t *plain = priv;
+
+	plain->buf = NULL;
+	plain->len = len;
+	if (last)
+		plain->flags |= OTF_FLAG_FLUSH;
+
+	return write_otf_chunk(plain);
+}
+
+static int start_decomp(otf_data_t *otfd, enum otf_decomp_type type)
+{
+	struct otf_decomp_ops ops = {
+		.get_buf = decomp_get_buf,
+		.put_buf = decomp_put_buf,
+		.priv = &otf_plain,
+	};
+	void *slots = otfd->loadaddr +
+		      max_t(size_t, OTF_SLOT_SIZE,
+			    ALIGN(otfd->offset + otfd->len, SZ_1M));
+
+	/* Keep the slots clear of the stack, leaving it 1 MiB to grow */
+	if ((ulong)slots + OTF_SLOTS * OTF_SLOT_SIZE >
+	    gd->start_addr_sp - SZ_1M) {
+		printf("\n[Error]: No RAM left to decompress the image past "
+		       "0x%lx\n", (ulong)slots);
+		return -1;
+	}
+
+	memset(&otf_plain, 0, sizeof(otf_plain));
+	otf_plain.loadaddr = slots;
+	otf_plain.part = otfd->part;
+	otf_plain.flags = OTF_FLAG_INIT;
+
+	otfd->flags &= ~OTF_FLAG_INIT;
+	otfd->flags |= OTF_FLAG_COMPRESSED;
+
+	return otf_decomp_start(&otf_decomp, type, &ops);
+}
+
+static int update_compressed_chunk(otf_data_t *otfd, const void *data)
+{
+	/* No new data, make progress on the chunk being written */
+	if (otfd->flags & OTF_FLAG_IDLE) {
+		otfd->flags &= ~OTF_FLAG_IDLE;
+		otf_plain.flags |= OTF_FLAG_IDLE;
+		return write_otf_chunk(&otf_plain);
+	}
+
+	if (otf_decomp_feed(&otf_decomp, data, otfd->len)) {
+		otf_decomp_abort(&otf_decomp);
+		return -1;
+	}
+
+	/* The compressed data is always received at the start of the RAM */
+	otfd->offset = 0;
+	if (!(otfd->flags & OTF_FLAG_FLUSH))
+		return 0;
+
+	return otf_decomp_finish(&otf_decomp);
+}
+
+/*
+ * Writes a chunk of the image to main storage media (eMMC), decompressing
+ * it first if the image is gzip or LZ4 compressed.
+ */
+int update_chunk(otf_data_t *otfd)
+{
+	const void *data = otfd->buf ? otfd->buf :
+				       otfd->loadaddr + otfd->offset;
+
+	if ((otfd->flags & OTF_FLAG_INIT) && otfd->len) {
+		enum otf_decomp_type type = otf_decomp_detect(data, otfd->len);
+
+		/* Drop what an aborted update may have left behind */
+		otf_decomp_abort(&otf_decomp);
+		if (type != OTF_DECOMP_NONE && start_decomp(otfd, type))
+			return -1;
+	}
+
+	if (otfd->flags & OTF_FLAG_COMPRESSED)
+		return update_compressed_chunk(otfd, data);
+
+	return write_otf_chunk(otfd);
+}
 #endif /* CONFIG_FSL_ESDHC */
@@ -0,0 +1,355 @@
+/*
+ *  Copyright (C) 2018 by Digi International Inc.
+ *  All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version2  as published by
+ *  the Free Software Foundation.
+*/
+#include <common.h>
+#include <malloc.h>
+#include <watchdog.h>
+#include <asm/unaligned.h>
+#include <linux/sizes.h>
+#include "otf_decomp.h"
+
+/*
+ * Streaming decompression of the images of on-the-fly updates.
+ *
+ * The compressed image is fed as it arrives, in pieces of any size, and
+ * decompressed straight into the buffers handed out by the consumer. gzip
+ * streams are inflated by zlib, which keeps its state between pieces. LZ4
+ * frames are decoded a block at a time, so a block split across pieces is
+ * gathered first.
+ */
+
+#define GZIP_MAGIC		0x8b1f
+#define LZ4F_MAGIC		0x184d2204
+
+/* LZ4 frame descriptor */
+#define LZ4F_HDR_SZ		7
+#define LZ4F_VERSION_MASK	0xc0
+#define LZ4F_VERSION		0x40
+#define LZ4F_INDEP_BLOCKS	0x20
+#define LZ4F_BLOCK_CSUM		0x10
+#define LZ4F_CONTENT_SIZE	0x08
+#define LZ4F_CONTENT_CSUM	0x04
+#define LZ4F_RESERVED		0x03
+#define LZ4F_BD_RESERVED	0x8f
+#define LZ4F_BLOCK_MAX(bd)	(1 << (8 + 2 * (((bd) >> 4) & 7)))
+#define LZ4F_UNCOMPRESSED	0x80000000
+
+enum {
+	LZ4_FRAME,		/* frame header */
+	LZ4_BLOCK_HDR,
+	LZ4_BLOCK,
+	LZ4_CONTENT_CSUM,
+	LZ4_END,
+};
+
+enum otf_decomp_type otf_decomp_detect(const void *buf, size_t len)
+{
+	if (len >= 2 && get_unaligned_le16(buf) == GZIP_MAGIC)
+		return OTF_DECOMP_GZIP;
+#ifdef CONFIG_LZ4
+	if (len >= 4 && get_unaligned_le32(buf) == LZ4F_MAGIC)
+		return OTF_DECOMP_LZ4;
+#endif
+
+	return OTF_DECOMP_NONE;
+}
+
+/* Makes room for decompressed data, passing on the buffer if it is full */
+static int out_room(struct otf_decomp *dc)
+{
+	if (dc->out && dc->out_len < dc->out_size)
+		return 0;
+
+	if (dc->out) {
+		if (dc->ops.put_buf(dc->ops.priv, dc->out_len, false))
+			return -1;
+		dc->total += dc->out_len;
+	}
+
+	dc->out_len = 0;
+	dc->out = dc->ops.get_buf(dc->ops.priv, &dc->out_size);
+	if (!dc->out || !dc->out_size) {
+		printf("\n[Error]: no room for the decompressed data\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Copies decompressed data to the consumer */
+static int out_copy(struct otf_decomp *dc, const u8 *data, size_t len)
+{
+	size_t n;
+
+	while (len) {
+		if (out_room(dc))
+			return -1;
+		n = min(len, dc->out_size - dc->out_len);
+		memcpy(dc->out + dc->out_len, data, n);
+		dc->out_len += n;
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int gzip_feed(struct otf_decomp *dc, const u8 *data, size_t len)
+{
+	int ret;
+
+	dc->zs.next_in = (u8 *)data;
+	dc->zs.avail_in = len;
+	while (dc->zs.avail_in) {
+		if (dc->done) {
+			printf("\n[Error]: data past the end of the compressed image\n");
+			return -1;
+		}
+		if (out_room(dc))
+			return -1;
+
+		dc->zs.next_out = dc->out + dc->out_len;
+		dc->zs.avail_out = dc->out_size - dc->out_len;
+		ret = inflate(&dc->zs, Z_NO_FLUSH);
+		dc->out_len = dc->zs.next_out - dc->out;
+		if (ret == Z_STREAM_END) {
+			dc->done = true;
+		} else if (ret != Z_OK) {
+			printf("\n[Error]: gzip image: %s\n",
+			       dc->zs.msg ? dc->zs.msg : "corrupted data");
+			return -1;
+		}
+		WATCHDOG_RESET();
+	}
+
+	return 0;
+}
+
+static void lz4_step(struct otf_decomp *dc, int step, size_t need)
+{
+	dc->step = step;
+	dc->have = 0;
+	dc->need = need;
+	if (step == LZ4_END)
+		dc->done = true;
+}
+
+/* Gathers the bytes of the current step in dst, returns the bytes used */
+static size_t lz4_gather(struct otf_decomp *dc, u8 *dst, const u8 *data,
+			 size_t len)
+{
+	size_t n = min(len, dc->need - dc->have);
+
+	memcpy(dst + dc->have, data, n);
+	dc->have += n;
+
+	return n;
+}
+
+static int lz4_frame(struct otf_decomp *dc)
+{
+	u8 bd = dc->hdr[5];
+
+	dc->flags = dc->hdr[4];
+	if ((dc->flags & LZ4F_CONTENT_SIZE) && dc->need == LZ4F_HDR_SZ) {
+		/* the content size comes before the header checksum */
+		dc->need += sizeof(u64);
+		return 0;
+	}
+
+	if ((dc->flags & (LZ4F_VERSION_MASK | LZ4F_RESERVED)) != LZ4F_VERSION ||
+	    (bd & LZ4F_BD_RESERVED) || LZ4F_BLOCK_MAX(bd) < SZ_64K) {
+		printf("\n[Error]: unsupported LZ4 frame\n");
+		return -1;
+	}
+	if (!(dc->flags & LZ4F_INDEP_BLOCKS)) {
+		printf("\n[Error]: LZ4 frames of linked blocks are not supported\n");
+		return -1;
+	}
+
+	dc->blk_max = LZ4F_BLOCK_MAX(bd);
+	dc->stage = malloc(dc->blk_max + sizeof(u32));
+	if (!dc->stage) {
+		printf("\n[Error]: cannot allocate LZ4 block buffer\n");
+		return -1;
+	}
+	lz4_step(dc, LZ4_BLOCK_HDR, sizeof(u32));
+
+	return 0;
+}
+
+static int lz4_block_hdr(struct otf_decomp *dc)
+{
+	u32 size;
+
+	dc->blk_hdr = get_unaligned_le32(dc->hdr);
+	if (!dc->blk_hdr) {
+		/* end mark */
+		if (dc->flags & LZ4F_CONTENT_CSUM)
+			lz4_step(dc, LZ4_CONTENT_CSUM, sizeof(u32));
+		else
+			lz4_step(dc, LZ4_END, 0);
+		return 0;
+	}
+
+	size = dc->blk_hdr & ~LZ4F_UNCOMPRESSED;
+	if (size > dc->blk_max) {
+		printf("\n[Error]: invalid LZ4 block size 0x%x\n", size);
+		return -1;
+	}
+	if (dc->flags & LZ4F_BLOCK_CSUM)
+		size += sizeof(u32);
+	lz4_step(dc, LZ4_BLOCK, size);
+
+	return 0;
+}
+
+/* Decompresses the block received, straight to the consumer if it fits */
+static int lz4_block(struct otf_decomp *dc, const u8 *data)
+{
+	u32 size = dc->blk_hdr & ~LZ4F_UNCOMPRESSED;
+	int ret;
+
+	if (dc->blk_hdr & LZ4F_UNCOMPRESSED)
+		ret = out_copy(dc, data, size);
+	else if (out_room(dc))
+		ret = -1;
+	else if (dc->out_size - dc->out_len >= dc->blk_max) {
+		ret = ulz4_block(data, size, dc->out + dc->out_len,
+				 dc->blk_max);
+		if (ret >= 0) {
+			dc->out_len += ret;
+			ret = 0;
+		}
+	} else {
+		if (!dc->blk_out)
+			dc->blk_out = malloc(dc->blk_max);
+		if (!dc->blk_out) {
+			printf("\n[Error]: cannot allocate LZ4 block buffer\n");
+			return -1;
+		}
+		ret = ulz4_block(data, size, dc->blk_out, dc->blk_max);
+		if (ret >= 0)
+			ret = out_copy(dc, dc->blk_out, ret);
+	}
+
+	if (ret < 0) {
+		printf("\n[Error]: LZ4 image: corrupted data\n");
+		return -1;
+	}
+	lz4_step(dc, LZ4_BLOCK_HDR, sizeof(u32));
+	WATCHDOG_RESET();
+
+	return 0;
+}
+
+static int lz4_feed(struct otf_decomp *dc, const u8 *data, size_t len)
+{
+	size_t n;
+
+	while (len) {
+		switch (dc->step) {
+		case LZ4_FRAME:
+			n = lz4_gather(dc, dc->hdr, data, len);
+			if (dc->have == dc->need && lz4_frame(dc))
+				return -1;
+			break;
+		case LZ4_BLOCK_HDR:
+			n = lz4_gather(dc, dc->hdr, data, len);
+			if (dc->have == dc->need && lz4_block_hdr(dc))
+				return -1;
+			break;
+		case LZ4_BLOCK:
+			/* Blocks that came in one piece are not copied */
+			if (!dc->have && len >= dc->need) {
+				n = dc->need;
+				if (lz4_block(dc, data))
+					return -1;
+				break;
+			}
+			n = lz4_gather(dc, dc->stage, data, len);
+			if (dc->have == dc->need && lz4_block(dc, dc->stage))
+				return -1;
+			break;
+		case LZ4_CONTENT_CSUM:
+			n = lz4_gather(dc, dc->hdr, data, len);
+			if (dc->have == dc->need)
+				lz4_step(dc, LZ4_END, 0);
+			break;
+		default:
+			printf("\n[Error]: data past the end of the compressed image\n");
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int otf_decomp_start(struct otf_decomp *dc, enum otf_decomp_type type,
+		     const struct otf_decomp_ops *ops)
+{
+	memset(dc, 0, sizeof(*dc));
+	dc->ops = *ops;
+	dc->type = type;
+
+	if (type == OTF_DECOMP_GZIP) {
+		dc->zs.zalloc = gzalloc;
+		dc->zs.zfree = gzfree;
+		/* gzip header and trailer, with the CRC of the data */
+		if (inflateInit2(&dc->zs, 16 + MAX_WBITS) != Z_OK) {
+			printf("\n[Error]: cannot allocate gzip state\n");
+			return -1;
+		}
+		dc->zs_init = true;
+		printf("Decompressing gzip image on the fly\n");
+	} else {
+		lz4_step(dc, LZ4_FRAME, LZ4F_HDR_SZ);
+		printf("Decompressing LZ4 image on the fly\n");
+	}
+
+	return 0;
+}
+
+/* Consumes the next len bytes of the compressed image */
+int otf_decomp_feed(struct otf_decomp *dc, const void *data, size_t len)
+{
+	if (dc->type == OTF_DECOMP_GZIP)
+		return gzip_feed(dc, data, len);
+
+	return lz4_feed(dc, data, len);
+}
+
+void otf_decomp_abort(struct otf_decomp *dc)
+{
+	if (dc->zs_init)
+		inflateEnd(&dc->zs);
+	free(dc->stage);
+	free(dc->blk_out);
+	dc->zs_init = false;
+	dc->stage = NULL;
+	dc->blk_out = NULL;
+}
+
+/* Passes on the last decompressed data and releases the decompressor */
+int otf_decomp_finish(struct otf_decomp *dc)
+{
+	int ret = -1;
+
+	if (!dc->done) {
+		printf("\n[Error]: compressed image is truncated\n");
+	} else if (!dc->ops.put_buf(dc->ops.priv, dc->out_len, true)) {
+		dc->total += dc->out_len;
+		printf("Image decompressed: %llu bytes\n", dc->total);
+		ret = 0;
+	}
+	otf_decomp_abort(dc);
+
+	return ret;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2018 by Digi International Inc.
+ *  All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version2  as published by
+ *  the Free Software Foundation.
+*/
+
+#ifndef __DIGI_OTF_DECOMP_H
+#define __DIGI_OTF_DECOMP_H
+
+#include <u-boot/zlib.h>
+
+enum otf_decomp_type {
+	OTF_DECOMP_NONE,
+	OTF_DECOMP_GZIP,
+	OTF_DECOMP_LZ4,
+};
+
+/* Consumer of the decompressed data */
+struct otf_decomp_ops {
+	/* returns a buffer for up to *size bytes of decompressed data */
+	void *(*get_buf)(void *priv, size_t *size);
+	/* passes on the len bytes decompressed to that buffer */
+	int (*put_buf)(void *priv, size_t len, bool last);
+	void *priv;
+};
+
+struct otf_decomp {
+	struct otf_decomp_ops ops;
+	enum otf_decomp_type type;
+	bool done;		/* end of the compressed stream seen */
+	u8 *out;		/* buffer from get_buf() */
+	size_t out_size;
+	size_t out_len;		/* bytes decompressed to out */
+	u64 total;		/* bytes passed on */
+
+	/* gzip */
+	z_stream zs;
+	bool zs_init;		/* zs must be released */
+
+	/* LZ4 frame */
+	int step;
+	u8 hdr[16];		/* frame or block header being received */
+	u8 *stage;		/* block being received */
+	size_t have, need;	/* bytes received, bytes of this step */
+	u8 flags;		/* frame descriptor flags */
+	u32 blk_max;		/* maximum block size */
+	u32 blk_hdr;		/* header of the block being received */
+	u8 *blk_out;		/* block decompressed when out is too small */
+};
+
+enum otf_decomp_type otf_decomp_detect(const void *buf, size_t len);
+int otf_decomp_start(struct otf_decomp *dc, enum otf_decomp_type type,
+		     const struct otf_decomp_ops *ops);
+int otf_decomp_feed(struct otf_decomp *dc, const void *data, size_t len);
+int otf_decomp_finish(struct otf_decomp *dc);
+void otf_decomp_abort(struct otf_decomp *dc);
+
+#endif  /* __DIGI_OTF_DECOMP_H */
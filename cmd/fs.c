@@ -89,3 +89,19 @@ U_BOOT_CMD(
 	"fstype <interface> <dev>:<part> <varname>\n"
 	"- set environment variable to filesystem type\n"
 );
+
+static int do_fsflush(cmd_tbl_t *cmdtp, int flag, int argc,
+		      char * const argv[])
+{
+	fs_flush();
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	fsflush, 1, 1, do_fsflush,
+	"unmount the filesystem kept mounted between commands",
+	"\n"
+	"    - Drop the cached mount, e.g. after the medium was replaced\n"
+	"      without the device being rescanned."
+);
@@ -8,6 +8,7 @@
 #include <common.h>
 #include <command.h>
 #include <console.h>
+#include <div64.h>
 #include <memalign.h>
 #include <mmc.h>
 
@@ -731,6 +732,45 @@ static int do_mmc_setdsr(cmd_tbl_t *cmdtp, int flag,
 	return ret;
 }
 
+#ifdef CONFIG_MMC_STATS
+static void print_mmc_stats(const char *dir, u64 bytes, u64 us, ulong cmds)
+{
+	u64 ms = lldiv(us, 1000);
+	u64 rate = 0;
+
+	if (ms)
+		rate = lldiv((bytes >> 10) * 1000, (u32)ms);
+	printf("%s %llu bytes in %lu commands, %llu ms, %llu KiB/s\n",
+	       dir, bytes, cmds, ms, rate);
+}
+
+static int do_mmc_stats(cmd_tbl_t *cmdtp, int flag,
+			int argc, char * const argv[])
+{
+	struct mmc *mmc;
+
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "reset")))
+		return CMD_RET_USAGE;
+
+	mmc = find_mmc_device(curr_device);
+	if (!mmc) {
+		printf("no mmc device at slot %x\n", curr_device);
+		return CMD_RET_FAILURE;
+	}
+
+	if (argc == 2) {
+		memset(&mmc->stats, 0, sizeof(mmc->stats));
+		return CMD_RET_SUCCESS;
+	}
+
+	print_mmc_stats("read: ", mmc->stats.read_bytes, mmc->stats.read_us,
+			mmc->stats.read_cmds);
+	print_mmc_stats("write:", mmc->stats.write_bytes, mmc->stats.write_us,
+			mmc->stats.write_cmds);
+	return CMD_RET_SUCCESS;
+}
+#endif
+
 #ifdef CONFIG_CMD_BKOPS_ENABLE
 static int do_mmc_bkops_enable(cmd_tbl_t *cmdtp, int flag,
 				   int argc, char * const argv[])
@@ -896,6 +936,9 @@ static cmd_tbl_t cmd_mmc[] = {
 	U_BOOT_CMD_MKENT(rpmb, CONFIG_SYS_MAXARGS, 1, do_mmcrpmb, "", ""),
 #endif
 	U_BOOT_CMD_MKENT(setdsr, 2, 0, do_mmc_setdsr, "", ""),
+#ifdef CONFIG_MMC_STATS
+	U_BOOT_CMD_MKENT(stats, 2, 0, do_mmc_stats, "", ""),
+#endif
 #ifdef CONFIG_CMD_BKOPS_ENABLE
 	U_BOOT_CMD_MKENT(bkops-enable, 2, 0, do_mmc_bkops_enable, "", ""),
 #endif
@@ -966,6 +1009,9 @@ U_BOOT_CMD(
 	"mmc rpmb counter - read the value of the write counter\n"
 #endif
 	"mmc setdsr <value> - set DSR register value\n"
+#ifdef CONFIG_MMC_STATS
+	"mmc stats [reset] - show or reset the transfer statistics\n"
+#endif
 #ifdef CONFIG_CMD_BKOPS_ENABLE
 	"mmc bkops-enable <dev> - enable background operations handshake on device\n"
 	"   WARNING: This is a write-once setting.\n"
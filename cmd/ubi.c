@@ -89,6 +89,16 @@ static void display_ubi_info(struct ubi_device *ubi)
 	ubi_msg("number of PEBs reserved for bad PEB handling: %d",
 			ubi->beb_rsvd_pebs);
 	ubi_msg("max/mean erase counter: %d/%d", ubi->max_ec, ubi->mean_ec);
+	ubi_msg("attached by:                %s", ubi->attach_mode);
+	ubi_msg("attach time:                %lu ms (scan %lu ms, volume table %lu ms, wear-leveling %lu ms, EBA %lu ms)",
+		ubi->scan_ms + ubi->vtbl_ms + ubi->wl_ms + ubi->eba_ms,
+		ubi->scan_ms, ubi->vtbl_ms, ubi->wl_ms, ubi->eba_ms);
+	if (ubi->fm)
+		ubi_msg("fastmap:                    %d PEBs, %s",
+			ubi->fm->used_blocks,
+			ubi->fm_disabled ? "not updated" : "updated on changes");
+	else
+		ubi_msg("fastmap:                    none");
 }
 
 static int ubi_info(int layout)
@@ -295,6 +305,7 @@ static int ubi_volume_continue_write(char *volume, void *buf, size_t size)
 
 		vol->checked = 1;
 		ubi_gluebi_updated(vol);
+		ubi_volume_notify(ubi, vol, UBI_VOLUME_UPDATED);
 	}
 
 	return 0;
@@ -593,6 +604,8 @@ int ubi_volume_off_write(char *volume, void *buf, size_t size, int isFirstPart,
 			printf("Cannot start volume update\n");
 			return err;
 		}
+		/* The VID header of every LEB written is read back and checked */
+		vol->upd_crc = 1;
 	}
 	else {
 		/* Increment remaining data counter */
@@ -610,6 +623,10 @@ int ubi_volume_off_write(char *volume, void *buf, size_t size, int isFirstPart,
 		return err;
 	}
 
+	/* The update is complete */
+	if (!vol->updating)
+		ubi_volume_notify(ubi, vol, UBI_VOLUME_UPDATED);
+
 	return 0;
 }
 
@@ -776,6 +793,12 @@ int ubi_part(char *part_name, const char *vid_header_offset)
 	}
 
 	ubi = ubi_devices[0];
+	if (!ubi_silent)
+		printf("UBI attached by %s in %lu ms (%d PEBs: scan %lu ms, volume table %lu ms, wear-leveling %lu ms, EBA %lu ms)\n",
+		       ubi->attach_mode,
+		       ubi->scan_ms + ubi->vtbl_ms + ubi->wl_ms + ubi->eba_ms,
+		       ubi->peb_count, ubi->scan_ms, ubi->vtbl_ms,
+		       ubi->wl_ms, ubi->eba_ms);
 
 	return 0;
 }
@@ -26,8 +26,10 @@ static int do_ubifs_mount(cmd_tbl_t *cmdtp, int flag, int argc,
 	char *vol_name;
 	int ret;
 
-	if (argc != 2)
-		return CMD_RET_USAGE;
+	if (argc == 1) {
+		uboot_ubifs_list();
+		return 0;
+	}
 
 	vol_name = argv[1];
 	debug("Using volume %s\n", vol_name);
@@ -53,11 +55,25 @@ int ubifs_is_mounted(void)
 
 void cmd_ubifs_umount(void)
 {
-	uboot_ubifs_umount();
+	uboot_ubifs_flush(1);
 	ubifs_mounted = 0;
 	ubifs_initialized = 0;
 }
 
+/*
+ * Unmounts a volume whose contents changed, so that it is not read through
+ * the index cached by its mount.
+ */
+void cmd_ubifs_volume_changed(int ubi_num, int vol_id)
+{
+	if (!ubifs_mounted)
+		return;
+
+	uboot_ubifs_drop(ubi_num, vol_id);
+	if (!ubifs_mounted_vol_name())
+		cmd_ubifs_umount();
+}
+
 static int do_ubifs_umount(cmd_tbl_t *cmdtp, int flag, int argc,
 				char * const argv[])
 {
@@ -69,7 +85,24 @@ static int do_ubifs_umount(cmd_tbl_t *cmdtp, int flag, int argc,
 		return -1;
 	}
 
-	cmd_ubifs_umount();
+	/* The volume mounted before becomes the current one */
+	uboot_ubifs_umount();
+	if (!ubifs_mounted_vol_name())
+		cmd_ubifs_umount();
+
+	return 0;
+}
+
+static int do_ubifs_flush(cmd_tbl_t *cmdtp, int flag, int argc,
+			  char * const argv[])
+{
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "-a")))
+		return CMD_RET_USAGE;
+
+	if (argc == 2)
+		cmd_ubifs_umount();
+	else
+		uboot_ubifs_flush(0);
 
 	return 0;
 }
@@ -141,7 +174,10 @@ U_BOOT_CMD(
 	ubifsmount, 2, 0, do_ubifs_mount,
 	"mount UBIFS volume",
 	"<volume-name>\n"
-	"    - mount 'volume-name' volume"
+	"    - mount 'volume-name' volume and make it the current one\n"
+	"      (volumes mounted before are kept mounted)\n"
+	"ubifsmount\n"
+	"    - list mounted volumes, '*' marks the current one"
 );
 
 U_BOOT_CMD(
@@ -150,6 +186,14 @@ U_BOOT_CMD(
 	"    - unmount current volume"
 );
 
+U_BOOT_CMD(
+	ubifsflush, 2, 0, do_ubifs_flush,
+	"unmount UBIFS volumes kept mounted",
+	"[-a]\n"
+	"    - unmount all volumes but the current one, freeing their caches\n"
+	"      -a: unmount the current volume too"
+);
+
 U_BOOT_CMD(
 	ubifsls, 2, 0, do_ubifs_ls,
 	"list files in a directory",
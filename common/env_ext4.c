@@ -28,6 +28,7 @@
 #include <memalign.h>
 #include <search.h>
 #include <errno.h>
+#include <fs.h>
 #include <ext4fs.h>
 #include <mmc.h>
 
@@ -66,6 +67,8 @@ int saveenv(void)
 		return 1;
 
 	dev = dev_desc->devnum;
+	/* the driver is used directly, unmount what the fs layer cached */
+	fs_flush();
 	ext4fs_set_blk_dev(dev_desc, &info);
 
 	if (!ext4fs_mount(info.size)) {
@@ -104,6 +107,7 @@ void env_relocate_spec(void)
 		goto err_env_relocate;
 
 	dev = dev_desc->devnum;
+	fs_flush();
 	ext4fs_set_blk_dev(dev_desc, &info);
 
 	if (!ext4fs_mount(info.size)) {
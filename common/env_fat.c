@@ -16,6 +16,7 @@
 #include <memalign.h>
 #include <search.h>
 #include <errno.h>
+#include <fs.h>
 #include <fat.h>
 #include <mmc.h>
 
@@ -55,6 +56,8 @@ int saveenv(void)
 		return 1;
 
 	dev = dev_desc->devnum;
+	/* the driver is used directly, unmount what the fs layer cached */
+	fs_flush();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		printf("\n** Unable to use %s %d:%d for saveenv **\n",
 		       FAT_ENV_INTERFACE, dev, part);
@@ -89,6 +92,7 @@ void env_relocate_spec(void)
 		goto err_env_relocate;
 
 	dev = dev_desc->devnum;
+	fs_flush();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		printf("\n** Unable to use %s %d:%d for loading the env **\n",
 		       FAT_ENV_INTERFACE, dev, part);
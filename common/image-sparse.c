@@ -54,6 +54,44 @@
 #define fastboot_okay(...)	(void) 0
 #endif
 
+/*
+ * The fill buffer is kept across chunks, and only refilled when the fill
+ * value changes
+ */
+static uint32_t *fill_buf;
+static uint32_t fill_buf_val;
+
+static uint32_t *get_fill_buf(uint32_t fill_val)
+{
+	int i;
+
+	if (!fill_buf) {
+		fill_buf = memalign(ARCH_DMA_MINALIGN,
+				    ROUNDUP(CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE,
+					    ARCH_DMA_MINALIGN));
+		if (!fill_buf)
+			return NULL;
+		fill_buf_val = ~fill_val;
+	}
+
+	if (fill_buf_val != fill_val) {
+		for (i = 0;
+		     i < CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE / sizeof(fill_val);
+		     i++)
+			fill_buf[i] = fill_val;
+		fill_buf_val = fill_val;
+	}
+
+	return fill_buf;
+}
+
+/* Makes blocks read back as zeros without writing them, if possible */
+static bool erase_blks(struct sparse_storage *info, lbaint_t blk,
+		       lbaint_t blkcnt)
+{
+	return info->erase && info->erase(info, blk, blkcnt) == blkcnt;
+}
+
 int write_sparse_chunk(struct sparse_storage *info, const sparse_header_t *sparse_header,
                 void **data_ptr, lbaint_t *blk, uint32_t *total_blocks, uint32_t *bytes_written)
 {
@@ -65,7 +103,7 @@ int write_sparse_chunk(struct sparse_storage *info, const sparse_header_t *spars
 	int i;
 	int j;
 	void *data = *data_ptr;
-	uint32_t *fill_buf = NULL;
+	uint32_t *buf;
 	int const fill_buf_num_blks = CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE / info->blksz;
 
 	/* Read and skip over chunk header */
@@ -127,25 +165,9 @@ int write_sparse_chunk(struct sparse_storage *info, const sparse_header_t *spars
 			return 1;
 		}
 
-		fill_buf = (uint32_t *)
-				memalign(ARCH_DMA_MINALIGN,
-					ROUNDUP(
-					info->blksz * fill_buf_num_blks,
-					ARCH_DMA_MINALIGN));
-		if (!fill_buf) {
-			fastboot_fail("Malloc failed for: CHUNK_TYPE_FILL");
-			return 1;
-		}
-
 		fill_val = *(uint32_t *)data;
 		data = (char *)data + sizeof(uint32_t);
 
-		for (i = 0;
-			i < (info->blksz * fill_buf_num_blks /
-				sizeof(fill_val));
-			i++)
-			fill_buf[i] = fill_val;
-
 		if (*blk + blkcnt > info->start + info->size) {
 			printf("%s: Request would exceed partition size!\n",
 				__func__);
@@ -153,11 +175,24 @@ int write_sparse_chunk(struct sparse_storage *info, const sparse_header_t *spars
 			return 1;
 		}
 
+		if (!fill_val && erase_blks(info, *blk, blkcnt)) {
+			*blk += blkcnt;
+			*bytes_written += blkcnt * info->blksz;
+			*total_blocks += chunk_data_sz / sparse_header->blk_sz;
+			break;
+		}
+
+		buf = get_fill_buf(fill_val);
+		if (!buf) {
+			fastboot_fail("Malloc failed for: CHUNK_TYPE_FILL");
+			return 1;
+		}
+
 		for (i = 0; i < blkcnt;) {
 			j = blkcnt - i;
 			if (j > fill_buf_num_blks)
 				j = fill_buf_num_blks;
-			blks = info->write(info, *blk, j, fill_buf);
+			blks = info->write(info, *blk, j, buf);
 			/* blks might be > j (eg. NAND bad-blocks) */
 			if (blks < j) {
 				printf("%s: %s " LBAFU " [%d]\n",
@@ -165,7 +200,6 @@ int write_sparse_chunk(struct sparse_storage *info, const sparse_header_t *spars
 					"Write failed, block #",
 					*blk, j);
 				fastboot_fail("flash write failure");
-				free(fill_buf);
 				return 1;
 			}
 			*blk += blks;
@@ -173,11 +207,15 @@ int write_sparse_chunk(struct sparse_storage *info, const sparse_header_t *spars
 		}
 		*bytes_written += blkcnt * info->blksz;
 		*total_blocks += chunk_data_sz / sparse_header->blk_sz;
-		free(fill_buf);
 		break;
 
 	case CHUNK_TYPE_DONT_CARE:
-		*blk += info->reserve(info, *blk, blkcnt);
+		/* leave the blocks erased rather than with stale data */
+		if (*blk + blkcnt <= info->start + info->size &&
+		    erase_blks(info, *blk, blkcnt))
+			*blk += blkcnt;
+		else
+			*blk += info->reserve(info, *blk, blkcnt);
 		*total_blocks += chunk_header->chunk_sz;
 		break;
 
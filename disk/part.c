@@ -217,6 +217,7 @@ void part_init(struct blk_desc *dev_desc)
 	const int n_ents = ll_entry_count(struct part_driver, part_driver);
 	struct part_driver *entry;
 
+	blk_changed(dev_desc);
 	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
 
 	dev_desc->part_type = PART_TYPE_UNKNOWN;
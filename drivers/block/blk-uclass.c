@@ -8,6 +8,9 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <linux/sizes.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 
@@ -386,12 +389,280 @@ int blk_get_device(int if_type, int devnum, struct udevice **devp)
 	return -ENODEV;
 }
 
+/* Upper bound for a merged run that has to go through a bounce buffer */
+#define BLK_BOUNCE_MAX_BYTES	SZ_1M
+
+static bool blk_run_is_contiguous(struct blk_desc *desc, struct list_head *run)
+{
+	struct blk_request *req, *prev = NULL;
+
+	list_for_each_entry(req, run, list) {
+		if (prev && (char *)req->buffer !=
+		    (char *)prev->buffer + prev->blkcnt * desc->blksz)
+			return false;
+		prev = req;
+	}
+
+	return true;
+}
+
+/* Whether every request starts at the block following the previous one */
+static bool blk_batch_is_run(struct list_head *batch)
+{
+	struct blk_request *req, *prev = NULL;
+
+	list_for_each_entry(req, batch, list) {
+		if (prev && req->start != prev->start + prev->blkcnt)
+			return false;
+		prev = req;
+	}
+
+	return true;
+}
+
+/* Share out @done blocks, counted from the start of the run */
+static void blk_run_set_result(struct list_head *run, long done)
+{
+	struct blk_request *req;
+
+	list_for_each_entry(req, run, list) {
+		if (done < 0)
+			req->result = done;
+		else
+			req->result = min_t(long, done, req->blkcnt);
+		if (done > 0)
+			done -= req->result;
+	}
+}
+
+static void blk_run_transfer(struct blk_desc *desc, struct list_head *run,
+			     lbaint_t blkcnt)
+{
+	struct udevice *dev = desc->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_request *first, *req;
+	size_t bytes = blkcnt * desc->blksz;
+	char *bounce, *ptr;
+	long done;
+
+	first = list_first_entry(run, struct blk_request, list);
+	if (blk_run_is_contiguous(desc, run)) {
+		if (first->op == BLK_REQ_READ)
+			done = ops->read(dev, first->start, blkcnt,
+					 first->buffer);
+		else
+			done = ops->write(dev, first->start, blkcnt,
+					  first->buffer);
+		blk_run_set_result(run, done);
+		return;
+	}
+
+	bounce = NULL;
+	if (bytes <= BLK_BOUNCE_MAX_BYTES)
+		bounce = malloc_cache_aligned(bytes);
+	if (!bounce) {
+		/* no memory for merging, one transfer per request */
+		list_for_each_entry(req, run, list) {
+			if (req->op == BLK_REQ_READ)
+				req->result = ops->read(dev, req->start,
+							req->blkcnt,
+							req->buffer);
+			else
+				req->result = ops->write(dev, req->start,
+							 req->blkcnt,
+							 req->buffer);
+		}
+		return;
+	}
+
+	if (first->op == BLK_REQ_WRITE) {
+		ptr = bounce;
+		list_for_each_entry(req, run, list) {
+			memcpy(ptr, req->buffer, req->blkcnt * desc->blksz);
+			ptr += req->blkcnt * desc->blksz;
+		}
+		done = ops->write(dev, first->start, blkcnt, bounce);
+	} else {
+		done = ops->read(dev, first->start, blkcnt, bounce);
+	}
+	blk_run_set_result(run, done);
+
+	if (first->op == BLK_REQ_READ) {
+		ptr = bounce;
+		list_for_each_entry(req, run, list) {
+			if (req->result > 0)
+				memcpy(req->buffer, ptr,
+				       req->result * desc->blksz);
+			ptr += req->blkcnt * desc->blksz;
+		}
+	}
+	free(bounce);
+}
+
+static int blk_run_complete(struct blk_desc *desc, struct list_head *run)
+{
+	struct blk_request *req, *n;
+	int ret = 0;
+
+	list_for_each_entry_safe(req, n, run, list) {
+		list_del_init(&req->list);
+		/* written blocks are left to be read back from the media */
+		if (req->op == BLK_REQ_READ && req->result == req->blkcnt)
+			blkcache_fill(desc->if_type, desc->devnum, req->start,
+				      req->blkcnt, desc->blksz, req->buffer);
+
+		if (req->result != req->blkcnt && !ret)
+			ret = req->result < 0 ? req->result : -EIO;
+		if (req->complete)
+			req->complete(req);
+	}
+
+	return ret;
+}
+
+/* Insert a read into @batch, keeping it sorted by block number */
+static void blk_batch_add_sorted(struct list_head *batch,
+				 struct blk_request *req)
+{
+	struct blk_request *pos;
+
+	list_for_each_entry_reverse(pos, batch, list) {
+		if (pos->start <= req->start) {
+			list_add(&req->list, &pos->list);
+			return;
+		}
+	}
+	list_add(&req->list, batch);
+}
+
+int blk_run_queue(struct blk_desc *block_dev)
+{
+	const struct blk_ops *ops = blk_get_ops(block_dev->bdev);
+	struct blk_request *req, *n, *last;
+	LIST_HEAD(batch);
+	LIST_HEAD(run);
+	lbaint_t blkcnt;
+	int ret = 0;
+	int err;
+
+	while (!list_empty(&block_dev->queue)) {
+		/*
+		 * Take the requests up to the next change of direction. Reads
+		 * may be reordered among themselves, but writes are issued in
+		 * the order they were queued in case they overlap.
+		 */
+		req = list_first_entry(&block_dev->queue, struct blk_request,
+				       list);
+		list_for_each_entry_safe_from(req, n, &block_dev->queue, list) {
+			if (!list_empty(&batch) && req->op !=
+			    list_first_entry(&batch, struct blk_request,
+					     list)->op)
+				break;
+			list_del(&req->list);
+			block_dev->queue_len--;
+			if (req->op == BLK_REQ_READ)
+				blk_batch_add_sorted(&batch, req);
+			else
+				list_add_tail(&req->list, &batch);
+		}
+
+		/*
+		 * Writes to separate runs all go to submit(), so that a
+		 * device which packs writes issues them as one command.
+		 */
+		req = list_first_entry(&batch, struct blk_request, list);
+		if (req->op == BLK_REQ_WRITE && ops->submit &&
+		    !blk_batch_is_run(&batch)) {
+			blk_run_set_result(&batch,
+					   ops->submit(block_dev->bdev,
+						       &batch));
+			err = blk_run_complete(block_dev, &batch);
+			if (err && !ret)
+				ret = err;
+			continue;
+		}
+
+		while (!list_empty(&batch)) {
+			/* merge requests for adjacent blocks into a run */
+			req = list_first_entry(&batch, struct blk_request,
+					       list);
+			list_move_tail(&req->list, &run);
+			blkcnt = req->blkcnt;
+			last = req;
+			while (!list_empty(&batch)) {
+				req = list_first_entry(&batch,
+						       struct blk_request,
+						       list);
+				if (req->start != last->start + last->blkcnt)
+					break;
+				list_move_tail(&req->list, &run);
+				blkcnt += req->blkcnt;
+				last = req;
+			}
+
+			debug("%s: %s " LBAF ", count " LBAFU "\n", __func__,
+			      last->op == BLK_REQ_READ ? "read" : "write",
+			      list_first_entry(&run, struct blk_request,
+					       list)->start, blkcnt);
+			blk_run_transfer(block_dev, &run, blkcnt);
+			err = blk_run_complete(block_dev, &run);
+			if (err && !ret)
+				ret = err;
+		}
+	}
+
+	return ret;
+}
+
+static int blk_queue_add(struct blk_desc *block_dev, struct blk_request *req)
+{
+	/*
+	 * Later reads must not be served stale blocks from the cache, nor
+	 * the data written instead of what reached the media.
+	 */
+	if (req->op == BLK_REQ_WRITE) {
+		blk_changed(block_dev);
+		blkcache_invalidate_range(block_dev->if_type,
+					  block_dev->devnum, req->start,
+					  req->blkcnt);
+	}
+	list_add_tail(&req->list, &block_dev->queue);
+	if (++block_dev->queue_len >= CONFIG_BLK_QUEUE_DEPTH)
+		return blk_run_queue(block_dev);
+
+	return 0;
+}
+
+int blk_submit(struct blk_desc *block_dev, struct blk_request *req)
+{
+	const struct blk_ops *ops = blk_get_ops(block_dev->bdev);
+
+	if ((req->op == BLK_REQ_READ && !ops->read) ||
+	    (req->op == BLK_REQ_WRITE && !ops->write)) {
+		req->result = -ENOSYS;
+		if (req->complete)
+			req->complete(req);
+		return -ENOSYS;
+	}
+
+	if (req->op == BLK_REQ_READ &&
+	    blkcache_read(block_dev->if_type, block_dev->devnum, req->start,
+			  req->blkcnt, block_dev->blksz, req->buffer)) {
+		req->result = req->blkcnt;
+		if (req->complete)
+			req->complete(req);
+		return 0;
+	}
+
+	return blk_queue_add(block_dev, req);
+}
+
 unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			lbaint_t blkcnt, void *buffer)
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
+	struct blk_request req;
 
 	if (!ops->read)
 		return -ENOSYS;
@@ -399,12 +670,16 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
-	blks_read = ops->read(dev, start, blkcnt, buffer);
-	if (blks_read == blkcnt)
-		blkcache_fill(block_dev->if_type, block_dev->devnum,
-			      start, blkcnt, block_dev->blksz, buffer);
+	if (blkcache_readahead(block_dev, start, blkcnt, buffer))
+		return blkcnt;
+
+	/* issue anything queued before us, together with this read */
+	blk_init_request(&req, BLK_REQ_READ, start, blkcnt, buffer);
+	blk_queue_add(block_dev, &req);
+	if (!list_empty(&req.list))
+		blk_run_queue(block_dev);
 
-	return blks_read;
+	return req.result;
 }
 
 unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
@@ -412,12 +687,17 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_request req;
 
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
-	return ops->write(dev, start, blkcnt, buffer);
+	blk_init_request(&req, BLK_REQ_WRITE, start, blkcnt, (void *)buffer);
+	blk_queue_add(block_dev, &req);
+	if (!list_empty(&req.list))
+		blk_run_queue(block_dev);
+
+	return req.result;
 }
 
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
@@ -429,10 +709,20 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->erase)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_run_queue(block_dev);
+	blk_changed(block_dev);
+	blkcache_invalidate_range(block_dev->if_type, block_dev->devnum,
+				  start, blkcnt);
 	return ops->erase(dev, start, blkcnt);
 }
 
+void blk_changed(struct blk_desc *block_dev)
+{
+	static unsigned long change_seq;
+
+	block_dev->change_seq = ++change_seq;
+}
+
 int blk_prepare_device(struct udevice *dev)
 {
 	struct blk_desc *desc = dev_get_uclass_platdata(dev);
@@ -542,8 +832,27 @@ int blk_unbind_all(int if_type)
 	return 0;
 }
 
+static int blk_post_bind(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_platdata(dev);
+
+	INIT_LIST_HEAD(&desc->queue);
+
+	return 0;
+}
+
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_platdata(dev);
+
+	blk_changed(desc);
+	return blk_run_queue(desc);
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
+	.post_bind	= blk_post_bind,
+	.pre_remove	= blk_pre_remove,
 	.per_device_platdata_auto_alloc_size = sizeof(struct blk_desc),
 };
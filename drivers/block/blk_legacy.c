@@ -243,9 +243,17 @@ ulong blk_write_devnum(enum if_type if_type, int devnum, lbaint_t start,
 	ret = get_desc(drv, devnum, &desc);
 	if (ret)
 		return ret;
+	blk_changed(desc);
 	return desc->block_write(desc, start, blkcnt, buffer);
 }
 
+void blk_changed(struct blk_desc *block_dev)
+{
+	static unsigned long change_seq;
+
+	block_dev->change_seq = ++change_seq;
+}
+
 int blk_select_hwpart_devnum(enum if_type if_type, int devnum, int hwpart)
 {
 	struct blk_driver *drv = blk_driver_lookup_type(if_type);
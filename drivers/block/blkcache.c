@@ -7,65 +7,177 @@
  */
 #include <config.h>
 #include <common.h>
+#include <blk.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
 
-struct block_cache_node {
-	struct list_head lh;
+/*
+ * The cache holds individual blocks. Each block lives in a hash bucket
+ * keyed on (iftype, devnum, lba) and on the LRU list of its device, so a
+ * lookup is O(1) per block and every device is trimmed against its own
+ * budget without evicting the blocks of another device.
+ */
+#define BLKCACHE_HASH_BITS	10
+#define BLKCACHE_HASH_SIZE	(1 << BLKCACHE_HASH_BITS)
+
+struct block_cache_dev {
+	struct list_head lh;		/* in block_cache_devs */
+	struct list_head lru;		/* block_cache_node, MRU first */
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
 	unsigned long blksz;
-	char *cache;
+	unsigned long bytes;		/* bytes of block data cached */
+	lbaint_t next;			/* block following the last read */
+	int sequential;			/* last read started at 'next' */
 };
 
-static LIST_HEAD(block_cache);
+struct block_cache_node {
+	struct hlist_node hn;
+	struct list_head lh;		/* in block_cache_dev.lru */
+	struct block_cache_dev *dev;
+	lbaint_t lba;
+	char cache[0];
+};
+
+static LIST_HEAD(block_cache_devs);
+static struct hlist_head *block_cache_hash;
+
+/* read-ahead buffer, reused while it is large enough */
+static char *ra_buf;
+static unsigned long ra_buf_size;
+static int ra_busy;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 2,
-	.max_entries = 32
+	.max_blocks_per_entry = CONFIG_BLOCK_CACHE_MAX_BLOCKS,
+	.max_megabytes = CONFIG_BLOCK_CACHE_SIZE_MB,
+	.readahead = CONFIG_BLOCK_CACHE_READAHEAD,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static inline unsigned int cache_hash(int iftype, int devnum, lbaint_t lba)
+{
+	u32 key = (u32)lba ^ (u32)((u64)lba >> 32) ^
+		  ((u32)iftype << 24) ^ ((u32)devnum << 16);
+
+	/* multiplicative hash, keep the top bits */
+	return (key * 0x9e370001U) >> (32 - BLKCACHE_HASH_BITS);
+}
+
+static struct block_cache_dev *cache_dev_find(int iftype, int devnum)
+{
+	struct block_cache_dev *bdev;
+
+	list_for_each_entry(bdev, &block_cache_devs, lh)
+		if (bdev->iftype == iftype && bdev->devnum == devnum)
+			return bdev;
+	return NULL;
+}
+
+static void cache_node_free(struct block_cache_node *node)
+{
+	hlist_del(&node->hn);
+	list_del(&node->lh);
+	node->dev->bytes -= node->dev->blksz;
+	_stats.entries--;
+	free(node);
+}
+
+static void cache_dev_flush(struct block_cache_dev *bdev)
+{
+	while (!list_empty(&bdev->lru))
+		cache_node_free(list_first_entry(&bdev->lru,
+						 struct block_cache_node, lh));
+}
+
+static struct block_cache_dev *cache_dev_get(int iftype, int devnum,
+					     unsigned long blksz)
+{
+	struct block_cache_dev *bdev = cache_dev_find(iftype, devnum);
+
+	if (!block_cache_hash) {
+		block_cache_hash = calloc(BLKCACHE_HASH_SIZE,
+					  sizeof(*block_cache_hash));
+		if (!block_cache_hash)
+			return NULL;
+	}
+
+	if (bdev) {
+		/* block size changed, e.g. a different medium was inserted */
+		if (bdev->blksz != blksz) {
+			cache_dev_flush(bdev);
+			bdev->blksz = blksz;
+		}
+		return bdev;
+	}
+
+	bdev = calloc(1, sizeof(*bdev));
+	if (!bdev)
+		return NULL;
+	INIT_LIST_HEAD(&bdev->lru);
+	bdev->iftype = iftype;
+	bdev->devnum = devnum;
+	bdev->blksz = blksz;
+	list_add(&bdev->lh, &block_cache_devs);
+
+	return bdev;
+}
+
+static struct block_cache_node *cache_find(struct block_cache_dev *bdev,
+					   lbaint_t lba)
 {
 	struct block_cache_node *node;
+	struct hlist_node *pos;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+	hlist_for_each_entry(node, pos,
+			     &block_cache_hash[cache_hash(bdev->iftype,
+							  bdev->devnum, lba)],
+			     hn)
+		if (node->dev == bdev && node->lba == lba)
 			return node;
-		}
-	return 0;
+	return NULL;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	struct block_cache_dev *bdev = NULL;
+	struct block_cache_node *node;
+	char *dst = buffer;
+	lbaint_t i;
+
+	/* nested read issued by blkcache_readahead() */
+	if (ra_busy)
+		return 0;
+
+	if (_stats.max_megabytes)
+		bdev = cache_dev_get(iftype, devnum, blksz);
+	if (!bdev)
+		goto miss;
+
+	bdev->sequential = (start == bdev->next);
+	bdev->next = start + blkcnt;
+
+	if (blkcnt > _stats.max_blocks_per_entry)
+		goto miss;
+
+	for (i = 0; i < blkcnt; i++, dst += blksz) {
+		node = cache_find(bdev, start + i);
+		if (!node)
+			goto miss;
+		memcpy(dst, node->cache, blksz);
+		/* maintain MRU ordering */
+		list_move(&node->lh, &bdev->lru);
 	}
 
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++_stats.hits;
+	return 1;
+
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
@@ -76,93 +188,175 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
+	unsigned long budget = (unsigned long)_stats.max_megabytes << 20;
+	struct block_cache_dev *bdev;
 	struct block_cache_node *node;
+	const char *src = buffer;
+	lbaint_t i;
 
-	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	/* don't cache big stuff, unless it is our own read-ahead */
+	if (blkcnt > _stats.max_blocks_per_entry && !ra_busy)
+		return;
+
+	if (budget < blksz || blkcnt * blksz > budget)
 		return;
 
-	if (_stats.max_entries == 0)
+	bdev = cache_dev_get(iftype, devnum, blksz);
+	if (!bdev)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
+	debug("fill: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+
+	for (i = 0; i < blkcnt; i++, src += blksz) {
+		node = cache_find(bdev, start + i);
+		if (node) {
+			memcpy(node->cache, src, blksz);
+			list_move(&node->lh, &bdev->lru);
+			continue;
 		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
+		if (bdev->bytes + blksz > budget) {
+			/* reuse the LRU block of this device */
+			node = list_last_entry(&bdev->lru,
+					       struct block_cache_node, lh);
+			debug("drop: lba " LBAF "\n", node->lba);
+			hlist_del(&node->hn);
+			list_del(&node->lh);
+			bdev->bytes -= blksz;
+			_stats.entries--;
+			_stats.evictions++;
+		} else {
+			node = malloc(sizeof(*node) + blksz);
+			if (!node)
+				return;
+			node->dev = bdev;
 		}
+
+		node->lba = start + i;
+		memcpy(node->cache, src, blksz);
+		hlist_add_head(&node->hn,
+			       &block_cache_hash[cache_hash(iftype, devnum,
+							    node->lba)]);
+		list_add(&node->lh, &bdev->lru);
+		bdev->bytes += blksz;
+		_stats.entries++;
 	}
+}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
+int blkcache_readahead(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt, void *buffer)
+{
+	struct block_cache_dev *bdev;
+	unsigned long bytes;
+	lbaint_t racnt;
+	ulong n;
+
+	if (ra_busy || !_stats.readahead ||
+	    blkcnt > _stats.max_blocks_per_entry)
+		return 0;
+
+	bdev = cache_dev_find(block_dev->if_type, block_dev->devnum);
+	if (!bdev || !bdev->sequential)
+		return 0;
+
+	racnt = _stats.readahead;
+	if (block_dev->lba && start + blkcnt + racnt > block_dev->lba) {
+		if (start + blkcnt >= block_dev->lba)
+			return 0;
+		racnt = block_dev->lba - start - blkcnt;
+	}
+
+	bytes = (blkcnt + racnt) * block_dev->blksz;
+	if (bytes > ((unsigned long)_stats.max_megabytes << 20))
+		return 0;
+
+	if (bytes > ra_buf_size) {
+		free(ra_buf);
+		ra_buf_size = 0;
+		ra_buf = malloc_cache_aligned(bytes);
+		if (!ra_buf)
+			return 0;
+		ra_buf_size = bytes;
+	}
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	debug("readahead: start " LBAF ", count " LBAFU "\n",
+	      start + blkcnt, racnt);
+
+	/* the nested read misses the cache and fills it with all blocks */
+	ra_busy = 1;
+	n = blk_dread(block_dev, start, blkcnt + racnt, ra_buf);
+	ra_busy = 0;
+	if (n != blkcnt + racnt)
+		return 0;
+
+	memcpy(buffer, ra_buf, blkcnt * block_dev->blksz);
+	_stats.readaheads++;
+
+	return 1;
 }
 
-void blkcache_invalidate(int iftype, int devnum)
+void blkcache_invalidate_range(int iftype, int devnum,
+			       lbaint_t start, lbaint_t blkcnt)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_dev *bdev = cache_dev_find(iftype, devnum);
+	struct block_cache_node *node, *n;
+	lbaint_t i;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
+	if (!bdev)
+		return;
+
+	if (blkcnt > bdev->bytes / bdev->blksz) {
+		/* cheaper to walk what we have than the whole range */
+		list_for_each_entry_safe(node, n, &bdev->lru, lh)
+			if (node->lba >= start && node->lba - start < blkcnt)
+				cache_node_free(node);
+		return;
+	}
+
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(bdev, start + i);
+		if (node)
+			cache_node_free(node);
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_invalidate(int iftype, int devnum)
 {
-	struct block_cache_node *node;
+	struct block_cache_dev *bdev = cache_dev_find(iftype, devnum);
+
+	if (!bdev)
+		return;
+
+	cache_dev_flush(bdev);
+	list_del(&bdev->lh);
+	free(bdev);
+}
+
+void blkcache_configure(unsigned blocks, unsigned megabytes,
+			unsigned readahead)
+{
+	struct block_cache_dev *bdev, *n;
+
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries)) {
+	    (megabytes != _stats.max_megabytes)) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
+		list_for_each_entry_safe(bdev, n, &block_cache_devs, lh) {
+			cache_dev_flush(bdev);
+			list_del(&bdev->lh);
+			free(bdev);
 		}
 		_stats.entries = 0;
 	}
 
 	_stats.max_blocks_per_entry = blocks;
-	_stats.max_entries = entries;
+	_stats.max_megabytes = megabytes;
+	_stats.readahead = readahead;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.readaheads = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -170,4 +364,6 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.readaheads = 0;
 }
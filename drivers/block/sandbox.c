@@ -49,6 +49,7 @@ static unsigned long host_block_read(struct blk_desc *block_dev,
 		return -1;
 #endif
 
+	host_dev->cmd_count++;
 	if (os_lseek(host_dev->fd, start * block_dev->blksz, OS_SEEK_SET) ==
 			-1) {
 		printf("ERROR: Invalid block %lx\n", start);
@@ -76,6 +77,7 @@ static unsigned long host_block_write(struct blk_desc *block_dev,
 	struct host_block_dev *host_dev = find_host_device(dev);
 #endif
 
+	host_dev->cmd_count++;
 	if (os_lseek(host_dev->fd, start * block_dev->blksz, OS_SEEK_SET) ==
 			-1) {
 		printf("ERROR: Invalid block %lx\n", start);
@@ -88,6 +90,40 @@ static unsigned long host_block_write(struct blk_desc *block_dev,
 }
 
 #ifdef CONFIG_BLK
+/* Transfer a run of adjacent requests with one seek, as one command */
+static long host_block_submit(struct udevice *dev, struct list_head *reqs)
+{
+	struct host_block_dev *host_dev = dev_get_priv(dev);
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+	struct blk_request *req, *prev = NULL;
+	long done = 0;
+	ssize_t len;
+
+	host_dev->cmd_count++;
+	list_for_each_entry(req, reqs, list) {
+		if ((!prev || req->start != prev->start + prev->blkcnt) &&
+		    os_lseek(host_dev->fd, req->start * block_dev->blksz,
+			     OS_SEEK_SET) == -1) {
+			printf("ERROR: Invalid block " LBAF "\n", req->start);
+			return done ? done : -1;
+		}
+		prev = req;
+		if (req->op == BLK_REQ_READ)
+			len = os_read(host_dev->fd, req->buffer,
+				      req->blkcnt * block_dev->blksz);
+		else
+			len = os_write(host_dev->fd, req->buffer,
+				       req->blkcnt * block_dev->blksz);
+		if (len < 0)
+			return done ? done : -1;
+		done += len / block_dev->blksz;
+		if (len != req->blkcnt * block_dev->blksz)
+			break;
+	}
+
+	return done;
+}
+
 int host_dev_bind(int devnum, char *filename)
 {
 	struct host_block_dev *host_dev;
@@ -221,6 +257,7 @@ int host_get_dev_err(int devnum, struct blk_desc **blk_devp)
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
@@ -19,6 +19,7 @@
 #include <mmc.h>
 #include <part.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <fsl_esdhc.h>
 #include <fdt_support.h>
 #include <asm/io.h>
@@ -51,6 +52,25 @@ DECLARE_GLOBAL_DATA_PTR;
 #define	ESDHC_FLAG_ERR010450		BIT(10)
 #define	ESDHC_FLAG_HS400_ES		BIT(11)
 
+#ifdef CONFIG_FSL_ESDHC_ADMA2
+/* ADMA2 descriptor attributes */
+#define ADMA2_ATTR_VALID		BIT(0)
+#define ADMA2_ATTR_END			BIT(1)
+#define ADMA2_ATTR_TRAN			(0x2 << 4)
+
+/* keep segments a multiple of the page and cache line size */
+#define ADMA2_MAX_LEN			0xf000
+/* a full b_max transfer, plus the head and tail of a misaligned read */
+#define ADMA2_DESC_COUNT	\
+	(DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * 512, ADMA2_MAX_LEN) + 2)
+
+struct esdhc_adma2_desc {
+	u16	attr;
+	u16	len;
+	u32	addr;
+} __packed;
+#endif
+
 struct fsl_esdhc {
 	uint    dsaddr;		/* SDMA system address register */
 	uint    blkattr;	/* Block attributes register */
@@ -122,6 +142,15 @@ struct esdhc_soc_data {
  * @wp_enable: 1: enable checking wp; 0: no check
  * @cd_gpio: gpio for card detection
  * @wp_gpio: gpio for write protection
+ * Following is used when ADMA2 is enabled
+ * @adma_table: descriptor table of the current transfer
+ * @adma_scratch: cache aligned buffer for the head and tail of a read
+ *		  whose destination is not cache aligned
+ * @adma_active: the current transfer uses ADMA2
+ * @adma_body: cache aligned part of the read destination
+ * @adma_head: destination bytes received through adma_scratch
+ * @adma_tail: destination bytes received through adma_scratch +
+ *	       ARCH_DMA_MINALIGN
  */
 struct fsl_esdhc_priv {
 	struct fsl_esdhc *esdhc_regs;
@@ -150,6 +179,17 @@ struct fsl_esdhc_priv {
 	struct gpio_desc cd_gpio;
 	struct gpio_desc wp_gpio;
 #endif
+#ifdef CONFIG_FSL_ESDHC_ADMA2
+	struct esdhc_adma2_desc *adma_table;
+	char *adma_scratch;
+	int adma_active;
+	char *adma_body;
+	uint adma_body_len;
+	char *adma_head;
+	uint adma_head_len;
+	char *adma_tail;
+	uint adma_tail_len;
+#endif
 };
 
 static void esdhc_dump(struct mmc *mmc)
@@ -280,6 +320,195 @@ esdhc_pio_read_write(struct mmc *mmc, struct mmc_data *data)
 }
 #endif
 
+#ifdef CONFIG_FSL_ESDHC_ADMA2
+static int esdhc_adma_addr(const void *buf, u32 *addr)
+{
+#if defined(CONFIG_FSL_LAYERSCAPE) || defined(CONFIG_S32V234) || \
+	defined(CONFIG_IMX8) || defined(CONFIG_IMX8M)
+	dma_addr_t phys = virt_to_phys((void *)buf);
+
+	if (upper_32_bits(phys))
+		return -EINVAL;
+	*addr = lower_32_bits(phys);
+#else
+	*addr = (u32)buf;
+#endif
+	return 0;
+}
+
+/* Append descriptors for @len bytes at @buf, return the new count */
+static int esdhc_adma_map(struct fsl_esdhc_priv *priv, int n,
+			  const char *buf, uint len)
+{
+	struct esdhc_adma2_desc *desc;
+	uint seg;
+	u32 addr;
+
+	while (len && n >= 0) {
+		if (n >= ADMA2_DESC_COUNT || esdhc_adma_addr(buf, &addr))
+			return -EINVAL;
+		seg = min_t(uint, len, ADMA2_MAX_LEN);
+		desc = &priv->adma_table[n++];
+		desc->attr = cpu_to_le16(ADMA2_ATTR_VALID | ADMA2_ATTR_TRAN);
+		desc->len = cpu_to_le16(seg);
+		desc->addr = cpu_to_le32(addr);
+		buf += seg;
+		len -= seg;
+	}
+
+	return n;
+}
+
+/*
+ * Describe @data in the ADMA2 table and select ADMA2, or leave the
+ * controller in SDMA mode if the buffer cannot be described.
+ *
+ * A read into a buffer which is not cache aligned receives the partial
+ * cache lines at either end in adma_scratch, so that invalidating the
+ * destination never discards data that merely shares a line with it.
+ * Everything in between goes straight into the caller's buffer.
+ */
+static int esdhc_adma_setup(struct fsl_esdhc_priv *priv,
+			    struct mmc_data *data)
+{
+	struct fsl_esdhc *regs = priv->esdhc_regs;
+	uint len = data->blocks * data->blocksize;
+	ulong start, end;
+	char *buf;
+	u32 addr;
+	int n;
+
+	priv->adma_active = 0;
+	priv->adma_head_len = 0;
+	priv->adma_body_len = 0;
+	priv->adma_tail_len = 0;
+	esdhc_clrbits32(&regs->proctl, PROCTL_DMAS_MASK);
+
+	if (!priv->adma_table)
+		return -ENOMEM;
+
+	if (data->flags & MMC_DATA_READ)
+		buf = data->dest;
+	else
+		buf = (char *)data->src;
+	start = (ulong)buf;
+	end = start + len;
+	if ((start | len) & 3)
+		return -EINVAL;
+
+	if (data->flags & MMC_DATA_READ) {
+		priv->adma_head_len = min_t(ulong, roundup(start,
+						ARCH_DMA_MINALIGN) - start, len);
+		if (len > priv->adma_head_len)
+			priv->adma_tail_len = end & (ARCH_DMA_MINALIGN - 1);
+		priv->adma_body_len = len - priv->adma_head_len -
+				      priv->adma_tail_len;
+		priv->adma_head = buf;
+		priv->adma_body = buf + priv->adma_head_len;
+		priv->adma_tail = priv->adma_body + priv->adma_body_len;
+
+		n = esdhc_adma_map(priv, 0, priv->adma_scratch,
+				   priv->adma_head_len);
+		n = esdhc_adma_map(priv, n, priv->adma_body,
+				   priv->adma_body_len);
+		n = esdhc_adma_map(priv, n,
+				   priv->adma_scratch + ARCH_DMA_MINALIGN,
+				   priv->adma_tail_len);
+	} else {
+		n = esdhc_adma_map(priv, 0, buf, len);
+		if (n > 0)
+			flush_dcache_range(rounddown(start, ARCH_DMA_MINALIGN),
+					   roundup(end, ARCH_DMA_MINALIGN));
+	}
+
+	if (n <= 0 || esdhc_adma_addr(priv->adma_table, &addr)) {
+		priv->adma_head_len = 0;
+		priv->adma_body_len = 0;
+		priv->adma_tail_len = 0;
+		return -EINVAL;
+	}
+
+	priv->adma_table[n - 1].attr |= cpu_to_le16(ADMA2_ATTR_END);
+	flush_dcache_range((ulong)priv->adma_table,
+			   (ulong)priv->adma_table +
+			   roundup(n * sizeof(*priv->adma_table),
+				   ARCH_DMA_MINALIGN));
+
+	esdhc_write32(&regs->adsaddr, addr);
+	esdhc_clrsetbits32(&regs->proctl, PROCTL_DMAS_MASK, PROCTL_DMAS_ADMA2);
+	priv->adma_active = 1;
+
+	return 0;
+}
+
+static int esdhc_adma_active(struct fsl_esdhc_priv *priv)
+{
+	return priv->adma_active;
+}
+
+static void esdhc_adma_invalidate(struct fsl_esdhc_priv *priv)
+{
+	if (priv->adma_body_len)
+		invalidate_dcache_range((ulong)priv->adma_body,
+					(ulong)priv->adma_body +
+					priv->adma_body_len);
+	if (priv->adma_head_len || priv->adma_tail_len)
+		invalidate_dcache_range((ulong)priv->adma_scratch,
+					(ulong)priv->adma_scratch +
+					2 * ARCH_DMA_MINALIGN);
+}
+
+/* Copy the partial cache lines of a read to their destination */
+static void esdhc_adma_finish(struct fsl_esdhc_priv *priv)
+{
+	esdhc_adma_invalidate(priv);
+	memcpy(priv->adma_head, priv->adma_scratch, priv->adma_head_len);
+	memcpy(priv->adma_tail, priv->adma_scratch + ARCH_DMA_MINALIGN,
+	       priv->adma_tail_len);
+}
+
+static void esdhc_adma_init(struct fsl_esdhc_priv *priv)
+{
+	if (priv->adma_table)
+		return;
+
+	priv->adma_table = memalign(ARCH_DMA_MINALIGN, ADMA2_DESC_COUNT *
+				    sizeof(struct esdhc_adma2_desc));
+	priv->adma_scratch = memalign(ARCH_DMA_MINALIGN,
+				      2 * ARCH_DMA_MINALIGN);
+	if (!priv->adma_table || !priv->adma_scratch) {
+		/* fall back to SDMA */
+		free(priv->adma_table);
+		free(priv->adma_scratch);
+		priv->adma_table = NULL;
+		priv->adma_scratch = NULL;
+	}
+}
+#else
+static inline int esdhc_adma_setup(struct fsl_esdhc_priv *priv,
+				   struct mmc_data *data)
+{
+	return -ENOSYS;
+}
+
+static inline int esdhc_adma_active(struct fsl_esdhc_priv *priv)
+{
+	return 0;
+}
+
+static inline void esdhc_adma_invalidate(struct fsl_esdhc_priv *priv)
+{
+}
+
+static inline void esdhc_adma_finish(struct fsl_esdhc_priv *priv)
+{
+}
+
+static inline void esdhc_adma_init(struct fsl_esdhc_priv *priv)
+{
+}
+#endif
+
 static int esdhc_setup_data(struct mmc *mmc, struct mmc_data *data)
 {
 	int timeout;
@@ -293,6 +522,10 @@ static int esdhc_setup_data(struct mmc *mmc, struct mmc_data *data)
 
 	wml_value = data->blocksize/4;
 
+#ifndef CONFIG_SYS_FSL_ESDHC_USE_PIO
+	esdhc_adma_setup(priv, data);
+#endif
+
 	if (data->flags & MMC_DATA_READ) {
 		if (wml_value > WML_RD_WML_MAX)
 			wml_value = WML_RD_WML_MAX_VAL;
@@ -312,9 +545,10 @@ static int esdhc_setup_data(struct mmc *mmc, struct mmc_data *data)
 #endif
 	} else {
 #ifndef CONFIG_SYS_FSL_ESDHC_USE_PIO
-		flush_dcache_range((ulong)data->src,
-				   (ulong)data->src+data->blocks
-					 *data->blocksize);
+		if (!esdhc_adma_active(priv))
+			flush_dcache_range((ulong)data->src,
+					   (ulong)data->src+data->blocks
+						 *data->blocksize);
 #endif
 		if (wml_value > WML_WR_WML_MAX)
 			wml_value = WML_WR_WML_MAX_VAL;
@@ -462,7 +696,9 @@ esdhc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 		if(err)
 			return err;
 
-		if (data->flags & MMC_DATA_READ)
+		if (esdhc_adma_active(priv))
+			esdhc_adma_invalidate(priv);
+		else if (data->flags & MMC_DATA_READ)
 			check_and_invalidate_dcache_range(cmd, data);
 	}
 
@@ -568,6 +804,9 @@ esdhc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 			}
 
 			if (irqstat & DATA_ERR) {
+				if (irqstat & IRQSTAT_DMAE)
+					debug("ADMA error status 0x%08x\n",
+					      esdhc_read32(&regs->admaes));
 				err = -ECOMM;
 				goto out;
 			}
@@ -578,7 +817,9 @@ esdhc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 		 * cache-fill during the DMA operations such as the
 		 * speculative pre-fetching etc.
 		 */
-		if (data->flags & MMC_DATA_READ)
+		if (esdhc_adma_active(priv))
+			esdhc_adma_finish(priv);
+		else if (data->flags & MMC_DATA_READ)
 			check_and_invalidate_dcache_range(cmd, data);
 #endif
 	}
@@ -1220,6 +1461,10 @@ static int fsl_esdhc_init(struct fsl_esdhc_priv *priv)
 #ifdef CONFIG_SYS_FSL_ESDHC_HAS_DDR_MODE
 	priv->cfg.host_caps |= MMC_MODE_DDR_52MHz;
 #endif
+#ifndef CONFIG_SYS_FSL_ERRATUM_ESDHC111
+	/* auto-CMD12 would follow a CMD23 bounded transfer */
+	priv->cfg.host_caps |= MMC_MODE_CMD23;
+#endif
 
 	if (priv->bus_width > 0) {
 		if (priv->bus_width < 8)
@@ -1242,6 +1487,7 @@ static int fsl_esdhc_init(struct fsl_esdhc_priv *priv)
 	priv->cfg.f_max = min(priv->sdhc_clk, (u32)200000000);
 
 	priv->cfg.b_max = CONFIG_SYS_MMC_MAX_BLK_COUNT;
+	esdhc_adma_init(priv);
 
 	writel(0, &regs->dllctrl);
 	if (priv->flags & ESDHC_FLAG_USDHC) {
@@ -312,6 +312,7 @@ static const struct blk_ops mmc_blk_ops = {
 #ifndef CONFIG_SPL_BUILD
 	.write	= mmc_bwrite,
 	.erase	= mmc_berase,
+	.submit	= mmc_bsubmit,
 #endif
 	.select_hwpart	= mmc_select_hwpart,
 };
@@ -154,6 +154,25 @@ void mmc_trace_state(struct mmc *mmc, struct mmc_cmd *cmd)
 }
 #endif
 
+#ifdef CONFIG_MMC_STATS
+void mmc_stats_add(struct mmc *mmc, bool write, u64 bytes, ulong cmds,
+		   ulong start)
+{
+	struct mmc_stats *stats = &mmc->stats;
+	ulong us = timer_get_us() - start;
+
+	if (write) {
+		stats->write_bytes += bytes;
+		stats->write_us += us;
+		stats->write_cmds += cmds;
+	} else {
+		stats->read_bytes += bytes;
+		stats->read_us += us;
+		stats->read_cmds += cmds;
+	}
+}
+#endif
+
 const char *mmc_mode_name(enum bus_mode mode)
 {
 	static const char *const names[] = {
@@ -367,11 +386,26 @@ int mmc_send_tuning(struct mmc *mmc, u32 opcode, int *cmd_error)
 }
 
 
+int mmc_set_blockcount(struct mmc *mmc, u32 arg)
+{
+	struct mmc_cmd cmd;
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = arg;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool sbc = mmc_can_sbc(mmc, blkcnt);
+
+	if (sbc && mmc_set_blockcount(mmc, blkcnt))
+		return 0;
 
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
@@ -393,7 +427,7 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	if (blkcnt > 1 && !sbc) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -421,6 +455,7 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	int dev_num = block_dev->devnum;
 	int err;
 	lbaint_t cur, blocks_todo = blkcnt;
+	ulong cmds = 0, start_us;
 
 	if (blkcnt == 0)
 		return 0;
@@ -450,6 +485,7 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		return 0;
 	}
 
+	start_us = mmc_stats_start();
 	do {
 		cur = (blocks_todo > mmc->cfg->b_max) ?
 			mmc->cfg->b_max : blocks_todo;
@@ -460,8 +496,12 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		blocks_todo -= cur;
 		start += cur;
 		dst += cur * mmc->read_bl_len;
+		cmds++;
 	} while (blocks_todo > 0);
 
+	mmc_stats_add(mmc, false, (u64)blkcnt * mmc->read_bl_len, cmds,
+		      start_us);
+
 	return blkcnt;
 }
 
@@ -916,6 +956,7 @@ int mmc_switch_any(struct mmc *mmc, unsigned int field, unsigned int val)
 
 int mmc_switch_part(struct mmc *mmc, unsigned int part_num)
 {
+	struct blk_desc *desc = mmc_get_blk_desc(mmc);
 	int ret;
 
 	ret = mmc_boot_part_access_chk(mmc, part_num);
@@ -932,7 +973,15 @@ int mmc_switch_part(struct mmc *mmc, unsigned int part_num)
 	 */
 	if ((ret == 0) || ((ret == -ENODEV) && (part_num == 0))) {
 		ret = mmc_set_capacity(mmc, part_num);
-		mmc_get_blk_desc(mmc)->hwpart = part_num;
+		/*
+		 * The block cache and anything derived from the content of
+		 * the device only know the LBA, not the hardware partition.
+		 */
+		if (desc->hwpart != part_num) {
+			blk_changed(desc);
+			blkcache_invalidate(desc->if_type, desc->devnum);
+		}
+		desc->hwpart = part_num;
 	}
 
 	return ret;
@@ -1240,6 +1289,8 @@ retry_scr:
 	if (mmc->scr[0] & SD_DATA_4BIT)
 		mmc->card_caps |= MMC_MODE_4BIT;
 
+	mmc->erased_byte = mmc->scr[0] & SD_DATA_STAT_AFTER_ERASE ? 0xff : 0;
+
 	/* Version 1.0 doesn't support switching */
 	if (mmc->version == SD_VERSION_1_0)
 		return 0;
@@ -1895,6 +1946,10 @@ static int mmc_startup_v4(struct mmc *mmc)
 	bool part_completed;
 	u8 *ext_csd;
 
+	mmc->cmd_caps = 0;
+	mmc->max_packed_writes = 0;
+	mmc->erased_byte = 0xff;
+
 	if (IS_SD(mmc) || (mmc->version < MMC_VERSION_4))
 		return 0;
 
@@ -1908,6 +1963,23 @@ static int mmc_startup_v4(struct mmc *mmc)
 	err = mmc_send_ext_csd(mmc, ext_csd);
 	if (err)
 		return err;
+
+	/*
+	 * Bounded multi-block transfers save the CMD12 and its busy wait.
+	 * Packed writes came with eMMC 4.5 (EXT_CSD_REV 6).
+	 */
+	if ((mmc->cfg->host_caps & MMC_MODE_CMD23) && !mmc_host_is_spi(mmc)) {
+		mmc->cmd_caps |= MMC_CMD_CAP_SBC;
+		if (ext_csd[EXT_CSD_REV] >= 6 &&
+		    ext_csd[EXT_CSD_MAX_PACKED_WRITES] >= 2) {
+			mmc->cmd_caps |= MMC_CMD_CAP_PACKED_WR;
+			mmc->max_packed_writes =
+				ext_csd[EXT_CSD_MAX_PACKED_WRITES];
+		}
+	}
+
+	mmc->erased_byte = ext_csd[EXT_CSD_ERASED_MEM_CONT] ? 0xff : 0;
+
 	if (ext_csd[EXT_CSD_REV] >= 2) {
 		/*
 		  * According to the JEDEC Standard, the value of
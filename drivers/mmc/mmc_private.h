@@ -16,6 +16,23 @@ extern int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 			struct mmc_data *data);
 extern int mmc_send_status(struct mmc *mmc, int timeout);
 extern int mmc_set_blocklen(struct mmc *mmc, int len);
+
+/**
+ * mmc_set_blockcount() - Send SET_BLOCK_COUNT (CMD23)
+ *
+ * @mmc:	MMC device
+ * @arg:	Number of blocks of the next transfer, ORed with
+ *		MMC_CMD23_ARG_REL_WR or MMC_CMD23_ARG_PACKED
+ * @return 0 if OK, -ve on error
+ */
+int mmc_set_blockcount(struct mmc *mmc, u32 arg);
+
+/* Whether a transfer of @blkcnt blocks is bounded with CMD23 */
+static inline bool mmc_can_sbc(struct mmc *mmc, lbaint_t blkcnt)
+{
+	return (mmc->cmd_caps & MMC_CMD_CAP_SBC) && blkcnt > 1 &&
+	       blkcnt <= MMC_CMD23_MAX_BLOCKS;
+}
 #ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
 void mmc_adapter_card_type_ident(void);
 #endif
@@ -34,6 +51,7 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 ulong mmc_bwrite(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 		 const void *src);
 ulong mmc_berase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
+long mmc_bsubmit(struct udevice *dev, struct list_head *reqs);
 #else
 ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		 const void *src);
@@ -91,6 +109,35 @@ static inline void mmc_trace_state(struct mmc *mmc, struct mmc_cmd *cmd)
 }
 #endif
 
+#ifdef CONFIG_MMC_STATS
+/**
+ * mmc_stats_add() - Account a completed block transfer
+ *
+ * @mmc:	MMC device
+ * @write:	true for a write, false for a read
+ * @bytes:	Number of bytes transferred
+ * @cmds:	Number of data commands issued
+ * @start:	timer_get_us() when the transfer started
+ */
+void mmc_stats_add(struct mmc *mmc, bool write, u64 bytes, ulong cmds,
+		   ulong start);
+
+static inline ulong mmc_stats_start(void)
+{
+	return timer_get_us();
+}
+#else
+static inline void mmc_stats_add(struct mmc *mmc, bool write, u64 bytes,
+				 ulong cmds, ulong start)
+{
+}
+
+static inline ulong mmc_stats_start(void)
+{
+	return 0;
+}
+#endif
+
 /**
  * mmc_get_next_devnum() - Get the next available MMC device number
  *
@@ -10,6 +10,8 @@
 #include <config.h>
 #include <common.h>
 #include <dm.h>
+#include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <div64.h>
 #include <linux/math64.h>
@@ -133,6 +135,7 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	struct mmc_cmd cmd;
 	struct mmc_data data;
 	int timeout = 1000;
+	bool sbc;
 
 	if ((start + blkcnt) > mmc_get_blk_desc(mmc)->lba) {
 		printf("MMC: block number 0x" LBAF " exceeds max(0x" LBAF ")\n",
@@ -142,7 +145,12 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 
 	if (blkcnt == 0)
 		return 0;
-	else if (blkcnt == 1)
+
+	sbc = mmc_can_sbc(mmc, blkcnt);
+	if (sbc && mmc_set_blockcount(mmc, blkcnt))
+		return 0;
+
+	if (blkcnt == 1)
 		cmd.cmdidx = MMC_CMD_WRITE_SINGLE_BLOCK;
 	else
 		cmd.cmdidx = MMC_CMD_WRITE_MULTIPLE_BLOCK;
@@ -167,7 +175,7 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	/* SPI multiblock writes terminate using a special
 	 * token, not a STOP_TRANSMISSION request.
 	 */
-	if (!mmc_host_is_spi(mmc) && blkcnt > 1) {
+	if (!mmc_host_is_spi(mmc) && blkcnt > 1 && !sbc) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -197,6 +205,7 @@ ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 #endif
 	int dev_num = block_dev->devnum;
 	lbaint_t cur, blocks_todo = blkcnt;
+	ulong cmds = 0, start_us;
 	int err;
 
 	struct mmc *mmc = find_mmc_device(dev_num);
@@ -210,6 +219,7 @@ ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	if (mmc_set_blocklen(mmc, mmc->write_bl_len))
 		return 0;
 
+	start_us = mmc_stats_start();
 	do {
 		cur = (blocks_todo > mmc->cfg->b_max) ?
 			mmc->cfg->b_max : blocks_todo;
@@ -218,7 +228,228 @@ ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		blocks_todo -= cur;
 		start += cur;
 		src += cur * mmc->write_bl_len;
+		cmds++;
 	} while (blocks_todo > 0);
 
+	mmc_stats_add(mmc, true, (u64)blkcnt * mmc->write_bl_len, cmds,
+		      start_us);
+
+	return blkcnt;
+}
+
+#ifdef CONFIG_BLK
+/* Largest packed write we assemble, including the header block */
+#define MMC_PACKED_MAX_BLOCKS	2048
+
+/*
+ * Write @count requests from @first on with one packed command: CMD23
+ * with the packed flag, then a CMD25 whose first block is a header
+ * listing the address and length of each request, followed by their
+ * data. The card writes each request to its own address.
+ */
+static ulong mmc_write_packed(struct mmc *mmc, struct list_head *reqs,
+			      struct blk_request *first, int count,
+			      lbaint_t blkcnt, char *buf)
+{
+	struct blk_request *req = first;
+	struct mmc_cmd cmd;
+	struct mmc_data data;
+	__le32 *hdr = (__le32 *)buf;
+	char *ptr = buf + mmc->write_bl_len;
+	ulong start_us = mmc_stats_start();
+	int i = 1;
+
+	memset(hdr, 0, mmc->write_bl_len);
+	hdr[0] = cpu_to_le32(count << 16 | MMC_PACKED_CMD_WR << 8 |
+			     MMC_PACKED_CMD_VER);
+	list_for_each_entry_from(req, reqs, list) {
+		if (i > count)
+			break;
+		hdr[i * 2] = cpu_to_le32(req->blkcnt);
+		hdr[i * 2 + 1] = cpu_to_le32(mmc->high_capacity ? req->start :
+					     req->start * mmc->write_bl_len);
+		memcpy(ptr, req->buffer, req->blkcnt * mmc->write_bl_len);
+		ptr += req->blkcnt * mmc->write_bl_len;
+		i++;
+	}
+
+	if (mmc_set_blockcount(mmc, MMC_CMD23_ARG_PACKED | blkcnt))
+		return 0;
+
+	cmd.cmdidx = MMC_CMD_WRITE_MULTIPLE_BLOCK;
+	cmd.cmdarg = le32_to_cpu(hdr[3]);
+	cmd.resp_type = MMC_RSP_R1;
+
+	data.src = buf;
+	data.blocks = blkcnt;
+	data.blocksize = mmc->write_bl_len;
+	data.flags = MMC_DATA_WRITE;
+
+	if (mmc_send_cmd(mmc, &cmd, &data)) {
+		printf("mmc packed write failed\n");
+		return 0;
+	}
+
+	if (mmc_send_status(mmc, 1000))
+		return 0;
+
+	mmc_stats_add(mmc, true, (u64)(blkcnt - 1) * mmc->write_bl_len, 1,
+		      start_us);
+
+	return blkcnt - 1;
+}
+
+/* Write requests one run at a time, merging adjacent contiguous ones */
+static long mmc_bsubmit_writes(struct udevice *dev, struct list_head *reqs)
+{
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+	struct blk_request *req;
+	const char *buf = NULL;
+	lbaint_t start = 0, blkcnt = 0;
+	long done = 0;
+	ulong n;
+
+	list_for_each_entry(req, reqs, list) {
+		if (blkcnt && req->start == start + blkcnt &&
+		    req->buffer == buf + blkcnt * block_dev->blksz) {
+			blkcnt += req->blkcnt;
+			continue;
+		}
+		if (blkcnt) {
+			n = mmc_bwrite(dev, start, blkcnt, buf);
+			done += n;
+			if (n != blkcnt)
+				return done;
+		}
+		start = req->start;
+		blkcnt = req->blkcnt;
+		buf = req->buffer;
+	}
+
+	if (blkcnt)
+		done += mmc_bwrite(dev, start, blkcnt, buf);
+
+	return done;
+}
+
+/*
+ * Issue the write requests queued on an MMC block device. Only the BLK
+ * request queue calls this, so the legacy block interface never packs its
+ * writes.
+ */
+long mmc_bsubmit(struct udevice *dev, struct list_head *reqs)
+{
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	struct blk_request *req, *pos;
+	lbaint_t blkcnt;
+	long done = 0;
+	int count, max;
+	char *buf;
+	ulong n;
+
+	if (!mmc)
+		return -ENODEV;
+
+	if (!(mmc->cmd_caps & MMC_CMD_CAP_PACKED_WR))
+		return mmc_bsubmit_writes(dev, reqs);
+
+	if (blk_select_hwpart_devnum(IF_TYPE_MMC, block_dev->devnum,
+				     block_dev->hwpart) < 0)
+		return 0;
+	if (mmc_set_blocklen(mmc, mmc->write_bl_len))
+		return 0;
+
+	buf = malloc_cache_aligned(MMC_PACKED_MAX_BLOCKS * mmc->write_bl_len);
+	if (!buf)
+		return mmc_bsubmit_writes(dev, reqs);
+
+	/* the header holds one 8-byte entry per request after its own */
+	max = min_t(int, mmc->max_packed_writes, mmc->write_bl_len / 8 - 1);
+
+	req = list_first_entry(reqs, struct blk_request, list);
+	while (&req->list != reqs) {
+		/* gather the requests that fit into one packed command */
+		count = 0;
+		blkcnt = 1;
+		pos = req;
+		list_for_each_entry_from(pos, reqs, list) {
+			if (count == max ||
+			    blkcnt + pos->blkcnt > MMC_PACKED_MAX_BLOCKS ||
+			    blkcnt + pos->blkcnt > mmc->cfg->b_max ||
+			    pos->start + pos->blkcnt > block_dev->lba)
+				break;
+			blkcnt += pos->blkcnt;
+			count++;
+		}
+
+		if (count < 2) {
+			/* not worth a header block */
+			n = mmc_bwrite(dev, req->start, req->blkcnt,
+				       req->buffer);
+			done += n;
+			if (n != req->blkcnt)
+				break;
+			req = list_entry(req->list.next, struct blk_request,
+					 list);
+			continue;
+		}
+
+		n = mmc_write_packed(mmc, reqs, req, count, blkcnt, buf);
+		if (n != blkcnt - 1)
+			break;
+		done += n;
+		req = pos;
+	}
+
+	free(buf);
+
+	return done;
+}
+#endif
+
+/* Erasing less than a group would take the rest of the group along */
+ulong mmc_erase_zeroes(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt)
+{
+	static void *zeroes;
+	static lbaint_t zeroes_blks;
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	lbaint_t grp, first, last, blk, n;
+	u32 rem;
+
+	if (!mmc || mmc->erased_byte || !mmc->erase_grp_size || !blkcnt)
+		return 0;
+
+	grp = mmc->erase_grp_size;
+	if (zeroes_blks < grp) {
+		free(zeroes);
+		zeroes = malloc_cache_aligned(grp * block_dev->blksz);
+		zeroes_blks = zeroes ? grp : 0;
+		if (!zeroes)
+			return 0;
+		memset(zeroes, 0, grp * block_dev->blksz);
+	}
+
+	/* the erase groups entirely in the range */
+	div_u64_rem(start, grp, &rem);
+	first = rem ? start + grp - rem : start;
+	div_u64_rem(start + blkcnt, grp, &rem);
+	last = start + blkcnt - rem;
+	if (first >= last)
+		first = last = start + blkcnt;
+
+	for (blk = start; blk < start + blkcnt; blk += n) {
+		if (blk == first && first < last) {
+			n = last - first;
+			if (blk_derase(block_dev, blk, n) != n)
+				return 0;
+			continue;
+		}
+		n = min(first > blk ? first : start + blkcnt, blk + grp) - blk;
+		if (blk_dwrite(block_dev, blk, n, zeroes) != n)
+			return 0;
+	}
+
 	return blkcnt;
 }
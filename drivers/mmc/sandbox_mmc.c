@@ -9,16 +9,166 @@
 #include <dm.h>
 #include <errno.h>
 #include <fdtdec.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <asm/test.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Size of the emulated eMMC, in 512-byte blocks */
+#define SANDBOX_EMMC_BLOCKS		2048
+#define SANDBOX_EMMC_MAX_PACKED_WRITES	8
+
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
 	struct mmc mmc;
 };
 
+/**
+ * struct sandbox_mmc_priv - State of the emulated card
+ *
+ * @emmc:	Emulate an eMMC 5.0 device instead of an SD card
+ * @ext_csd:	EXT_CSD register of the eMMC
+ * @data:	Contents of the eMMC
+ * @block_count: Number of blocks of the next transfer set with CMD23, or 0
+ * @packed:	The next transfer is a packed write
+ * @cmd_count:	Number of times each command was received
+ * @packed_count: Number of packed writes carried out
+ */
+struct sandbox_mmc_priv {
+	bool emmc;
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];
+	u8 *data;
+	u32 block_count;
+	bool packed;
+	int cmd_count[64];
+	int packed_count;
+};
+
+static int sandbox_emmc_packed_write(struct sandbox_mmc_priv *priv,
+				     struct mmc_data *data)
+{
+	const __le32 *hdr = (const __le32 *)data->src;
+	const char *src = data->src + MMC_MAX_BLOCK_LEN;
+	u32 start, blkcnt, total = 0;
+	int count, i;
+
+	if ((le32_to_cpu(hdr[0]) & 0xffff) !=
+	    (MMC_PACKED_CMD_WR << 8 | MMC_PACKED_CMD_VER))
+		return -EIO;
+	count = (le32_to_cpu(hdr[0]) >> 16) & 0xff;
+	if (!count || count > SANDBOX_EMMC_MAX_PACKED_WRITES)
+		return -EIO;
+
+	for (i = 1; i <= count; i++) {
+		blkcnt = le32_to_cpu(hdr[i * 2]) & MMC_CMD23_MAX_BLOCKS;
+		start = le32_to_cpu(hdr[i * 2 + 1]);
+		total += blkcnt;
+		if (total > data->blocks - 1 ||
+		    start + blkcnt > SANDBOX_EMMC_BLOCKS)
+			return -EIO;
+		memcpy(priv->data + start * MMC_MAX_BLOCK_LEN, src,
+		       blkcnt * MMC_MAX_BLOCK_LEN);
+		src += blkcnt * MMC_MAX_BLOCK_LEN;
+	}
+	if (total != data->blocks - 1)
+		return -EIO;
+	priv->packed_count++;
+
+	return 0;
+}
+
+static int sandbox_emmc_xfer(struct sandbox_mmc_priv *priv,
+			     struct mmc_cmd *cmd, struct mmc_data *data)
+{
+	u32 count = priv->block_count;
+	bool packed = priv->packed;
+	u8 *ptr = priv->data + cmd->cmdarg * MMC_MAX_BLOCK_LEN;
+	ulong len = data->blocks * MMC_MAX_BLOCK_LEN;
+
+	/* CMD23 only applies to the command which follows it */
+	priv->block_count = 0;
+	priv->packed = false;
+
+	if (data->blocksize != MMC_MAX_BLOCK_LEN ||
+	    (count && data->blocks != count))
+		return -EIO;
+	if (packed)
+		return data->flags & MMC_DATA_WRITE ?
+			sandbox_emmc_packed_write(priv, data) : -EIO;
+	if (cmd->cmdarg + data->blocks > SANDBOX_EMMC_BLOCKS)
+		return -EIO;
+
+	if (data->flags & MMC_DATA_READ)
+		memcpy(data->dest, ptr, len);
+	else
+		memcpy(ptr, data->src, len);
+
+	return 0;
+}
+
+/**
+ * sandbox_emmc_send_cmd() - Emulate eMMC commands
+ *
+ * This emulates a sector-addressed eMMC 5.0 device with a RAM backing store,
+ * supporting CMD23 and packed writes.
+ */
+static int sandbox_emmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
+				 struct mmc_data *data)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u32 arg = cmd->cmdarg;
+
+	switch (cmd->cmdidx) {
+	case MMC_CMD_GO_IDLE_STATE:
+	case MMC_CMD_ALL_SEND_CID:
+	case MMC_CMD_SET_RELATIVE_ADDR:
+	case MMC_CMD_SELECT_CARD:
+	case MMC_CMD_SET_BLOCKLEN:
+	case MMC_CMD_STOP_TRANSMISSION:
+		break;
+	case MMC_CMD_APP_CMD:
+		/* not an SD card */
+		return -ETIMEDOUT;
+	case MMC_CMD_SEND_OP_COND:
+		cmd->response[0] = OCR_BUSY | OCR_HCS | MMC_VDD_165_195 |
+				   MMC_VDD_32_33 | MMC_VDD_33_34;
+		break;
+	case MMC_CMD_SEND_CSD:
+		cmd->response[0] = 4 << 26 | 0x32;	/* v4, 25MHz */
+		cmd->response[1] = 9 << 16;		/* 1 << read_bl_len */
+		cmd->response[2] = (SANDBOX_EMMC_BLOCKS / 1024 - 1) << 16;
+		cmd->response[3] = 9 << 22;		/* 1 << write_bl_len */
+		break;
+	case MMC_CMD_SEND_EXT_CSD:
+		if (!data)
+			return -ETIMEDOUT;	/* SD_CMD_SEND_IF_COND */
+		memcpy(data->dest, priv->ext_csd, MMC_MAX_BLOCK_LEN);
+		break;
+	case MMC_CMD_SWITCH:
+		if (arg >> 24 == MMC_SWITCH_MODE_WRITE_BYTE)
+			priv->ext_csd[(arg >> 16) & 0xff] = (arg >> 8) & 0xff;
+		break;
+	case MMC_CMD_SEND_STATUS:
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		break;
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->block_count = arg & MMC_CMD23_MAX_BLOCKS;
+		priv->packed = arg & MMC_CMD23_ARG_PACKED;
+		break;
+	case MMC_CMD_READ_SINGLE_BLOCK:
+	case MMC_CMD_READ_MULTIPLE_BLOCK:
+	case MMC_CMD_WRITE_SINGLE_BLOCK:
+	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		return sandbox_emmc_xfer(priv, cmd, data);
+	default:
+		debug("%s: Unknown command %d\n", __func__, cmd->cmdidx);
+		break;
+	}
+
+	return 0;
+}
+
 /**
  * sandbox_mmc_send_cmd() - Emulate SD commands
  *
@@ -28,6 +178,12 @@ struct sandbox_mmc_plat {
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->cmd_count[cmd->cmdidx & 63]++;
+	if (priv->emmc)
+		return sandbox_emmc_send_cmd(dev, cmd, data);
+
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		break;
@@ -48,8 +204,14 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[1] = 10 << 16;	/* 1 << block_len */
 		break;
 	case SD_CMD_SWITCH_FUNC: {
-		u32 *resp = (u32 *)data->dest;
+		u32 *resp;
 
+		/* ACMD6 (set bus width) shares the command index */
+		if (!data)
+			break;
+		resp = (u32 *)data->dest;
+		/* report the access mode of group 1 as switched */
+		resp[4] = cpu_to_be32((cmd->cmdarg & 0xf) << 24);
 		resp[7] = cpu_to_be32(SD_HIGHSPEED_BUSY);
 		break;
 	}
@@ -101,13 +263,63 @@ static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.get_cd = sandbox_mmc_get_cd,
 };
 
+int sandbox_mmc_get_cmd_count(struct udevice *dev, int cmdidx)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return priv->cmd_count[cmdidx & 63];
+}
+
+int sandbox_mmc_get_packed_count(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return priv->packed_count;
+}
+
+void sandbox_mmc_reset_counts(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	memset(priv->cmd_count, '\0', sizeof(priv->cmd_count));
+	priv->packed_count = 0;
+}
+
 int sandbox_mmc_probe(struct udevice *dev)
 {
 	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u8 *ext_csd = priv->ext_csd;
+
+	priv->emmc = dev_get_driver_data(dev);
+	if (priv->emmc) {
+		priv->data = calloc(SANDBOX_EMMC_BLOCKS, MMC_MAX_BLOCK_LEN);
+		if (!priv->data)
+			return -ENOMEM;
+		ext_csd[EXT_CSD_REV] = 7;
+		ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+					     EXT_CSD_CARD_TYPE_52;
+		ext_csd[EXT_CSD_SEC_CNT] = SANDBOX_EMMC_BLOCKS & 0xff;
+		ext_csd[EXT_CSD_SEC_CNT + 1] = SANDBOX_EMMC_BLOCKS >> 8;
+		ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+		ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;
+		ext_csd[EXT_CSD_MAX_PACKED_WRITES] =
+			SANDBOX_EMMC_MAX_PACKED_WRITES;
+	}
 
 	return mmc_init(&plat->mmc);
 }
 
+int sandbox_mmc_remove(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	free(priv->data);
+	priv->data = NULL;
+
+	return 0;
+}
+
 int sandbox_mmc_bind(struct udevice *dev)
 {
 	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
@@ -119,6 +331,8 @@ int sandbox_mmc_bind(struct udevice *dev)
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
 	cfg->b_max = U32_MAX;
+	if (dev_get_driver_data(dev))
+		cfg->host_caps |= MMC_MODE_CMD23;
 
 	return mmc_bind(dev, &plat->mmc, cfg);
 }
@@ -132,6 +346,7 @@ int sandbox_mmc_unbind(struct udevice *dev)
 
 static const struct udevice_id sandbox_mmc_ids[] = {
 	{ .compatible = "sandbox,mmc" },
+	{ .compatible = "sandbox,emmc", .data = true },
 	{ }
 };
 
@@ -143,5 +358,7 @@ U_BOOT_DRIVER(mmc_sandbox) = {
 	.bind		= sandbox_mmc_bind,
 	.unbind		= sandbox_mmc_unbind,
 	.probe		= sandbox_mmc_probe,
+	.remove		= sandbox_mmc_remove,
+	.priv_auto_alloc_size = sizeof(struct sandbox_mmc_priv),
 	.platdata_auto_alloc_size = sizeof(struct sandbox_mmc_plat),
 };
@@ -28,7 +28,9 @@
 #include <asm/arch/sys_proto.h>
 #include <asm/imx-common/dma.h>
 
-#define	MXS_NAND_DMA_DESCRIPTOR_COUNT		4
+/* Four descriptors per page of a read chain, plus the final one */
+#define	MXS_NAND_DMA_DESCRIPTOR_COUNT	\
+	(4 * CONFIG_MXS_NAND_READ_CHAIN_PAGES + 1)
 
 #define	MXS_NAND_CHUNK_DATA_CHUNK_SIZE		512
 #if (defined(CONFIG_MX6) || defined(CONFIG_MX7) || defined(CONFIG_IMX8) || defined(CONFIG_IMX8M))
@@ -61,6 +63,10 @@ struct mxs_nand_info {
 	uint8_t		*cmd_buf;
 	uint8_t		*data_buf;
 	uint8_t		*oob_buf;
+	uint8_t		*aux_buf;	/* auxiliary data of a read chain */
+
+	/* BCH handle of the last page of a read chain */
+	uint16_t	bch_handle;
 
 	uint8_t		marking_block_bad;
 	uint8_t		raw_oob_mode;
@@ -72,6 +78,8 @@ struct mxs_nand_info {
 				loff_t to, struct mtd_oob_ops *ops);
 	int		(*hooked_block_markbad)(struct mtd_info *mtd,
 				loff_t ofs);
+	int		(*hooked_read)(struct mtd_info *mtd, loff_t from,
+				size_t len, size_t *retlen, u_char *buf);
 
 	/* DMA descriptors */
 	struct mxs_dma_desc	**desc;
@@ -106,10 +114,18 @@ static void mxs_nand_flush_cmd_buf(struct mxs_nand_info *info)
 
 	flush_dcache_range(addr, addr + MXS_NAND_COMMAND_BUFFER_SIZE);
 }
+
+static void mxs_nand_inval_buf(void *buf, uint32_t len)
+{
+	uint32_t addr = (uintptr_t)buf;
+
+	invalidate_dcache_range(addr, addr + roundup(len, MXS_DMA_ALIGNMENT));
+}
 #else
 static inline void mxs_nand_flush_data_buf(struct mxs_nand_info *info) {}
 static inline void mxs_nand_inval_data_buf(struct mxs_nand_info *info) {}
 static inline void mxs_nand_flush_cmd_buf(struct mxs_nand_info *info) {}
+static inline void mxs_nand_inval_buf(void *buf, uint32_t len) {}
 #endif
 
 static struct mxs_dma_desc *mxs_nand_get_dma_desc(struct mxs_nand_info *info)
@@ -347,6 +363,32 @@ static int mxs_nand_wait_for_bch_complete(void)
 	return ret;
 }
 
+/*
+ * Wait for the BCH to complete the page tagged with handle and clear the IRQ
+ *
+ * The pages of a read chain complete one after another, so the complete IRQ
+ * alone does not tell that the last one is done.
+ */
+static int mxs_nand_wait_for_bch_handle(uint16_t handle)
+{
+	struct mxs_bch_regs *bch_regs = (struct mxs_bch_regs *)MXS_BCH_BASE;
+	int timeout = MXS_NAND_BCH_TIMEOUT;
+	uint32_t tmp;
+
+	while (timeout--) {
+		tmp = readl(&bch_regs->hw_bch_status0);
+		tmp = (tmp & BCH_STATUS0_HANDLE_MASK) >>
+			BCH_STATUS0_HANDLE_OFFSET;
+		if (tmp == handle)
+			break;
+		udelay(1);
+	}
+
+	writel(BCH_CTRL_COMPLETE_IRQ, &bch_regs->hw_bch_ctrl_clr);
+
+	return timeout < 0 ? -ETIMEDOUT : 0;
+}
+
 /*
  * This is the function that we install in the cmd_ctrl function pointer of the
  * owning struct nand_chip. The only functions in the reference implementation
@@ -698,10 +740,15 @@ static int mxs_nand_ecc_read_page(struct mtd_info *mtd, struct nand_chip *nand,
 	struct mxs_bch_regs *bch_regs = (struct mxs_bch_regs *)MXS_BCH_BASE;
 	uint32_t channel = MXS_DMA_CHANNEL_AHB_APBH_GPMI0 + nand_info->cur_chip;
 	uint32_t corrected = 0, failed = 0;
+	uint8_t	*data_buf = nand_info->data_buf;
 	uint8_t	*status;
 	int i, ret;
 	int flag = 0;
 
+	/* Decode straight into the caller's buffer if the DMA can use it */
+	if (IS_ALIGNED((uintptr_t)buf, MXS_DMA_ALIGNMENT))
+		data_buf = buf;
+
 	/* Compile the DMA descriptor - wait for ready. */
 	d = mxs_nand_get_dma_desc(nand_info);
 	d->cmd.data =
@@ -739,7 +786,7 @@ static int mxs_nand_ecc_read_page(struct mtd_info *mtd, struct nand_chip *nand,
 		GPMI_ECCCTRL_ECC_CMD_DECODE |
 		GPMI_ECCCTRL_BUFFER_MASK_BCH_PAGE;
 	d->cmd.pio_words[3] = mtd->writesize + mtd->oobsize;
-	d->cmd.pio_words[4] = (dma_addr_t)nand_info->data_buf;
+	d->cmd.pio_words[4] = (dma_addr_t)data_buf;
 	d->cmd.pio_words[5] = (dma_addr_t)nand_info->oob_buf;
 
 	mxs_dma_desc_append(channel, d);
@@ -775,7 +822,8 @@ static int mxs_nand_ecc_read_page(struct mtd_info *mtd, struct nand_chip *nand,
 	mxs_dma_desc_append(channel, d);
 
 	/* Invalidate caches */
-	mxs_nand_inval_data_buf(nand_info);
+	mxs_nand_inval_buf(data_buf, mtd->writesize);
+	mxs_nand_inval_buf(nand_info->oob_buf, mtd->oobsize);
 
 	/* Execute the DMA chain. */
 	ret = mxs_dma_go(channel);
@@ -793,10 +841,11 @@ static int mxs_nand_ecc_read_page(struct mtd_info *mtd, struct nand_chip *nand,
 	mxs_nand_return_dma_descs(nand_info);
 
 	/* Invalidate caches */
-	mxs_nand_inval_data_buf(nand_info);
+	mxs_nand_inval_buf(data_buf, mtd->writesize);
+	mxs_nand_inval_buf(nand_info->oob_buf, mtd->oobsize);
 
 	/* Read DMA completed, now do the mark swapping. */
-	mxs_nand_swap_block_mark(mtd, nand_info->data_buf, nand_info->oob_buf);
+	mxs_nand_swap_block_mark(mtd, data_buf, nand_info->oob_buf);
 
 	/* Loop over status bytes, accumulating ECC status. */
 	status = nand_info->oob_buf + mxs_nand_aux_status_offset();
@@ -813,8 +862,7 @@ static int mxs_nand_ecc_read_page(struct mtd_info *mtd, struct nand_chip *nand,
 		}
 
 		if (status[i] == 0xfe) {
-			if (mxs_nand_erased_page(mtd, nand,
-						 nand_info->data_buf, i, page))
+			if (mxs_nand_erased_page(mtd, nand, data_buf, i, page))
 				break;
 			failed++;
 			continue;
@@ -840,7 +888,8 @@ static int mxs_nand_ecc_read_page(struct mtd_info *mtd, struct nand_chip *nand,
 
 	nand->oob_poi[0] = nand_info->oob_buf[0];
 
-	memcpy(buf, nand_info->data_buf, mtd->writesize);
+	if (data_buf != buf)
+		memcpy(buf, data_buf, mtd->writesize);
 
 	if (flag)
 		memset(buf, 0xff, mtd->writesize);
@@ -851,6 +900,297 @@ rtn:
 	return ret;
 }
 
+/*
+ * Read count sequential pages of one block with a single DMA chain.
+ *
+ * The first page is loaded with READ0 and each page is then moved to the
+ * cache register with READ CACHE SEQUENTIAL (READ CACHE END for the last
+ * one), so that the chip loads the next page while the BCH decodes the
+ * current one straight into buf. Erased pages are filled with 0xff here;
+ * uncorrectable pages are left for the caller to read again one at a time,
+ * with the full handling of mxs_nand_ecc_read_page(), and flagged in *redo.
+ */
+static int mxs_nand_read_chain(struct mtd_info *mtd, int page, int count,
+			       uint8_t *buf, uint32_t *redo)
+{
+	struct nand_chip *nand = mtd_to_nand(mtd);
+	struct mxs_nand_info *nand_info = nand_get_controller_data(nand);
+	uint32_t channel = MXS_DMA_CHANNEL_AHB_APBH_GPMI0 + nand_info->cur_chip;
+	uint32_t aux_size = roundup(mtd->oobsize, MXS_DMA_ALIGNMENT);
+	uint32_t corrected = 0;
+	struct mxs_dma_desc *d;
+	uint8_t *data, *aux, *status;
+	int i, j, erased, ret;
+
+	*redo = 0;
+
+	nand->cmdfunc(mtd, NAND_CMD_READ0, 0, page);
+
+	nand_info->cmd_buf[0] = NAND_CMD_READCACHESEQ;
+	nand_info->cmd_buf[1] = NAND_CMD_READCACHEEND;
+	mxs_nand_flush_cmd_buf(nand_info);
+
+	for (i = 0; i < count; i++) {
+		data = buf + i * mtd->writesize;
+		aux = nand_info->aux_buf + i * aux_size;
+
+		/* Tag the page so that its completion can be told apart */
+		nand_info->bch_handle = nand_info->bch_handle % 0xfff + 1;
+
+		/* Compile the DMA descriptor - move the page to the cache. */
+		d = mxs_nand_get_dma_desc(nand_info);
+		d->cmd.data =
+			MXS_DMA_DESC_COMMAND_DMA_READ | MXS_DMA_DESC_CHAIN |
+			MXS_DMA_DESC_WAIT4END |
+			(3 << MXS_DMA_DESC_PIO_WORDS_OFFSET) |
+			(1 << MXS_DMA_DESC_BYTES_OFFSET);
+
+		d->cmd.address = (dma_addr_t)(nand_info->cmd_buf +
+					      (i == count - 1 ? 1 : 0));
+
+		d->cmd.pio_words[0] =
+			GPMI_CTRL0_COMMAND_MODE_WRITE |
+			GPMI_CTRL0_WORD_LENGTH |
+			(nand_info->cur_chip << GPMI_CTRL0_CS_OFFSET) |
+			GPMI_CTRL0_ADDRESS_NAND_CLE |
+			GPMI_CTRL0_ADDRESS_INCREMENT |
+			1;
+
+		mxs_dma_desc_append(channel, d);
+
+		/* Compile the DMA descriptor - wait for ready. */
+		d = mxs_nand_get_dma_desc(nand_info);
+		d->cmd.data =
+			MXS_DMA_DESC_COMMAND_NO_DMAXFER | MXS_DMA_DESC_CHAIN |
+			MXS_DMA_DESC_NAND_WAIT_4_READY | MXS_DMA_DESC_WAIT4END |
+			(1 << MXS_DMA_DESC_PIO_WORDS_OFFSET);
+
+		d->cmd.address = 0;
+
+		d->cmd.pio_words[0] =
+			GPMI_CTRL0_COMMAND_MODE_WAIT_FOR_READY |
+			GPMI_CTRL0_WORD_LENGTH |
+			(nand_info->cur_chip << GPMI_CTRL0_CS_OFFSET) |
+			GPMI_CTRL0_ADDRESS_NAND_DATA;
+
+		mxs_dma_desc_append(channel, d);
+
+		/* Compile the DMA descriptor - enable the BCH and read. */
+		d = mxs_nand_get_dma_desc(nand_info);
+		d->cmd.data =
+			MXS_DMA_DESC_COMMAND_NO_DMAXFER | MXS_DMA_DESC_CHAIN |
+			MXS_DMA_DESC_WAIT4END |
+			(6 << MXS_DMA_DESC_PIO_WORDS_OFFSET);
+
+		d->cmd.address = 0;
+
+		d->cmd.pio_words[0] =
+			GPMI_CTRL0_COMMAND_MODE_READ |
+			GPMI_CTRL0_WORD_LENGTH |
+			(nand_info->cur_chip << GPMI_CTRL0_CS_OFFSET) |
+			GPMI_CTRL0_ADDRESS_NAND_DATA |
+			(mtd->writesize + mtd->oobsize);
+		d->cmd.pio_words[1] = 0;
+		d->cmd.pio_words[2] =
+			(nand_info->bch_handle << GPMI_ECCCTRL_HANDLE_OFFSET) |
+			GPMI_ECCCTRL_ENABLE_ECC |
+			GPMI_ECCCTRL_ECC_CMD_DECODE |
+			GPMI_ECCCTRL_BUFFER_MASK_BCH_PAGE;
+		d->cmd.pio_words[3] = mtd->writesize + mtd->oobsize;
+		d->cmd.pio_words[4] = (dma_addr_t)data;
+		d->cmd.pio_words[5] = (dma_addr_t)aux;
+
+		mxs_dma_desc_append(channel, d);
+
+		/* Compile the DMA descriptor - disable the BCH block. */
+		d = mxs_nand_get_dma_desc(nand_info);
+		d->cmd.data =
+			MXS_DMA_DESC_COMMAND_NO_DMAXFER | MXS_DMA_DESC_CHAIN |
+			MXS_DMA_DESC_NAND_WAIT_4_READY | MXS_DMA_DESC_WAIT4END |
+			(3 << MXS_DMA_DESC_PIO_WORDS_OFFSET);
+
+		d->cmd.address = 0;
+
+		d->cmd.pio_words[0] =
+			GPMI_CTRL0_COMMAND_MODE_WAIT_FOR_READY |
+			GPMI_CTRL0_WORD_LENGTH |
+			(nand_info->cur_chip << GPMI_CTRL0_CS_OFFSET) |
+			GPMI_CTRL0_ADDRESS_NAND_DATA |
+			(mtd->writesize + mtd->oobsize);
+		d->cmd.pio_words[1] = 0;
+		d->cmd.pio_words[2] = 0;
+
+		mxs_dma_desc_append(channel, d);
+	}
+
+	/* Compile the DMA descriptor - deassert the NAND lock and interrupt. */
+	d = mxs_nand_get_dma_desc(nand_info);
+	d->cmd.data =
+		MXS_DMA_DESC_COMMAND_NO_DMAXFER | MXS_DMA_DESC_IRQ |
+		MXS_DMA_DESC_DEC_SEM;
+
+	d->cmd.address = 0;
+
+	mxs_dma_desc_append(channel, d);
+
+	/* Invalidate caches */
+	mxs_nand_inval_buf(buf, count * mtd->writesize);
+	mxs_nand_inval_buf(nand_info->aux_buf, count * aux_size);
+
+	/* Execute the DMA chain. */
+	ret = mxs_dma_go(channel);
+	if (ret) {
+		printf("MXS NAND: DMA read error\n");
+		goto rtn;
+	}
+
+	ret = mxs_nand_wait_for_bch_handle(nand_info->bch_handle);
+	if (ret) {
+		printf("MXS NAND: BCH read timeout\n");
+		goto rtn;
+	}
+
+	/* Invalidate caches */
+	mxs_nand_inval_buf(buf, count * mtd->writesize);
+	mxs_nand_inval_buf(nand_info->aux_buf, count * aux_size);
+
+	for (i = 0; i < count; i++) {
+		data = buf + i * mtd->writesize;
+		aux = nand_info->aux_buf + i * aux_size;
+
+		mxs_nand_swap_block_mark(mtd, data, aux);
+
+		/*
+		 * Loop over status bytes, accumulating ECC status. The erased
+		 * page check of mxs_nand_ecc_read_page() needs the raw page,
+		 * so uncorrectable pages are read again.
+		 */
+		status = aux + mxs_nand_aux_status_offset();
+		erased = 0;
+		for (j = 0; j < mxs_nand_ecc_chunk_cnt(mtd->writesize); j++) {
+			if (status[j] == 0xfe) {
+				*redo |= 1U << i;
+				break;
+			}
+			if (status[j] == 0xff)
+				erased++;
+			else
+				corrected += status[j];
+		}
+		if (*redo & (1U << i) || !erased ||
+		    !(is_mx6dqp() || is_mx7() ||
+		      is_mx6ul() || is_imx8() || is_imx8m()))
+			continue;
+
+		/*
+		 * These BCHs also report erased chunks that have a few bit
+		 * flips. A page with only erased chunks is blank, clear the
+		 * flips here instead of reading it again; a page with both
+		 * kinds of chunks is left to mxs_nand_ecc_read_page().
+		 */
+		if (erased == mxs_nand_ecc_chunk_cnt(mtd->writesize))
+			memset(data, 0xff, mtd->writesize);
+		else
+			*redo |= 1U << i;
+	}
+
+	/* Propagate ECC status to the owning MTD. */
+	mtd->ecc_stats.corrected += corrected;
+
+rtn:
+	mxs_nand_return_dma_descs(nand_info);
+
+	return ret;
+}
+
+/*
+ * Read data from NAND.
+ *
+ * This function is a veneer that replaces the function originally installed by
+ * the NAND Flash MTD code. Runs of whole pages going to a buffer the DMA can
+ * use are read with mxs_nand_read_chain(), everything else is left to the
+ * original function.
+ */
+static int mxs_nand_hook_read(struct mtd_info *mtd, loff_t from, size_t len,
+			      size_t *retlen, u_char *buf)
+{
+	struct nand_chip *chip = mtd_to_nand(mtd);
+	struct mxs_nand_info *nand_info = nand_get_controller_data(chip);
+	unsigned int failed = mtd->ecc_stats.failed;
+	int ppb = 1 << (chip->phys_erase_shift - chip->page_shift);
+	int realpage, count, i, ret = 0;
+	unsigned int max_bitflips = 0;
+	size_t done = 0, n;
+	uint32_t redo;
+
+	if ((from & (mtd->writesize - 1)) || len < 2 * mtd->writesize ||
+	    !IS_ALIGNED((uintptr_t)buf, MXS_DMA_ALIGNMENT))
+		return nand_info->hooked_read(mtd, from, len, retlen, buf);
+
+	while (len - done >= mtd->writesize) {
+		realpage = (int)((from + done) >> chip->page_shift);
+
+		/* Chains stay within a block */
+		count = min_t(size_t, (len - done) >> chip->page_shift,
+			      ppb - (realpage & (ppb - 1)));
+		count = min(count, CONFIG_MXS_NAND_READ_CHAIN_PAGES);
+		if (count == 1) {
+			ret = nand_info->hooked_read(mtd, from + done,
+						     mtd->writesize, &n,
+						     buf + done);
+			if (ret < 0 && ret != -EBADMSG)
+				goto out;
+			max_bitflips = max_t(unsigned int, max_bitflips,
+					     max(ret, 0));
+			done += mtd->writesize;
+			continue;
+		}
+
+		chip->select_chip(mtd,
+				  (int)((from + done) >> chip->chip_shift));
+		ret = mxs_nand_read_chain(mtd, realpage & chip->pagemask, count,
+					  buf + done, &redo);
+		chip->select_chip(mtd, -1);
+		if (ret)
+			goto out;
+
+		for (i = 0; i < count; i++) {
+			if (!(redo & (1U << i)))
+				continue;
+			ret = nand_info->hooked_read(mtd,
+					from + done + i * mtd->writesize,
+					mtd->writesize, &n,
+					buf + done + i * mtd->writesize);
+			if (ret < 0 && ret != -EBADMSG)
+				goto out;
+			max_bitflips = max_t(unsigned int, max_bitflips,
+					     max(ret, 0));
+		}
+		done += count * mtd->writesize;
+	}
+
+	/* Last partial page */
+	if (done < len) {
+		ret = nand_info->hooked_read(mtd, from + done, len - done, &n,
+					     buf + done);
+		if (ret < 0 && ret != -EBADMSG)
+			goto out;
+		max_bitflips = max_t(unsigned int, max_bitflips, max(ret, 0));
+		done = len;
+	}
+	ret = 0;
+
+out:
+	*retlen = done;
+	if (ret < 0)
+		return ret;
+
+	if (mtd->ecc_stats.failed != failed)
+		return -EBADMSG;
+
+	return max_bitflips;
+}
+
 /*
  * Write a page to NAND.
  */
@@ -1097,6 +1437,20 @@ static int mxs_nand_ecc_write_oob(struct mtd_info *mtd, struct nand_chip *nand,
 	return 0;
 }
 
+/*
+ * Test if the chip has the READ CACHE SEQUENTIAL and READ CACHE END commands.
+ */
+static bool mxs_nand_has_read_cache(struct nand_chip *chip)
+{
+#ifdef CONFIG_SYS_NAND_ONFI_DETECTION
+	return chip->onfi_version &&
+	       (le16_to_cpu(chip->onfi_params.opt_cmd) &
+		ONFI_OPT_CMD_READ_CACHE);
+#else
+	return false;
+#endif
+}
+
 /*
  * At this point, the physical NAND Flash chips have been identified and
  * counted, so we know the physical geometry. This enables us to make some
@@ -1168,6 +1522,14 @@ void nand_postident(struct mtd_info *mtd)
 		mtd->_block_markbad = mxs_nand_hook_block_markbad;
 	}
 
+	/* Chain the reads of sequential pages if the chip has a read cache */
+	if (CONFIG_MXS_NAND_READ_CHAIN_PAGES > 1 &&
+	    mxs_nand_has_read_cache(nand) &&
+	    mtd->_read != mxs_nand_hook_read) {
+		nand_info->hooked_read = mtd->_read;
+		mtd->_read = mxs_nand_hook_read;
+	}
+
 #ifdef CONFIG_SKIP_NAND_BBT_SCAN
 	nand->options |= NAND_SKIP_BBTSCAN;
 #endif
@@ -1211,6 +1573,17 @@ int mxs_nand_alloc_buffers(struct mxs_nand_info *nand_info)
 	memset(nand_info->cmd_buf, 0, MXS_NAND_COMMAND_BUFFER_SIZE);
 	nand_info->cmd_queue_len = 0;
 
+	/* Auxiliary buffers of a read chain */
+	nand_info->aux_buf = memalign(MXS_DMA_ALIGNMENT,
+				CONFIG_MXS_NAND_READ_CHAIN_PAGES *
+				roundup(NAND_MAX_OOBSIZE, MXS_DMA_ALIGNMENT));
+	if (!nand_info->aux_buf) {
+		free(buf);
+		free(nand_info->cmd_buf);
+		printf("MXS NAND: Error allocating auxiliary buffers\n");
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -1345,6 +1718,7 @@ int board_nand_init(struct nand_chip *nand)
 err2:
 	free(nand_info->data_buf);
 	free(nand_info->cmd_buf);
+	free(nand_info->aux_buf);
 err1:
 	free(nand_info);
 	return err;
@@ -829,6 +829,9 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		return 0;
 	}
 
+#ifdef __UBOOT__
+	ubi_io_prefetch_hdrs(ubi, pnum);
+#endif
 	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
 	if (err < 0)
 		return err;
@@ -1239,6 +1242,16 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	if (!vidh)
 		goto out_ech;
 
+#ifdef __UBOOT__
+	/*
+	 * Both headers of a PEB are fetched with one read. Without the
+	 * buffer, they are just read one at a time.
+	 */
+	ubi->hdrs_len = ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize;
+	ubi->hdrs_buf = kmalloc(ubi->hdrs_len, GFP_KERNEL);
+	ubi->hdrs_pnum = -1;
+#endif
+
 	for (pnum = start; pnum < ubi->peb_count; pnum++) {
 		cond_resched();
 
@@ -1248,6 +1261,11 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 			goto out_vidh;
 	}
 
+#ifdef __UBOOT__
+	kfree(ubi->hdrs_buf);
+	ubi->hdrs_buf = NULL;
+#endif
+
 	ubi_msg(ubi, "scanning is finished");
 
 	/* Calculate mean erase counter */
@@ -1291,6 +1309,10 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	return 0;
 
 out_vidh:
+#ifdef __UBOOT__
+	kfree(ubi->hdrs_buf);
+	ubi->hdrs_buf = NULL;
+#endif
 	ubi_free_vid_hdr(ubi, vidh);
 out_ech:
 	kfree(ech);
@@ -1387,6 +1409,17 @@ out:
 
 #endif
 
+#ifdef __UBOOT__
+/* Returns the milliseconds since *start and restarts the count */
+static unsigned long phase_ms(unsigned long *start)
+{
+	unsigned long ms = get_timer(*start);
+
+	*start = get_timer(0);
+	return ms;
+}
+#endif
+
 /**
  * ubi_attach - attach an MTD device.
  * @ubi: UBI device descriptor
@@ -1399,6 +1432,10 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 {
 	int err;
 	struct ubi_attach_info *ai;
+#ifdef __UBOOT__
+	unsigned long start = get_timer(0);
+	const char *mode = "scanning";
+#endif
 
 	ai = alloc_ai();
 	if (!ai)
@@ -1415,8 +1452,14 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 		err = scan_all(ubi, ai, 0);
 	else {
 		err = scan_fast(ubi, &ai);
+#ifdef __UBOOT__
+		mode = "fastmap";
+#endif
 		if (err > 0 || mtd_is_eccerr(err)) {
 			if (err != UBI_NO_FASTMAP) {
+#ifdef __UBOOT__
+				mode = "scanning, the fastmap is not usable";
+#endif
 				destroy_ai(ai);
 				ai = alloc_ai();
 				if (!ai)
@@ -1424,6 +1467,9 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 
 				err = scan_all(ubi, ai, 0);
 			} else {
+#ifdef __UBOOT__
+				mode = "scanning, no fastmap found";
+#endif
 				err = scan_all(ubi, ai, UBI_FM_MAX_START);
 			}
 		}
@@ -1440,18 +1486,31 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	ubi->max_ec = ai->max_ec;
 	ubi->mean_ec = ai->mean_ec;
 	dbg_gen("max. sequence number:       %llu", ai->max_sqnum);
+#ifdef __UBOOT__
+	ubi->attach_mode = mode;
+	ubi->scan_ms = phase_ms(&start);
+#endif
 
 	err = ubi_read_volume_table(ubi, ai);
 	if (err)
 		goto out_ai;
+#ifdef __UBOOT__
+	ubi->vtbl_ms = phase_ms(&start);
+#endif
 
 	err = ubi_wl_init(ubi, ai);
 	if (err)
 		goto out_vtbl;
+#ifdef __UBOOT__
+	ubi->wl_ms = phase_ms(&start);
+#endif
 
 	err = ubi_eba_init(ubi, ai);
 	if (err)
 		goto out_wl;
+#ifdef __UBOOT__
+	ubi->eba_ms = phase_ms(&start);
+#endif
 
 #ifdef CONFIG_MTD_UBI_FASTMAP
 	if (ubi->fm && ubi_dbg_chk_fastmap(ubi)) {
@@ -188,11 +188,24 @@ int ubi_volume_notify(struct ubi_device *ubi, struct ubi_volume *vol, int ntype)
 	ubi_do_get_device_info(ubi, &nt.di);
 	ubi_do_get_volume_info(ubi, vol, &nt.vi);
 
+#if defined(__UBOOT__) && defined(CONFIG_CMD_UBIFS)
+	/* A UBIFS mount of the volume no longer matches its contents */
+	if (ntype != UBI_VOLUME_ADDED)
+		cmd_ubifs_volume_changed(ubi->ubi_num, vol->vol_id);
+#endif
+
 	switch (ntype) {
 	case UBI_VOLUME_ADDED:
 	case UBI_VOLUME_REMOVED:
 	case UBI_VOLUME_RESIZED:
 	case UBI_VOLUME_RENAMED:
+#ifdef __UBOOT__
+	/*
+	 * The device is not detached before booting, so the fastmap is
+	 * written when U-Boot is done updating a volume.
+	 */
+	case UBI_VOLUME_UPDATED:
+#endif
 		ret = ubi_update_fastmap(ubi);
 		if (ret)
 			ubi_msg(ubi, "Unable to write a new fastmap: %i", ret);
@@ -699,6 +699,53 @@ bad:
 	return 1;
 }
 
+#ifdef __UBOOT__
+/**
+ * ubi_io_prefetch_hdrs - read the EC and VID headers of a PEB at once.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock to read from
+ *
+ * This function reads both headers of @pnum with a single MTD read into
+ * @ubi->hdrs_buf, from where the next 'ubi_io_read_ec_hdr()' and
+ * 'ubi_io_read_vid_hdr()' of @pnum take them. Nothing is kept if the read
+ * fails or reports an ECC error, so that the headers are read one at a time
+ * and the error is attributed to the right one.
+ */
+void ubi_io_prefetch_hdrs(struct ubi_device *ubi, int pnum)
+{
+	int err;
+
+	ubi->hdrs_pnum = -1;
+	if (!ubi->hdrs_buf)
+		return;
+
+	err = ubi_io_read(ubi, ubi->hdrs_buf, pnum, 0, ubi->hdrs_len);
+	if (err && err != UBI_IO_BITFLIPS)
+		return;
+
+	ubi->hdrs_err = err;
+	ubi->hdrs_pnum = pnum;
+}
+
+/* Reads header data, from @ubi->hdrs_buf if it holds them */
+static int read_hdr(const struct ubi_device *ubi, void *buf, int pnum,
+		    int offset, int len)
+{
+	if (!ubi->hdrs_buf || pnum != ubi->hdrs_pnum ||
+	    offset + len > ubi->hdrs_len)
+		return ubi_io_read(ubi, buf, pnum, offset, len);
+
+	memcpy(buf, ubi->hdrs_buf + offset, len);
+	return ubi->hdrs_err;
+}
+#else
+static int read_hdr(const struct ubi_device *ubi, void *buf, int pnum,
+		    int offset, int len)
+{
+	return ubi_io_read(ubi, buf, pnum, offset, len);
+}
+#endif
+
 /**
  * ubi_io_read_ec_hdr - read and check an erase counter header.
  * @ubi: UBI device description object
@@ -730,7 +777,7 @@ int ubi_io_read_ec_hdr(struct ubi_device *ubi, int pnum,
 	dbg_io("read EC header from PEB %d", pnum);
 	ubi_assert(pnum >= 0 && pnum < ubi->peb_count);
 
-	read_err = ubi_io_read(ubi, ec_hdr, pnum, 0, UBI_EC_HDR_SIZE);
+	read_err = read_hdr(ubi, ec_hdr, pnum, 0, UBI_EC_HDR_SIZE);
 	if (read_err) {
 		if (read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 			return read_err;
@@ -1005,8 +1052,8 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 	ubi_assert(pnum >= 0 &&  pnum < ubi->peb_count);
 
 	p = (char *)vid_hdr - ubi->vid_hdr_shift;
-	read_err = ubi_io_read(ubi, p, pnum, ubi->vid_hdr_aloffset,
-			  ubi->vid_hdr_alsize);
+	read_err = read_hdr(ubi, p, pnum, ubi->vid_hdr_aloffset,
+			    ubi->vid_hdr_alsize);
 	if (read_err && read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 		return read_err;
 
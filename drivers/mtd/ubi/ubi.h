@@ -300,6 +300,8 @@ struct ubi_fm_pool {
  * @updating: %1 if the volume is being updated
  * @changing_leb: %1 if the atomic LEB change ioctl command is in progress
  * @direct_writes: %1 if direct writes are enabled for this volume
+ * @upd_crc: %1 if the volume update stores the data CRC in the VID headers,
+ *           also for dynamic volumes, and reads the VID headers back
  *
  * The @corrupted field indicates that the volume's contents is corrupted.
  * Since UBI protects only static volumes, this field is not relevant to
@@ -348,6 +350,9 @@ struct ubi_volume {
 	unsigned int updating:1;
 	unsigned int changing_leb:1;
 	unsigned int direct_writes:1;
+#ifdef __UBOOT__
+	unsigned int upd_crc:1;
+#endif
 };
 
 /**
@@ -525,6 +530,17 @@ struct ubi_debug_info {
  * @buf_mutex: protects @peb_buf
  * @ckvol_mutex: serializes static volume checking when opening
  *
+ * @hdrs_buf: buffer for the EC and VID headers of a PEB read at once while
+ *            scanning (%NULL if not scanning)
+ * @hdrs_len: size of @hdrs_buf, up to the end of the VID header
+ * @hdrs_pnum: PEB whose headers @hdrs_buf holds (%-1 if none)
+ * @hdrs_err: return code of the read of @hdrs_buf
+ * @attach_mode: how the device was attached (fastmap or scanning)
+ * @scan_ms: time taken to scan the PEBs when attaching, in milliseconds
+ * @vtbl_ms: time taken to read the volume table when attaching
+ * @wl_ms: time taken to initialize wear-leveling when attaching
+ * @eba_ms: time taken to initialize the EBA tables when attaching
+ *
  * @dbg: debugging information for this UBI device
  */
 struct ubi_device {
@@ -624,6 +640,18 @@ struct ubi_device {
 	struct mutex buf_mutex;
 	struct mutex ckvol_mutex;
 
+#ifdef __UBOOT__
+	void *hdrs_buf;
+	int hdrs_len;
+	int hdrs_pnum;
+	int hdrs_err;
+	const char *attach_mode;
+	unsigned long scan_ms;
+	unsigned long vtbl_ms;
+	unsigned long wl_ms;
+	unsigned long eba_ms;
+#endif
+
 	struct ubi_debug_info dbg;
 };
 
@@ -890,6 +918,9 @@ int ubi_io_write(struct ubi_device *ubi, const void *buf, int pnum, int offset,
 int ubi_io_sync_erase(struct ubi_device *ubi, int pnum, int torture);
 int ubi_io_is_bad(const struct ubi_device *ubi, int pnum);
 int ubi_io_mark_bad(const struct ubi_device *ubi, int pnum);
+#ifdef __UBOOT__
+void ubi_io_prefetch_hdrs(struct ubi_device *ubi, int pnum);
+#endif
 int ubi_io_read_ec_hdr(struct ubi_device *ubi, int pnum,
 		       struct ubi_ec_hdr *ec_hdr, int verbose);
 int ubi_io_write_ec_hdr(struct ubi_device *ubi, int pnum,
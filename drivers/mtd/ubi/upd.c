@@ -126,6 +126,13 @@ int ubi_start_update(struct ubi_device *ubi, struct ubi_volume *vol,
 	dbg_gen("start update of volume %d, %llu bytes", vol->vol_id, bytes);
 	ubi_assert(!vol->updating && !vol->changing_leb);
 	vol->updating = 1;
+#ifdef __UBOOT__
+	vol->upd_crc = 0;
+#ifdef CONFIG_CMD_UBIFS
+	/* The volume is rewritten under a UBIFS mount of it */
+	cmd_ubifs_volume_changed(ubi->ubi_num, vol->vol_id);
+#endif
+#endif
 
 	vol->upd_buf = vmalloc(ubi->leb_size);
 	if (!vol->upd_buf)
@@ -222,6 +229,52 @@ int ubi_start_leb_change(struct ubi_device *ubi, struct ubi_volume *vol,
 	return 0;
 }
 
+#ifdef __UBOOT__
+/**
+ * verify_leb - check a logical eraseblock written by the update.
+ * @ubi: UBI device description object
+ * @vol: volume description object
+ * @lnum: logical eraseblock number
+ * @buf: data written
+ * @len: data size
+ *
+ * The data pages were checked by the program status of the MTD device when
+ * they were written, UBI moving the data to another PEB if that failed. This
+ * function reads the VID header of logical eraseblock @lnum back, which the
+ * ECC and the header CRC check, and makes sure it records the size and CRC
+ * of the data in @buf. The data itself is not read back. Returns zero in
+ * case of success and a negative error code in case of failure.
+ */
+static int verify_leb(struct ubi_device *ubi, struct ubi_volume *vol,
+		      int lnum, const void *buf, int len)
+{
+	struct ubi_vid_hdr *vid_hdr;
+	int err, pnum = vol->eba_tbl[lnum];
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 1);
+	if (err && err != UBI_IO_BITFLIPS) {
+		ubi_err(ubi, "cannot read back the VID header of LEB %d:%d, PEB %d",
+			vol->vol_id, lnum, pnum);
+		err = err < 0 ? err : -EIO;
+	} else if (be32_to_cpu(vid_hdr->data_size) != len ||
+		   be32_to_cpu(vid_hdr->data_crc) !=
+		   crc32(UBI_CRC32_INIT, buf, len)) {
+		ubi_err(ubi, "VID header of LEB %d:%d, PEB %d does not match the data written",
+			vol->vol_id, lnum, pnum);
+		err = -EBADMSG;
+	} else {
+		err = 0;
+	}
+	ubi_free_vid_hdr(ubi, vid_hdr);
+
+	return err;
+}
+#endif
+
 /**
  * write_leb - write update data.
  * @ubi: UBI device description object
@@ -266,6 +319,17 @@ static int write_leb(struct ubi_device *ubi, struct ubi_volume *vol, int lnum,
 			return 0;
 		}
 
+#ifdef __UBOOT__
+		/*
+		 * Written as an atomic LEB change, which stores the length and
+		 * CRC of the data in the VID header, so that the data can be
+		 * verified against it instead of against the data written.
+		 */
+		if (vol->upd_crc)
+			err = ubi_eba_atomic_leb_change(ubi, vol, lnum, buf,
+							len);
+		else
+#endif
 		err = ubi_eba_write_leb(ubi, vol, lnum, buf, 0, len);
 	} else {
 		/*
@@ -281,6 +345,11 @@ static int write_leb(struct ubi_device *ubi, struct ubi_volume *vol, int lnum,
 		err = ubi_eba_write_leb_st(ubi, vol, lnum, buf, len, used_ebs);
 	}
 
+#ifdef __UBOOT__
+	if (!err && vol->upd_crc)
+		err = verify_leb(ubi, vol, lnum, buf, len);
+#endif
+
 	return err;
 }
 
@@ -368,6 +437,24 @@ int ubi_more_update_data(struct ubi_device *ubi, struct ubi_volume *vol,
 		else
 			len = count;
 
+#ifdef __UBOOT__
+		/*
+		 * Whole eraseblocks are written straight from the buffer, as
+		 * write_leb() does not pad them.
+		 */
+		if (len == vol->usable_leb_size) {
+			err = write_leb(ubi, vol, lnum, (void *)buf, len,
+					vol->upd_ebs);
+			if (err)
+				break;
+
+			vol->upd_received += len;
+			count -= len;
+			lnum += 1;
+			buf += len;
+			continue;
+		}
+#endif
 		err = copy_from_user(vol->upd_buf, buf, len);
 		if (err)
 			return -EFAULT;
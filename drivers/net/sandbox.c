@@ -11,10 +11,14 @@
 #include <dm.h>
 #include <malloc.h>
 #include <net.h>
+#include <asm/eth.h>
 #include <asm/test.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Packets that a tx handler can queue to be received */
+#define SB_ETH_RX_QUEUE		32
+
 /**
  * struct eth_sandbox_priv - memory for sandbox mock driver
  *
@@ -22,16 +26,23 @@ DECLARE_GLOBAL_DATA_PTR;
  * fake_host_ipaddr: IP address of mocked machine
  * recv_packet_buffer: buffer of the packet returned as received
  * recv_packet_length: length of the packet returned as received
+ * rx_queue: packets queued by sandbox_eth_recv_packet(), received in order
+ *	     after the mock response
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
 	struct in_addr fake_host_ipaddr;
 	uchar *recv_packet_buffer;
 	int recv_packet_length;
+	uchar rx_queue[SB_ETH_RX_QUEUE][PKTSIZE_ALIGN];
+	int rx_queue_length[SB_ETH_RX_QUEUE];
+	int rx_queue_head;
+	int rx_queue_count;
 };
 
 static bool disabled[8] = {false};
 static bool skip_timeout;
+static sandbox_eth_tx_hand_f *tx_handler[8];
 
 /*
  * sandbox_eth_disable_response()
@@ -54,6 +65,41 @@ void sandbox_eth_skip_timeout(void)
 	skip_timeout = true;
 }
 
+/*
+ * sandbox_eth_set_tx_handler()
+ *
+ * index - The alias index (also DM seq number)
+ * handler - Called for every packet sent before the mock responses, NULL to
+ *	     remove it
+ */
+void sandbox_eth_set_tx_handler(int index, sandbox_eth_tx_hand_f *handler)
+{
+	tx_handler[index] = handler;
+}
+
+/*
+ * sandbox_eth_recv_packet()
+ *
+ * Queue a packet to be received by the device, from a tx handler
+ */
+int sandbox_eth_recv_packet(struct udevice *dev, const void *packet,
+			    unsigned int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int tail;
+
+	if (priv->rx_queue_count == SB_ETH_RX_QUEUE ||
+	    length > PKTSIZE_ALIGN)
+		return -ENOSPC;
+
+	tail = (priv->rx_queue_head + priv->rx_queue_count) % SB_ETH_RX_QUEUE;
+	memcpy(priv->rx_queue[tail], packet, length);
+	priv->rx_queue_length[tail] = length;
+	priv->rx_queue_count++;
+
+	return 0;
+}
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -78,6 +124,10 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	    disabled[dev->seq])
 		return 0;
 
+	if (dev->seq >= 0 && dev->seq < ARRAY_SIZE(tx_handler) &&
+	    tx_handler[dev->seq] && tx_handler[dev->seq](dev, packet, length))
+		return 0;
+
 	if (ntohs(eth->et_protlen) == PROT_ARP) {
 		struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
 
@@ -171,12 +221,28 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 		*packetp = priv->recv_packet_buffer;
 		return lcl_recv_packet_length;
 	}
+
+	if (priv->rx_queue_count) {
+		int head = priv->rx_queue_head;
+		int length = priv->rx_queue_length[head];
+
+		/* copy out, handling it may queue more packets */
+		memcpy(priv->recv_packet_buffer, priv->rx_queue[head], length);
+		priv->rx_queue_head = (head + 1) % SB_ETH_RX_QUEUE;
+		priv->rx_queue_count--;
+		*packetp = priv->recv_packet_buffer;
+		return length;
+	}
 	return 0;
 }
 
 static void sb_eth_stop(struct udevice *dev)
 {
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
 	debug("eth_sandbox: Stop\n");
+
+	priv->rx_queue_count = 0;
 }
 
 static int sb_eth_write_hwaddr(struct udevice *dev)
@@ -525,6 +525,37 @@ static void ci_ep_submit_next_request(struct ci_ep *ci_ep)
 	writel(bit, &udc->epprime);
 }
 
+/*
+ * Take the request at the head of the queue back from the controller: flush
+ * the endpoint and free the extra dTDs of the request.
+ */
+static void ci_ep_unprime(struct ci_ep *ci_ep, struct ci_req *ci_req)
+{
+	struct ci_udc *udc = (struct ci_udc *)controller.ctrl->hcor;
+	struct ept_queue_item *item, *next_td;
+	int bit, num, in, j;
+
+	num = ci_ep->desc->bEndpointAddress & USB_ENDPOINT_NUMBER_MASK;
+	in = (ci_ep->desc->bEndpointAddress & USB_DIR_IN) != 0;
+	bit = in ? EPT_TX(num) : EPT_RX(num);
+
+	writel(bit, &udc->epflush);
+	while (readl(&udc->epflush) & bit)
+		;
+
+	next_td = ci_get_qtd(num, in);
+	for (j = 0; j < ci_req->dtd_count; j++) {
+		item = next_td;
+		if (j != ci_req->dtd_count - 1)
+			next_td = (struct ept_queue_item *)(unsigned long)
+				item->next;
+		if (j != 0)
+			free(item);
+	}
+
+	ci_ep->req_primed = false;
+}
+
 static int ci_ep_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 {
 	struct ci_ep *ci_ep = container_of(_ep, struct ci_ep, ep);
@@ -538,7 +569,20 @@ static int ci_ep_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 	if (&ci_req->req != _req)
 		return -EINVAL;
 
-	list_del_init(&ci_req->queue);
+	/*
+	 * The request at the head of the queue is primed. Take it back from
+	 * the controller, or the requests queued after it would wait for it
+	 * to complete.
+	 */
+	if (ci_ep->req_primed &&
+	    ci_req == list_first_entry(&ci_ep->queue, struct ci_req, queue)) {
+		ci_ep_unprime(ci_ep, ci_req);
+		list_del_init(&ci_req->queue);
+		if (!list_empty(&ci_ep->queue))
+			ci_ep_submit_next_request(ci_ep);
+	} else {
+		list_del_init(&ci_req->queue);
+	}
 
 	if (ci_req->req.status == -EINPROGRESS) {
 		ci_req->req.status = -ECONNRESET;
@@ -89,6 +89,15 @@ extern void trusty_os_init(void);
 
 #define EP_BUFFER_SIZE			4096
 
+/*
+ * The data of a download is received straight into the fastboot buffer,
+ * through FB_DL_REQS requests of up to FB_DL_REQ_SIZE bytes that are all
+ * queued at once, so that the controller always has one to fill. The size
+ * must keep the requests cache line and maxpacket aligned.
+ */
+#define FB_DL_REQS			4
+#define FB_DL_REQ_SIZE			0x20000
+
 #ifdef CONFIG_FLASH_MCUFIRMWARE_SUPPORT
 struct fastboot_device_info fastboot_firmwareinfo;
 #endif
@@ -104,6 +113,8 @@ struct fastboot_device_info fastboot_firmwareinfo;
  */
 static unsigned int download_size;
 static unsigned int download_bytes;
+static unsigned char *download_base;
+static unsigned int download_queued;	/* bytes handed to requests */
 
 /* common variables of fastboot getvar command */
 char *fastboot_common_var[FASTBOOT_COMMON_VAR_NUM] = {
@@ -146,6 +157,7 @@ struct f_fastboot {
 	/* IN/OUT EP's and corresponding requests */
 	struct usb_ep *in_ep, *out_ep;
 	struct usb_request *in_req, *out_req;
+	struct usb_request *dl_req[FB_DL_REQS];
 	usb_req *front, *rear;
 };
 
@@ -826,6 +838,12 @@ static lbaint_t mmc_sparse_reserve(struct sparse_storage *info,
 	return blkcnt;
 }
 
+static lbaint_t mmc_sparse_erase(struct sparse_storage *info,
+		lbaint_t blk, lbaint_t blkcnt)
+{
+	return mmc_erase_zeroes(info->priv, blk, blkcnt);
+}
+
 /*judge wether the gpt image and bootloader image are overlay*/
 bool bootloader_gpt_overlay(void)
 {
@@ -976,6 +994,7 @@ static void process_flash_mmc(const char *cmdbuf)
 				sparse.size = info.size;
 				sparse.write = mmc_sparse_write;
 				sparse.reserve = mmc_sparse_reserve;
+				sparse.erase = mmc_sparse_erase;
 				printf("Flashing sparse image at offset " LBAFU "\n",
 				       sparse.start);
 
@@ -2346,6 +2365,430 @@ void fastboot_okay(const char *reason)
 	strncat(fb_response_str, reason, FASTBOOT_RESPONSE_LEN - 4 - 1);
 }
 
+#if defined(CONFIG_FSL_FASTBOOT) && defined(CONFIG_FASTBOOT_STORAGE_MMC)
+/*
+ * Streaming flash: once armed with "oem stream:<partition>", the next
+ * download is written to the partition while it is received, so that an
+ * image larger than the fastboot buffer goes in a single transfer. The
+ * download requests then cycle over the first FB_DL_REQS slices of the
+ * buffer, each slice being parsed and written before it is queued again.
+ * Android sparse images are parsed a chunk at a time, other images are
+ * written as they come. The "flash" command that follows reports the
+ * result.
+ */
+#define FASTBOOT_STREAM
+#define FB_STREAM_MAX_SIZE		0xfffff000
+#define FB_STREAM_STAGE_SIZE		64
+
+enum fb_stream_state {
+	FB_STREAM_IDLE,
+	FB_STREAM_ARMED,	/* the next download goes to the partition */
+	FB_STREAM_DONE,		/* waiting for the flash command */
+};
+
+enum fb_stream_step {
+	FB_STREAM_FILE_HDR,	/* collecting the sparse image header */
+	FB_STREAM_SKIP,		/* skipping the rest of a longer header */
+	FB_STREAM_CHUNK_HDR,	/* collecting a chunk header */
+	FB_STREAM_CHUNK_DATA,	/* collecting the data of a FILL/CRC chunk */
+	FB_STREAM_RAW,		/* writing the data of a RAW chunk */
+	FB_STREAM_IMAGE,	/* writing a non sparse image */
+	FB_STREAM_END,		/* all the chunks written */
+	FB_STREAM_ERROR,
+};
+
+static struct {
+	enum fb_stream_state state;
+	char part[32];
+	struct sparse_storage sparse;
+	char response[FASTBOOT_RESPONSE_LEN];
+
+	/* state of the download being streamed */
+	enum fb_stream_step step;
+	enum fb_stream_step next;	/* step after FB_STREAM_SKIP */
+	sparse_header_t hdr;
+	u8 stage[FB_STREAM_STAGE_SIZE];	/* headers and FILL/CRC data */
+	unsigned int have, need;	/* bytes in stage, bytes to collect */
+	unsigned int chunk;
+	u64 raw_left;			/* data left in the RAW chunk */
+	u8 *partial;			/* block split across two transfers */
+	unsigned int partial_len;
+	lbaint_t blk;
+	u32 total_blocks;
+	u32 bytes_written;
+} fb_stream;
+
+static bool fastboot_stream_armed(void)
+{
+	return fb_stream.state == FB_STREAM_ARMED;
+}
+
+static void fastboot_stream_arm(const char *name)
+{
+	struct fastboot_ptentry *ptn;
+	struct blk_desc *dev_desc;
+	disk_partition_t info;
+	struct mmc *mmc;
+
+	fb_stream.state = FB_STREAM_IDLE;
+	if (!*name) {
+		fastboot_okay("");
+		return;
+	}
+
+	ptn = fastboot_flash_find_ptn(name);
+	if (!ptn) {
+		fastboot_fail("partition does not exist");
+		return;
+	}
+	if (is_raw_partition(ptn) ||
+	    (ptn->flags & FASTBOOT_PTENTRY_FLAGS_WRITE_ENV)) {
+		fastboot_fail("partition cannot be streamed");
+		return;
+	}
+
+	mmc = find_mmc_device(fastboot_devinfo.dev_id);
+	if (mmc && mmc_init(mmc))
+		printf("MMC card init failed!\n");
+
+	dev_desc = blk_get_dev("mmc", fastboot_devinfo.dev_id);
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		fastboot_fail("flash device not supported");
+		return;
+	}
+	if (part_get_info(dev_desc, ptn->partition_index, &info)) {
+		fastboot_fail("bad partition index");
+		return;
+	}
+
+	strlcpy(fb_stream.part, ptn->name, sizeof(fb_stream.part));
+	fb_stream.sparse.blksz = info.blksz;
+	fb_stream.sparse.start = info.start;
+	fb_stream.sparse.size = info.size;
+	fb_stream.sparse.write = mmc_sparse_write;
+	fb_stream.sparse.reserve = mmc_sparse_reserve;
+	fb_stream.sparse.erase = mmc_sparse_erase;
+	fb_stream.sparse.priv = dev_desc;
+	fb_stream.state = FB_STREAM_ARMED;
+
+	printf("Next download is streamed to partition '%s'\n", ptn->name);
+	fastboot_okay("");
+}
+
+/* Prepares the parser for a download, returns 0 on success */
+static int fastboot_stream_start(void)
+{
+	fb_stream.step = FB_STREAM_FILE_HDR;
+	fb_stream.have = 0;
+	fb_stream.need = sizeof(sparse_header_t);
+	fb_stream.chunk = 0;
+	fb_stream.partial_len = 0;
+	fb_stream.blk = fb_stream.sparse.start;
+	fb_stream.total_blocks = 0;
+	fb_stream.bytes_written = 0;
+	fb_stream.response[0] = '\0';
+
+	fb_stream.partial = memalign(ARCH_DMA_MINALIGN, fb_stream.sparse.blksz);
+	if (!fb_stream.partial) {
+		fb_stream.state = FB_STREAM_IDLE;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int fastboot_stream_write_blks(const void *data, lbaint_t blkcnt)
+{
+	struct sparse_storage *info = &fb_stream.sparse;
+
+	if (fb_stream.blk + blkcnt > info->start + info->size) {
+		fastboot_fail("image too large for partition");
+		return -1;
+	}
+	if (info->write(info, fb_stream.blk, blkcnt, data) < blkcnt) {
+		printf("Write failed, block #" LBAFU "\n", fb_stream.blk);
+		fastboot_fail("flash write failure");
+		return -1;
+	}
+	fb_stream.blk += blkcnt;
+	fb_stream.bytes_written += blkcnt * info->blksz;
+
+	return 0;
+}
+
+/* Writes data in whole blocks, keeping a trailing partial block */
+static int fastboot_stream_write(const u8 *data, unsigned int len)
+{
+	lbaint_t blksz = fb_stream.sparse.blksz;
+	unsigned int n;
+
+	if (fb_stream.partial_len) {
+		n = min_t(unsigned int, len, blksz - fb_stream.partial_len);
+		memcpy(fb_stream.partial + fb_stream.partial_len, data, n);
+		fb_stream.partial_len += n;
+		data += n;
+		len -= n;
+		if (fb_stream.partial_len < blksz)
+			return 0;
+		if (fastboot_stream_write_blks(fb_stream.partial, 1))
+			return -1;
+		fb_stream.partial_len = 0;
+	}
+
+	n = len / blksz;
+	if (n && fastboot_stream_write_blks(data, n))
+		return -1;
+
+	fb_stream.partial_len = len - n * blksz;
+	memcpy(fb_stream.partial, data + n * blksz, fb_stream.partial_len);
+
+	return 0;
+}
+
+static void fastboot_stream_next_chunk(void)
+{
+	fb_stream.have = 0;
+	if (++fb_stream.chunk == fb_stream.hdr.total_chunks) {
+		fb_stream.step = FB_STREAM_END;
+	} else {
+		fb_stream.step = FB_STREAM_CHUNK_HDR;
+		fb_stream.need = fb_stream.hdr.chunk_hdr_sz;
+	}
+}
+
+/* Acts on the header or chunk collected in the stage buffer */
+static int fastboot_stream_staged(void)
+{
+	sparse_header_t *hdr = &fb_stream.hdr;
+	chunk_header_t *chunk = (chunk_header_t *)fb_stream.stage;
+	void *data = fb_stream.stage;
+
+	switch (fb_stream.step) {
+	case FB_STREAM_FILE_HDR:
+		if (!is_sparse_image(fb_stream.stage)) {
+			fb_stream.step = FB_STREAM_IMAGE;
+			return fastboot_stream_write(fb_stream.stage,
+						     fb_stream.have);
+		}
+
+		memcpy(hdr, fb_stream.stage, sizeof(*hdr));
+		if (hdr->blk_sz % fb_stream.sparse.blksz ||
+		    hdr->file_hdr_sz < sizeof(*hdr) ||
+		    hdr->chunk_hdr_sz < sizeof(chunk_header_t) ||
+		    hdr->chunk_hdr_sz > FB_STREAM_STAGE_SIZE - sizeof(u32)) {
+			fastboot_fail("unsupported sparse image");
+			return -1;
+		}
+		puts("Flashing Sparse Image\n");
+
+		fb_stream.have = 0;
+		fb_stream.need = hdr->chunk_hdr_sz;
+		fb_stream.next = hdr->total_chunks ? FB_STREAM_CHUNK_HDR :
+						     FB_STREAM_END;
+		fb_stream.step = fb_stream.next;
+		if (hdr->file_hdr_sz > sizeof(*hdr)) {
+			fb_stream.need = hdr->file_hdr_sz - sizeof(*hdr);
+			fb_stream.step = FB_STREAM_SKIP;
+		}
+		return 0;
+
+	case FB_STREAM_CHUNK_HDR:
+		if (chunk->chunk_type == CHUNK_TYPE_RAW) {
+			fb_stream.raw_left = (u64)chunk->chunk_sz * hdr->blk_sz;
+			if (chunk->total_sz != hdr->chunk_hdr_sz +
+					       fb_stream.raw_left) {
+				fastboot_fail("Bogus chunk size for chunk type Raw");
+				return -1;
+			}
+			fb_stream.step = FB_STREAM_RAW;
+			if (!fb_stream.raw_left)
+				fastboot_stream_next_chunk();
+			return 0;
+		}
+
+		if (chunk->total_sz < hdr->chunk_hdr_sz ||
+		    chunk->total_sz > hdr->chunk_hdr_sz + sizeof(u32)) {
+			fastboot_fail("Bogus chunk size");
+			return -1;
+		}
+		if (chunk->total_sz > fb_stream.have) {
+			/* the FILL value or CRC follows the header */
+			fb_stream.need = chunk->total_sz - fb_stream.have;
+			fb_stream.step = FB_STREAM_CHUNK_DATA;
+			return 0;
+		}
+		/* fall through */
+	case FB_STREAM_CHUNK_DATA:
+		if (write_sparse_chunk(&fb_stream.sparse, hdr, &data,
+				       &fb_stream.blk, &fb_stream.total_blocks,
+				       &fb_stream.bytes_written))
+			return -1;
+		fastboot_stream_next_chunk();
+		return 0;
+
+	default:
+		return 0;
+	}
+}
+
+/* Consumes the next len bytes of the download */
+static void fastboot_stream_feed(const u8 *data, unsigned int len)
+{
+	unsigned int n;
+	int ret = 0;
+
+	/* write_sparse_chunk() reports errors through fastboot_fail() */
+	fb_response_str = fb_stream.response;
+
+	while (len && !ret) {
+		switch (fb_stream.step) {
+		case FB_STREAM_FILE_HDR:
+		case FB_STREAM_CHUNK_HDR:
+		case FB_STREAM_CHUNK_DATA:
+			n = min(len, fb_stream.need);
+			memcpy(fb_stream.stage + fb_stream.have, data, n);
+			fb_stream.have += n;
+			fb_stream.need -= n;
+			if (!fb_stream.need)
+				ret = fastboot_stream_staged();
+			break;
+		case FB_STREAM_SKIP:
+			n = min(len, fb_stream.need);
+			fb_stream.need -= n;
+			if (!fb_stream.need) {
+				fb_stream.need = fb_stream.hdr.chunk_hdr_sz;
+				fb_stream.step = fb_stream.next;
+			}
+			break;
+		case FB_STREAM_RAW:
+			n = min_t(u64, len, fb_stream.raw_left);
+			ret = fastboot_stream_write(data, n);
+			fb_stream.raw_left -= n;
+			if (!ret && !fb_stream.raw_left) {
+				chunk_header_t *chunk =
+					(chunk_header_t *)fb_stream.stage;
+
+				fb_stream.total_blocks += chunk->chunk_sz;
+				fastboot_stream_next_chunk();
+			}
+			break;
+		case FB_STREAM_IMAGE:
+			n = len;
+			ret = fastboot_stream_write(data, n);
+			break;
+		case FB_STREAM_END:
+			fastboot_fail("data after the last chunk");
+			ret = -1;
+			n = len;
+			break;
+		default:
+			/* drop the rest of a download that failed */
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+
+	if (ret)
+		fb_stream.step = FB_STREAM_ERROR;
+}
+
+/* Completes the streamed download and returns the response to it */
+static const char *fastboot_stream_end(void)
+{
+	fb_response_str = fb_stream.response;
+
+	switch (fb_stream.step) {
+	case FB_STREAM_ERROR:
+		break;
+	case FB_STREAM_FILE_HDR:
+		/* an image shorter than a sparse header */
+		if (fastboot_stream_write(fb_stream.stage, fb_stream.have))
+			break;
+		/* fall through */
+	case FB_STREAM_IMAGE:
+		if (fb_stream.partial_len) {
+			memset(fb_stream.partial + fb_stream.partial_len, 0,
+			       fb_stream.sparse.blksz - fb_stream.partial_len);
+			if (fastboot_stream_write_blks(fb_stream.partial, 1))
+				break;
+		}
+		fastboot_okay("");
+		break;
+	case FB_STREAM_END:
+		if (fb_stream.total_blocks != fb_stream.hdr.total_blks)
+			fastboot_fail("sparse image write failure");
+		else
+			fastboot_okay("");
+		break;
+	default:
+		fastboot_fail("sparse image is truncated");
+		break;
+	}
+
+	free(fb_stream.partial);
+	fb_stream.partial = NULL;
+
+	if (!strncmp(fb_stream.response, "OKAY", 4)) {
+		printf("........ wrote %u bytes to '%s'\n",
+		       fb_stream.bytes_written, fb_stream.part);
+		fb_stream.state = FB_STREAM_DONE;
+	} else {
+		printf("Streaming to '%s' failed: %s\n", fb_stream.part,
+		       fb_stream.response + 4);
+		fb_stream.state = FB_STREAM_IDLE;
+	}
+
+	return fb_stream.response;
+}
+
+/* Drops a streamed download that ended before all of its data arrived */
+static void fastboot_stream_abort(void)
+{
+	free(fb_stream.partial);
+	fb_stream.partial = NULL;
+	fb_stream.state = FB_STREAM_IDLE;
+	printf("Streaming to '%s' aborted\n", fb_stream.part);
+}
+
+/* Answers the flash command that follows a streamed download */
+static bool fastboot_stream_flash(const char *name)
+{
+	struct fastboot_ptentry *ptn;
+
+	if (fb_stream.state != FB_STREAM_DONE)
+		return false;
+
+	fb_stream.state = FB_STREAM_IDLE;
+	ptn = fastboot_flash_find_ptn(name);
+	if (ptn && !strcmp(ptn->name, fb_stream.part))
+		fastboot_okay("");
+	else
+		fastboot_fail("image was streamed to another partition");
+
+	return true;
+}
+
+static void cb_oem_stream(struct usb_ep *ep, struct usb_request *req)
+{
+	char *cmd = req->buf;
+	char response[FASTBOOT_RESPONSE_LEN];
+
+	strsep(&cmd, ":");
+	fb_response_str = response;
+
+#ifdef CONFIG_FASTBOOT_LOCK
+	if (fastboot_get_lock_stat() != FASTBOOT_UNLOCK) {
+		error("device is LOCKed!\n");
+		fastboot_tx_write_str("FAIL device is locked.");
+		return;
+	}
+#endif
+	fastboot_stream_arm(cmd);
+	fastboot_tx_write_str(response);
+}
+#endif
+
 static void fastboot_fifo_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	int status = req->status;
@@ -2435,6 +2878,7 @@ static void fastboot_disable(struct usb_function *f)
 {
 	usb_req *req;
 	struct f_fastboot *f_fb = func_to_fastboot(f);
+	int i;
 
 	usb_ep_disable(f_fb->out_ep);
 	usb_ep_disable(f_fb->in_ep);
@@ -2444,6 +2888,13 @@ static void fastboot_disable(struct usb_function *f)
 		usb_ep_free_request(f_fb->out_ep, f_fb->out_req);
 		f_fb->out_req = NULL;
 	}
+	/* the download requests point into the fastboot buffer */
+	for (i = 0; i < FB_DL_REQS; i++) {
+		if (f_fb->dl_req[i]) {
+			usb_ep_free_request(f_fb->out_ep, f_fb->dl_req[i]);
+			f_fb->dl_req[i] = NULL;
+		}
+	}
 	if (f_fb->in_req) {
 		free(f_fb->in_req->buf);
 		usb_ep_free_request(f_fb->in_ep, f_fb->in_req);
@@ -2484,7 +2935,7 @@ static struct usb_request *fastboot_start_ep(struct usb_ep *ep)
 static int fastboot_set_alt(struct usb_function *f,
 			    unsigned interface, unsigned alt)
 {
-	int ret;
+	int ret, i;
 	struct usb_composite_dev *cdev = f->config->cdev;
 	struct usb_gadget *gadget = cdev->gadget;
 	struct f_fastboot *f_fb = func_to_fastboot(f);
@@ -2508,6 +2959,15 @@ static int fastboot_set_alt(struct usb_function *f,
 	}
 	f_fb->out_req->complete = rx_handler_command;
 
+	for (i = 0; i < FB_DL_REQS; i++) {
+		f_fb->dl_req[i] = usb_ep_alloc_request(f_fb->out_ep, 0);
+		if (!f_fb->dl_req[i]) {
+			puts("failed to alloc download req\n");
+			ret = -EINVAL;
+			goto err;
+		}
+	}
+
 	d = fb_ep_desc(gadget, &fs_ep_in, &hs_ep_in);
 	ret = usb_ep_enable(f_fb->in_ep, d);
 	if (ret) {
@@ -2820,6 +3280,12 @@ static int get_single_var(char *cmd, char *response)
 	} else if (!strcmp_l1("downloadsize", cmd) ||
 		!strcmp_l1("max-download-size", cmd)) {
 
+#ifdef FASTBOOT_STREAM
+		if (fastboot_stream_armed())
+			snprintf(response + strlen(response), chars_left,
+				 "0x%x", FB_STREAM_MAX_SIZE);
+		else
+#endif
 		snprintf(response + strlen(response), chars_left, "0x%x", CONFIG_FASTBOOT_BUF_SIZE);
 	} else if (!strcmp_l1("erase-block-size", cmd)) {
 		mmc_dev_no = mmc_get_env_dev();
@@ -2985,16 +3451,18 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 	}
 }
 
-static unsigned int rx_bytes_expected(struct usb_ep *ep)
+static unsigned int rx_bytes_expected(struct usb_ep *ep, unsigned int offset)
 {
-	int rx_remain = download_size - download_bytes;
+	unsigned int rx_remain;
 	unsigned int rem;
 	unsigned int maxpacket = ep->maxpacket;
 
-	if (rx_remain <= 0)
+	if (offset >= download_size)
 		return 0;
-	else if (rx_remain > EP_BUFFER_SIZE)
-		return EP_BUFFER_SIZE;
+
+	rx_remain = download_size - offset;
+	if (rx_remain > FB_DL_REQ_SIZE)
+		return FB_DL_REQ_SIZE;
 
 	/*
 	 * Some controllers e.g. DWC3 don't like OUT transfers to be
@@ -3009,26 +3477,68 @@ static unsigned int rx_bytes_expected(struct usb_ep *ep)
 	return rx_remain;
 }
 
+static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req);
+
+/* Hands the next part of the fastboot buffer to req */
+static void rx_queue_dl_image(struct usb_ep *ep, struct usb_request *req)
+{
+	unsigned int offset = download_queued;
+
+	req->length = rx_bytes_expected(ep, download_queued);
+	if (!req->length)
+		return;
+
+#ifdef FASTBOOT_STREAM
+	/* each slice is consumed before its request is queued again */
+	if (fastboot_stream_armed())
+		offset %= FB_DL_REQS * FB_DL_REQ_SIZE;
+#endif
+	req->buf = download_base + offset;
+	req->actual = 0;
+	req->complete = rx_handler_dl_image;
+	download_queued += req->length;
+	usb_ep_queue(ep, req, 0);
+}
+
+/* Ends the download and gets back to receiving commands */
+static void rx_end_dl_image(struct usb_ep *ep, const char *response)
+{
+	int i;
+
+	download_size = 0;
+	/*
+	 * After a short transfer, the next request may already be primed.
+	 * Dequeuing it must take it back from the controller, so that the
+	 * command request is not queued behind it.
+	 */
+	for (i = 0; i < FB_DL_REQS; i++)
+		usb_ep_dequeue(ep, fastboot_func->dl_req[i]);
+
+	fastboot_tx_write_str(response);
+
+	fastboot_func->out_req->actual = 0;
+	usb_ep_queue(ep, fastboot_func->out_req, 0);
+}
+
 #define BYTES_PER_DOT	0x20000
 static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 {
-	char response[FASTBOOT_RESPONSE_LEN];
 	unsigned int transfer_size = download_size - download_bytes;
-	const unsigned char *buffer = req->buf;
-	unsigned int buffer_size = req->actual;
 	unsigned int pre_dot_num, now_dot_num;
-	void * base_addr = (void*)getenv_ulong("fastboot_buffer", 16, CONFIG_FASTBOOT_BUF_ADDR);
 
 	if (req->status != 0) {
-		printf("Bad status: %d\n", req->status);
+		if (req->status != -ECONNRESET)
+			printf("Bad status: %d\n", req->status);
 		return;
 	}
 
-	if (buffer_size < transfer_size)
-		transfer_size = buffer_size;
+	if (req->actual < transfer_size)
+		transfer_size = req->actual;
 
-	memcpy(base_addr + download_bytes,
-	       buffer, transfer_size);
+#ifdef FASTBOOT_STREAM
+	if (fastboot_stream_armed())
+		fastboot_stream_feed(req->buf, transfer_size);
+#endif
 
 	pre_dot_num = download_bytes / BYTES_PER_DOT;
 	download_bytes += transfer_size;
@@ -3046,21 +3556,33 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 		 * Reset global transfer variable, keep download_bytes because
 		 * it will be used in the next possible flashing command
 		 */
-		download_size = 0;
-		req->complete = rx_handler_command;
-		req->length = EP_BUFFER_SIZE;
-
-		strcpy(response, "OKAY");
-		fastboot_tx_write_str(response);
-
-		printf("\ndownloading of %d bytes finished\n", download_bytes);
-
+		printf("\ndownloading of %u bytes finished\n", download_bytes);
+#ifdef FASTBOOT_STREAM
+		if (fastboot_stream_armed()) {
+			/* the buffer only held a window of the image */
+			download_bytes = 0;
+			rx_end_dl_image(ep, fastboot_stream_end());
+			return;
+		}
+#endif
+		rx_end_dl_image(ep, "OKAY");
+	} else if (req->actual < req->length) {
+		/*
+		 * The host only ends a transfer short with the last of the
+		 * data; the requests queued behind this one would be off.
+		 */
+		rx_end_dl_image(ep, "FAILshort transfer");
+		printf("\ndownload aborted, short transfer at %d bytes\n",
+		       download_bytes);
+#ifdef FASTBOOT_STREAM
+		if (fastboot_stream_armed()) {
+			download_bytes = 0;
+			fastboot_stream_abort();
+		}
+#endif
 	} else {
-		req->length = rx_bytes_expected(ep);
+		rx_queue_dl_image(ep, req);
 	}
-
-	req->actual = 0;
-	usb_ep_queue(ep, req, 0);
 }
 
 static void cb_upload(struct usb_ep *ep, struct usb_request *req)
@@ -3086,6 +3608,7 @@ static void cb_download(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
 	char response[FASTBOOT_RESPONSE_LEN];
+	int i;
 
 	strsep(&cmd, ":");
 	download_size = simple_strtoul(cmd, NULL, 16);
@@ -3095,13 +3618,30 @@ static void cb_download(struct usb_ep *ep, struct usb_request *req)
 
 	if (0 == download_size) {
 		strcpy(response, "FAILdata invalid size");
+#ifdef FASTBOOT_STREAM
+	} else if (fastboot_stream_armed() &&
+		   (download_size > FB_STREAM_MAX_SIZE ||
+		    fastboot_stream_start())) {
+		download_size = 0;
+		strcpy(response, "FAILcannot stream data");
+	} else if (!fastboot_stream_armed() &&
+		   download_size > CONFIG_FASTBOOT_BUF_SIZE) {
+#else
 	} else if (download_size > CONFIG_FASTBOOT_BUF_SIZE) {
+#endif
 		download_size = 0;
 		strcpy(response, "FAILdata too large");
 	} else {
 		sprintf(response, "DATA%08x", download_size);
-		req->complete = rx_handler_dl_image;
-		req->length = rx_bytes_expected(ep);
+		/*
+		 * The command request is requeued at the end of the download,
+		 * the data goes straight to the fastboot buffer
+		 */
+		download_base = (unsigned char *)getenv_ulong("fastboot_buffer",
+						16, CONFIG_FASTBOOT_BUF_ADDR);
+		download_queued = 0;
+		for (i = 0; i < FB_DL_REQS; i++)
+			rx_queue_dl_image(ep, fastboot_func->dl_req[i]);
 	}
 	fastboot_tx_write_str(response);
 }
@@ -3334,6 +3874,12 @@ static void cb_flash(struct usb_ep *ep, struct usb_request *req)
 	int gpt_valid_pst = 0;
 	if (strncmp(cmd, "gpt", 3) == 0)
 		gpt_valid_pre = partition_table_valid();
+#endif
+#ifdef FASTBOOT_STREAM
+	if (fastboot_stream_flash(cmd)) {
+		fastboot_tx_write_str(response);
+		return;
+	}
 #endif
 	rx_process_flash(cmd);
 #ifdef CONFIG_FASTBOOT_LOCK
@@ -3531,6 +4077,12 @@ static const struct cmd_dispatch_info cmd_dispatch_info[] = {
 		.cb = cb_erase,
 	},
 #endif
+#ifdef FASTBOOT_STREAM
+	{
+		.cmd = "oem stream:",
+		.cb = cb_oem_stream,
+	},
+#endif
 #ifdef CONFIG_FASTBOOT_LOCK
 	{
 		.cmd = "oem",
@@ -3581,7 +4133,9 @@ static void rx_handler_command(struct usb_ep *ep, struct usb_request *req)
 
 	*cmdbuf = '\0';
 	req->actual = 0;
-	usb_ep_queue(ep, req, 0);
+	/* during a download the OUT endpoint belongs to the data requests */
+	if (!download_size)
+		usb_ep_queue(ep, req, 0);
 }
 #endif
 
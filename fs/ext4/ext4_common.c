@@ -46,6 +46,35 @@ int ext4fs_indir3_blkno = -1;
 struct ext2_inode *g_parent_inode;
 static int symlinknest;
 
+/*
+ * The extent tree block last read on each level below the inode, so that
+ * consecutive lookups in one file do not walk the tree on the device
+ */
+#define EXT4_EXT_MAX_DEPTH	5
+#define EXT4_EXT_INIT_MAX_LEN	(1 << 15)
+
+static struct ext4_extent_cache {
+	char *buf;
+	int size;
+	unsigned long long blkno;	/* 0 if buf holds no block */
+} ext4fs_ext_cache[EXT4_EXT_MAX_DEPTH];
+
+/*
+ * Inodes recently read, direct-mapped on the inode number, and the group
+ * descriptor table read when mounting. Path lookups then go to the device
+ * only for directory contents. Both are dropped by ext4fs_cache_invalidate()
+ * whenever the write code changes metadata on the device.
+ */
+#define EXT4_INODE_CACHE_SIZE	64
+
+static struct ext4_inode_cache {
+	int ino;			/* 0 if the slot is empty */
+	struct ext2_inode inode;
+} *ext4fs_inode_cache;
+
+static char *ext4fs_gd_cache;
+static uint32_t ext4fs_gd_count;
+
 #if defined(CONFIG_EXT4_WRITE)
 struct ext2_block_group *ext4fs_get_group_descriptor
 	(const struct ext_filesystem *fs, uint32_t bg_idx)
@@ -1509,15 +1538,40 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 
 #endif
 
+/* Return extent tree block 'block' on level 'level', reading it if needed */
+static struct ext4_extent_header *ext4fs_read_extent_block
+	(unsigned long long block, int blksz, int level, int log2_blksz)
+{
+	struct ext4_extent_cache *c = &ext4fs_ext_cache[level];
+
+	if (c->blkno == block && c->size == blksz)
+		return (struct ext4_extent_header *)c->buf;
+
+	if (c->size != blksz) {
+		free(c->buf);
+		c->size = 0;
+		c->buf = zalloc(blksz);
+		if (!c->buf)
+			return NULL;
+		c->size = blksz;
+	}
+
+	c->blkno = 0;
+	if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz, c->buf))
+		return NULL;
+	c->blkno = block;
+
+	return (struct ext4_extent_header *)c->buf;
+}
+
 static struct ext4_extent_header *ext4fs_get_extent_block
-	(struct ext2_data *data, char *buf,
-		struct ext4_extent_header *ext_block,
+	(struct ext2_data *data, struct ext4_extent_header *ext_block,
 		uint32_t fileblock, int log2_blksz)
 {
 	struct ext4_extent_idx *index;
 	unsigned long long block;
 	int blksz = EXT2_BLOCK_SIZE(data);
-	int i;
+	int depth, i;
 
 	while (1) {
 		index = (struct ext4_extent_idx *)(ext_block + 1);
@@ -1525,8 +1579,11 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 		if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC)
 			return NULL;
 
-		if (ext_block->eh_depth == 0)
+		depth = le16_to_cpu(ext_block->eh_depth);
+		if (depth == 0)
 			return ext_block;
+		if (depth > EXT4_EXT_MAX_DEPTH)
+			return NULL;
 		i = -1;
 		do {
 			i++;
@@ -1540,10 +1597,9 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 		block = le16_to_cpu(index[i].ei_leaf_hi);
 		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
 
-		if (ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
-				   buf))
-			ext_block = (struct ext4_extent_header *)buf;
-		else
+		ext_block = ext4fs_read_extent_block(block, blksz, depth - 1,
+						     log2_blksz);
+		if (!ext_block)
 			return NULL;
 	}
 }
@@ -1556,6 +1612,11 @@ static int ext4fs_blockgroup
 	int log2blksz = get_fs()->dev_desc->log2blksz;
 	int desc_size = get_fs()->gdsize;
 
+	if (ext4fs_gd_cache && group < ext4fs_gd_count) {
+		memcpy(blkgrp, ext4fs_gd_cache + group * desc_size, desc_size);
+		return 1;
+	}
+
 	desc_per_blk = EXT2_BLOCK_SIZE(data) / desc_size;
 
 	blkno = le32_to_cpu(data->sblock.first_data_block) + 1 +
@@ -1576,10 +1637,19 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	struct ext2_sblock *sblock = &data->sblock;
 	struct ext_filesystem *fs = get_fs();
 	int log2blksz = get_fs()->dev_desc->log2blksz;
+	struct ext4_inode_cache *slot = NULL;
 	int inodes_per_block, status;
 	long int blkno;
 	unsigned int blkoff;
 
+	if (ext4fs_inode_cache) {
+		slot = &ext4fs_inode_cache[ino % EXT4_INODE_CACHE_SIZE];
+		if (slot->ino == ino) {
+			memcpy(inode, &slot->inode, sizeof(struct ext2_inode));
+			return 1;
+		}
+	}
+
 	/* It is easier to calculate if the first inode is 0. */
 	ino--;
 	status = ext4fs_blockgroup(data, ino / le32_to_cpu
@@ -1598,9 +1668,64 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	if (status == 0)
 		return 0;
 
+	if (slot) {
+		slot->ino = ino + 1;
+		memcpy(&slot->inode, inode, sizeof(struct ext2_inode));
+	}
+
 	return 1;
 }
 
+/* Read the whole group descriptor table of the filesystem in 'data' */
+static void ext4fs_load_gd_cache(struct ext2_data *data)
+{
+	struct ext2_sblock *sblock = &data->sblock;
+	struct ext_filesystem *fs = get_fs();
+	int log2blksz = fs->dev_desc->log2blksz;
+	uint32_t count, blocks;
+	long int blkno;
+
+	count = DIV_ROUND_UP(le32_to_cpu(sblock->total_blocks) -
+			     le32_to_cpu(sblock->first_data_block),
+			     le32_to_cpu(sblock->blocks_per_group));
+	blocks = DIV_ROUND_UP(count * fs->gdsize, EXT2_BLOCK_SIZE(data));
+	blkno = le32_to_cpu(sblock->first_data_block) + 1;
+
+	ext4fs_gd_cache = zalloc(blocks * EXT2_BLOCK_SIZE(data));
+	if (!ext4fs_gd_cache)
+		return;
+	if (!ext4fs_devread((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
+			    log2blksz), 0, blocks * EXT2_BLOCK_SIZE(data),
+			    ext4fs_gd_cache)) {
+		free(ext4fs_gd_cache);
+		ext4fs_gd_cache = NULL;
+		return;
+	}
+	ext4fs_gd_count = count;
+}
+
+void ext4fs_cache_invalidate(void)
+{
+	if (ext4fs_inode_cache)
+		memset(ext4fs_inode_cache, 0, EXT4_INODE_CACHE_SIZE *
+		       sizeof(struct ext4_inode_cache));
+
+	free(ext4fs_gd_cache);
+	ext4fs_gd_cache = NULL;
+	ext4fs_gd_count = 0;
+	if (ext4fs_root)
+		ext4fs_load_gd_cache(ext4fs_root);
+}
+
+static void ext4fs_cache_free(void)
+{
+	free(ext4fs_inode_cache);
+	ext4fs_inode_cache = NULL;
+	free(ext4fs_gd_cache);
+	ext4fs_gd_cache = NULL;
+	ext4fs_gd_count = 0;
+}
+
 long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 {
 	long int blknr;
@@ -1618,20 +1743,16 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
 		long int startblock, endblock;
-		char *buf = zalloc(blksz);
-		if (!buf)
-			return -ENOMEM;
 		struct ext4_extent_header *ext_block;
 		struct ext4_extent *extent;
 		int i;
 		ext_block =
-			ext4fs_get_extent_block(ext4fs_root, buf,
+			ext4fs_get_extent_block(ext4fs_root,
 						(struct ext4_extent_header *)
 						inode->b.blocks.dir_blocks,
 						fileblock, log2_blksz);
 		if (!ext_block) {
 			printf("invalid extent block\n");
-			free(buf);
 			return -EINVAL;
 		}
 
@@ -1643,19 +1764,16 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 
 			if (startblock > fileblock) {
 				/* Sparse file */
-				free(buf);
 				return 0;
 
 			} else if (fileblock < endblock) {
 				start = le16_to_cpu(extent[i].ee_start_hi);
 				start = (start << 32) +
 					le32_to_cpu(extent[i].ee_start_lo);
-				free(buf);
 				return (fileblock - startblock) + start;
 			}
 		}
 
-		free(buf);
 		return 0;
 	}
 
@@ -1944,6 +2062,82 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 	return blknr;
 }
 
+/*
+ * Map 'fileblock' of a file like read_allocated_block(), and store in
+ * '*count' the number of blocks from there on that are contiguous on the
+ * device, or that read as zeros if 0 is returned. Files without extents
+ * are mapped one block at a time.
+ */
+long int read_allocated_extent(struct ext2_inode *inode, int fileblock,
+			       int *count)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	unsigned long long start;
+	long int startblock;
+	int lo, hi, mid, i, len, entries;
+	int uninit = 0;
+
+	*count = 1;
+	if (!(le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL))
+		return read_allocated_block(inode, fileblock);
+
+	ext_block = ext4fs_get_extent_block(ext4fs_root,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock,
+					    LOG2_BLOCK_SIZE(ext4fs_root) -
+					    get_fs()->dev_desc->log2blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+	entries = le16_to_cpu(ext_block->eh_entries);
+
+	/* the last extent starting at or before fileblock */
+	i = -1;
+	lo = 0;
+	hi = entries - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (le32_to_cpu(extent[mid].ee_block) <= fileblock) {
+			i = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	if (i >= 0) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		len = le16_to_cpu(extent[i].ee_len);
+		if (len > EXT4_EXT_INIT_MAX_LEN) {
+			/* allocated, but not written yet */
+			len -= EXT4_EXT_INIT_MAX_LEN;
+			uninit = 1;
+		}
+
+		if (fileblock < startblock + len) {
+			*count = startblock + len - fileblock;
+			if (uninit)
+				return 0;
+
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			return (fileblock - startblock) + start;
+		}
+	}
+
+	/* Sparse file, the hole ends where the next extent starts */
+	if (i + 1 < entries)
+		*count = le32_to_cpu(extent[i + 1].ee_block) - fileblock;
+
+	return 0;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -1958,6 +2152,8 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
  */
 void ext4fs_reinit_global(void)
 {
+	int i;
+
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -1976,9 +2172,16 @@ void ext4fs_reinit_global(void)
 		ext4fs_indir3_size = 0;
 		ext4fs_indir3_blkno = -1;
 	}
+	for (i = 0; i < EXT4_EXT_MAX_DEPTH; i++) {
+		free(ext4fs_ext_cache[i].buf);
+		ext4fs_ext_cache[i].buf = NULL;
+		ext4fs_ext_cache[i].size = 0;
+		ext4fs_ext_cache[i].blkno = 0;
+	}
 }
 void ext4fs_close(void)
 {
+	ext4fs_close_file();
 	if ((ext4fs_file != NULL) && (ext4fs_root != NULL)) {
 		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
 		ext4fs_file = NULL;
@@ -1989,27 +2192,132 @@ void ext4fs_close(void)
 	}
 
 	ext4fs_reinit_global();
+	ext4fs_cache_free();
 }
 
-int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
-				struct ext2fs_node **fnode, int *ftype)
+/*
+ * Walk the htree index of a directory down to the leaf block that can hold
+ * 'name'. Leaves following it are returned as well while their hash shows
+ * that colliding names continue there. Sets *more when the run of leaves
+ * may go on beyond what was returned. Returns the number of leaf blocks,
+ * or 0 when the directory has to be scanned linearly.
+ */
+static int ext4fs_dx_lookup(struct ext2fs_node *dir, const char *name,
+			    uint32_t *leaves, int max, int *more)
 {
-	unsigned int fpos = 0;
-	int status;
+	struct ext2_data *data = dir->data;
+	struct ext2_sblock *sb = &data->sblock;
+	int blksz = EXT2_BLOCK_SIZE(data);
+	struct dx_root_info *info;
+	struct dx_countlimit *cl;
+	struct dx_entry *entries, *at;
+	__u32 seed[4], hash;
+	uint32_t block;
+	int version, indirect, levels, count, limit, lo, hi, mid;
+	int i, n = 0;
 	loff_t actread;
-	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
+	char *buf;
 
-#ifdef DEBUG
-	if (name != NULL)
-		printf("Iterate dir %s\n", name);
-#endif /* of DEBUG */
-	if (!diro->inode_read) {
-		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
-		if (status == 0)
-			return 0;
+	*more = 0;
+	if (!(le32_to_cpu(sb->feature_compatibility) &
+	      EXT4_FEATURE_COMPAT_DIR_INDEX) ||
+	    !(le32_to_cpu(dir->inode.flags) & EXT4_INDEX_FL))
+		return 0;
+
+	/* "." and ".." are not hashed, they sit in front of the root */
+	if (!strcmp(name, ".") || !strcmp(name, ".."))
+		return 0;
+
+	buf = zalloc(blksz);
+	if (!buf)
+		return 0;
+
+	if (ext4fs_read_file(dir, 0, blksz, buf, &actread) < 0 ||
+	    actread != blksz)
+		goto out;
+
+	/* the root info follows the 12 byte "." and ".." entries */
+	info = (struct dx_root_info *)(buf + 24);
+	indirect = info->indirect_levels;
+	levels = indirect;
+	if (info->reserved_zero || info->info_length < 8 ||
+	    24 + info->info_length + sizeof(struct dx_entry) > blksz ||
+	    levels >= EXT4_HTREE_LEVEL)
+		goto out;
+
+	version = info->hash_version;
+	if (version <= DX_HASH_TEA &&
+	    (le32_to_cpu(sb->flags) & EXT2_FLAGS_UNSIGNED_HASH))
+		version += DX_HASH_LEGACY_UNSIGNED;
+	for (i = 0; i < 4; i++)
+		seed[i] = le32_to_cpu(sb->hash_seed[i]);
+	if (ext4fs_dirhash(name, strlen(name), version, seed, &hash))
+		goto out;
+
+	entries = (struct dx_entry *)((char *)info + info->info_length);
+	for (;;) {
+		cl = (struct dx_countlimit *)entries;
+		count = le16_to_cpu(cl->count);
+		limit = le16_to_cpu(cl->limit);
+		if (!count || count > limit ||
+		    (char *)(entries + limit) > buf + blksz)
+			goto out;
+
+		/* last entry with a hash <= ours, entry 0 covers the rest */
+		lo = 1;
+		hi = count - 1;
+		while (lo <= hi) {
+			mid = (lo + hi) / 2;
+			if (le32_to_cpu(entries[mid].hash) > hash)
+				hi = mid - 1;
+			else
+				lo = mid + 1;
+		}
+		at = entries + lo - 1;
+		block = le32_to_cpu(at->block) & 0x0fffffff;
+
+		if (!levels--)
+			break;
+
+		/* interior nodes start with an empty 8 byte dirent */
+		if (ext4fs_read_file(dir, (loff_t)block * blksz, blksz, buf,
+				     &actread) < 0 || actread != blksz)
+			goto out;
+		entries = (struct dx_entry *)(buf + 8);
 	}
-	/* Search the file.  */
-	while (fpos < le32_to_cpu(diro->inode.size)) {
+
+	leaves[n++] = block;
+	for (at++; at < entries + count; at++) {
+		/* the low bit flags a hash continued from the previous leaf */
+		if ((le32_to_cpu(at->hash) & ~1) != hash)
+			break;
+		if (n == max) {
+			*more = 1;
+			break;
+		}
+		leaves[n++] = le32_to_cpu(at->block) & 0x0fffffff;
+	}
+	/*
+	 * The next leaf is behind the next index node, we don't follow. buf
+	 * holds that index node by now, so info is not looked at again.
+	 */
+	if (at == entries + count && indirect)
+		*more = 1;
+
+out:
+	free(buf);
+	return n;
+}
+
+static int ext4fs_iterate_dir_range(struct ext2fs_node *diro,
+				    unsigned int fpos, unsigned int end,
+				    char *name, struct ext2fs_node **fnode,
+				    int *ftype)
+{
+	int status;
+	loff_t actread;
+
+	while (fpos < end) {
 		struct ext2_dirent dirent;
 
 		status = ext4fs_read_file(diro, fpos,
@@ -2126,6 +2434,47 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 	return 0;
 }
 
+#define EXT4_DX_MAX_LEAVES	4
+
+int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
+				struct ext2fs_node **fnode, int *ftype)
+{
+	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
+	uint32_t leaves[EXT4_DX_MAX_LEAVES];
+	unsigned int blksz = EXT2_BLOCK_SIZE(diro->data);
+	int status, more, n, i;
+
+#ifdef DEBUG
+	if (name != NULL)
+		printf("Iterate dir %s\n", name);
+#endif /* of DEBUG */
+	if (!diro->inode_read) {
+		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
+		if (status == 0)
+			return 0;
+	}
+
+	/* Indexed directory: only search the leaves the name hashes to */
+	if ((name != NULL) && (fnode != NULL) && (ftype != NULL)) {
+		n = ext4fs_dx_lookup(diro, name, leaves, EXT4_DX_MAX_LEAVES,
+				     &more);
+		for (i = 0; i < n; i++) {
+			status = ext4fs_iterate_dir_range(diro,
+							  leaves[i] * blksz,
+							  (leaves[i] + 1) * blksz,
+							  name, fnode, ftype);
+			if (status)
+				return status;
+		}
+		if (n && !more)
+			return 0;
+	}
+
+	/* Search the file.  */
+	return ext4fs_iterate_dir_range(diro, 0, le32_to_cpu(diro->inode.size),
+					name, fnode, ftype);
+}
+
 static char *ext4fs_read_symlink(struct ext2fs_node *node)
 {
 	char *symlink;
@@ -2290,7 +2639,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* the filesystem may stay mounted across several opens */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
@@ -2356,6 +2709,11 @@ int ext4fs_mount(unsigned part_length)
 	data->diropen.inode_read = 1;
 	data->inode = &data->diropen.inode;
 
+	ext4fs_cache_free();
+	ext4fs_load_gd_cache(data);
+	ext4fs_inode_cache = calloc(EXT4_INODE_CACHE_SIZE,
+				    sizeof(struct ext4_inode_cache));
+
 	status = ext4fs_read_inode(data, 2, data->inode);
 	if (status == 0)
 		goto fail;
@@ -2365,6 +2723,7 @@ int ext4fs_mount(unsigned part_length)
 	return 1;
 fail:
 	printf("Failed to mount ext2 filesystem...\n");
+	ext4fs_cache_free();
 	free(data);
 	ext4fs_root = NULL;
 
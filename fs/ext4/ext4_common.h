@@ -56,8 +56,11 @@ int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
+int ext4fs_dirhash(const char *name, int len, int version,
+		   const __u32 *seed, __u32 *hash);
 
 #if defined(CONFIG_EXT4_WRITE)
+void ext4fs_cache_invalidate(void);
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
 uint16_t ext4fs_checksum_update(unsigned int i);
 int ext4fs_get_parent_inode_num(const char *dirname, char *dname, int flags);
@@ -99,6 +99,9 @@ static void ext4fs_update(void)
 
 	ext4fs_dump_metadata();
 
+	/* inodes and group descriptors changed under the read caches */
+	ext4fs_cache_invalidate();
+
 	gindex = 0;
 	gd_index = 0;
 }
@@ -605,6 +608,9 @@ int ext4fs_init(void)
 	if (ext4fs_init_journal())
 		goto fail;
 
+	/* replaying the journal may have rewritten metadata */
+	ext4fs_cache_invalidate();
+
 	/* get total no of blockgroups */
 	fs->no_blkgrp = (uint32_t)ext4fs_div_roundup(
 			le32_to_cpu(ext4fs_root->sblock.total_blocks)
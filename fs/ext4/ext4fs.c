@@ -45,112 +45,92 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
  * reads into one potentially more efficient larger sequential read action
+ *
+ * The file is mapped an extent at a time, so that each run of blocks
+ * that is contiguous on the device, possibly spanning several extents,
+ * is read with a single request. Holes are zero-filled.
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
-	lbaint_t blockcnt;
+	lbaint_t i, blockcnt;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
-	lbaint_t previous_block_number = -1;
 	lbaint_t delayed_start = 0;
-	lbaint_t delayed_extent = 0;
-	lbaint_t delayed_skipfirst = 0;
+	loff_t delayed_extent = 0;
+	int delayed_skipfirst = 0;
 	lbaint_t delayed_next = 0;
 	char *delayed_buf = NULL;
-	short status;
+	int skipfirst;
 
 	/* Adjust len so it we can't read past the end of the file. */
 	if (len + pos > filesize)
 		len = (filesize - pos);
 
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
+	i = lldiv(pos, blocksize);
+	skipfirst = pos - (loff_t)blocksize * i;
+
+	while (i < blockcnt) {
+		long int blknr;
+		loff_t bytes;
+		int count;
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
-		lbaint_t blknr;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
-		int skipfirst = 0;
-		blknr = read_allocated_block(&(node->inode), i);
+		blknr = read_allocated_extent(&node->inode, i, &count);
 		if (blknr < 0)
 			return -1;
+		if (count > blockcnt - i)
+			count = blockcnt - i;
 
-		blknr = blknr << log2_fs_blocksize;
-
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
+		bytes = (loff_t)count * blocksize - skipfirst;
+		/* Last block: the file may end within it */
+		if (i + count == blockcnt)
+			bytes -= (loff_t)blockcnt * blocksize - (len + pos);
 
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
-
-		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
 		if (blknr) {
-			int status;
-
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-					if (status == 0)
-						return -1;
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
+			lbaint_t start = (lbaint_t)blknr << log2_fs_blocksize;
+
+			if (!delayed_extent || delayed_next != start ||
+			    delayed_extent + bytes > INT_MAX) {
+				/* spill */
+				if (delayed_extent &&
+				    !ext4fs_devread(delayed_start,
+						    delayed_skipfirst,
+						    delayed_extent,
+						    delayed_buf))
+					return -1;
+				delayed_start = start;
+				delayed_extent = 0;
 				delayed_skipfirst = skipfirst;
 				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
 			}
+			delayed_extent += bytes;
+			delayed_next = start +
+				((lbaint_t)count << log2_fs_blocksize);
 		} else {
-			if (previous_block_number != -1) {
-				/* spill */
-				status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-				if (status == 0)
-					return -1;
-				previous_block_number = -1;
-			}
-			memset(buf, 0, blocksize - skipfirst);
+			/* spill */
+			if (delayed_extent &&
+			    !ext4fs_devread(delayed_start, delayed_skipfirst,
+					    delayed_extent, delayed_buf))
+				return -1;
+			delayed_extent = 0;
+			memset(buf, 0, bytes);
 		}
-		buf += blocksize - skipfirst;
-	}
-	if (previous_block_number != -1) {
-		/* spill */
-		status = ext4fs_devread(delayed_start,
-					delayed_skipfirst, delayed_extent,
-					delayed_buf);
-		if (status == 0)
-			return -1;
-		previous_block_number = -1;
+
+		buf += bytes;
+		i += count;
+		skipfirst = 0;
 	}
 
+	/* spill */
+	if (delayed_extent &&
+	    !ext4fs_devread(delayed_start, delayed_skipfirst, delayed_extent,
+			    delayed_buf))
+		return -1;
+
 	*actread  = len;
 	return 0;
 }
@@ -198,6 +178,85 @@ int ext4fs_read(char *buf, loff_t offset, loff_t len, loff_t *actread)
 	return ext4fs_read_file(ext4fs_file, offset, len, buf, actread);
 }
 
+/*
+ * The file opened by ext4fs_open_file(). It is kept apart from ext4fs_file,
+ * which the other lookups replace, and freed when unmounting. Its inode and
+ * the cached metadata are valid for the change_seq of the device they were
+ * read at.
+ */
+static struct ext2fs_node *ext4fs_opened;
+static unsigned long ext4fs_opened_seq;
+
+int ext4fs_open_file(const char *filename, loff_t *size)
+{
+	ext4fs_close_file();
+
+	if (ext4fs_open(filename, size) < 0)
+		return -1;
+
+	ext4fs_opened = ext4fs_file;
+	ext4fs_opened_seq = get_fs()->dev_desc->change_seq;
+	ext4fs_file = NULL;
+
+	return 0;
+}
+
+/*
+ * The device was written since the open file was last read: drop the
+ * cached metadata and read the inode again, provided the superblock
+ * still shows the same filesystem
+ */
+static int ext4fs_revalidate_file(void)
+{
+	struct blk_desc *dev_desc = get_fs()->dev_desc;
+	struct ext2_sblock *sblock;
+	int ret = -1;
+
+	if (dev_desc->change_seq == ext4fs_opened_seq)
+		return 0;
+
+	sblock = zalloc(SUPERBLOCK_SIZE);
+	if (!sblock)
+		return -1;
+
+	if (!ext4_read_superblock((char *)sblock) ||
+	    le16_to_cpu(sblock->magic) != EXT2_MAGIC ||
+	    memcmp(sblock->unique_id, ext4fs_root->sblock.unique_id,
+		   sizeof(sblock->unique_id)))
+		goto out;
+
+	memcpy(&ext4fs_root->sblock, sblock, sizeof(*sblock));
+	ext4fs_reinit_global();
+	ext4fs_cache_invalidate();
+	if (!ext4fs_read_inode(ext4fs_root, ext4fs_opened->ino,
+			       &ext4fs_opened->inode))
+		goto out;
+
+	ext4fs_opened_seq = dev_desc->change_seq;
+	ret = 0;
+out:
+	free(sblock);
+	return ret;
+}
+
+int ext4fs_read_next(void *buf, loff_t pos, loff_t len, loff_t *actread)
+{
+	if (ext4fs_root == NULL || ext4fs_opened == NULL)
+		return -1;
+
+	if (ext4fs_revalidate_file())
+		return -1;
+
+	return ext4fs_read_file(ext4fs_opened, pos, len, buf, actread);
+}
+
+void ext4fs_close_file(void)
+{
+	if (ext4fs_opened && ext4fs_root)
+		ext4fs_free_node(ext4fs_opened, &ext4fs_root->diropen);
+	ext4fs_opened = NULL;
+}
+
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 disk_partition_t *fs_partition)
 {
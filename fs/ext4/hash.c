@@ -0,0 +1,206 @@
+/*
+ * Directory index hash functions, used to look up names in htree
+ * indexed directories.
+ *
+ * Based on fs/ext4/hash.c from Linux:
+ * Copyright (C) 2002 by Theodore Ts'o
+ *
+ * SPDX-License-Identifier:	GPL-2.0
+ */
+
+#include <common.h>
+#include "ext4_common.h"
+
+#define DELTA 0x9E3779B9
+
+#define ROL32(x, s)	(((x) << (s)) | ((x) >> (32 - (s))))
+
+static void tea_transform(__u32 buf[4], __u32 const in[])
+{
+	__u32 sum = 0;
+	__u32 b0 = buf[0], b1 = buf[1];
+	__u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* F, G and H are basic MD4 functions: selection, majority, parity */
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + x, a = ROL32(a, s))
+#define K1 0
+#define K2 013240474631UL
+#define K3 015666365641UL
+
+/* cut-down version of the MD4 transform, as used by ext3/ext4 */
+static void half_md4_transform(__u32 buf[4], __u32 const in[8])
+{
+	__u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* Round 1 */
+	MD4_ROUND(F, a, b, c, d, in[0] + K1,  3);
+	MD4_ROUND(F, d, a, b, c, in[1] + K1,  7);
+	MD4_ROUND(F, c, d, a, b, in[2] + K1, 11);
+	MD4_ROUND(F, b, c, d, a, in[3] + K1, 19);
+	MD4_ROUND(F, a, b, c, d, in[4] + K1,  3);
+	MD4_ROUND(F, d, a, b, c, in[5] + K1,  7);
+	MD4_ROUND(F, c, d, a, b, in[6] + K1, 11);
+	MD4_ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+	/* Round 2 */
+	MD4_ROUND(G, a, b, c, d, in[1] + K2,  3);
+	MD4_ROUND(G, d, a, b, c, in[3] + K2,  5);
+	MD4_ROUND(G, c, d, a, b, in[5] + K2,  9);
+	MD4_ROUND(G, b, c, d, a, in[7] + K2, 13);
+	MD4_ROUND(G, a, b, c, d, in[0] + K2,  3);
+	MD4_ROUND(G, d, a, b, c, in[2] + K2,  5);
+	MD4_ROUND(G, c, d, a, b, in[4] + K2,  9);
+	MD4_ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+	/* Round 3 */
+	MD4_ROUND(H, a, b, c, d, in[3] + K3,  3);
+	MD4_ROUND(H, d, a, b, c, in[7] + K3,  9);
+	MD4_ROUND(H, c, d, a, b, in[2] + K3, 11);
+	MD4_ROUND(H, b, c, d, a, in[6] + K3, 15);
+	MD4_ROUND(H, a, b, c, d, in[1] + K3,  3);
+	MD4_ROUND(H, d, a, b, c, in[5] + K3,  9);
+	MD4_ROUND(H, c, d, a, b, in[0] + K3, 11);
+	MD4_ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+#undef MD4_ROUND
+#undef K1
+#undef K2
+#undef K3
+#undef F
+#undef G
+#undef H
+
+/* The old legacy hash */
+static __u32 dx_hack_hash(const char *name, int len, int unsigned_char)
+{
+	__u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	int c;
+
+	while (len--) {
+		if (unsigned_char)
+			c = *(const unsigned char *)name++;
+		else
+			c = *(const signed char *)name++;
+		hash = hash1 + (hash0 ^ (c * 7152373));
+
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static void str2hashbuf(const char *msg, int len, __u32 *buf, int num,
+			int unsigned_char)
+{
+	__u32 pad, val;
+	int i, c;
+
+	pad = (__u32)len | ((__u32)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4)
+		len = num * 4;
+	for (i = 0; i < len; i++) {
+		if (unsigned_char)
+			c = ((const unsigned char *)msg)[i];
+		else
+			c = ((const signed char *)msg)[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+/*
+ * Returns the hash of a file name, with the low bit cleared as stored in
+ * the index, or -1 if the hash version is not supported.
+ */
+int ext4fs_dirhash(const char *name, int len, int version,
+		   const __u32 *seed, __u32 *hash)
+{
+	__u32 in[8], buf[4];
+	const char *p;
+	int unsigned_char = 0;
+	int i;
+
+	/* the default seed, unless the filesystem has its own */
+	buf[0] = 0x67452301;
+	buf[1] = 0xefcdab89;
+	buf[2] = 0x98badcfe;
+	buf[3] = 0x10325476;
+	for (i = 0; seed && i < 4; i++) {
+		if (seed[i]) {
+			memcpy(buf, seed, sizeof(buf));
+			break;
+		}
+	}
+
+	switch (version) {
+	case DX_HASH_LEGACY_UNSIGNED:
+		unsigned_char = 1;
+		/* fall through */
+	case DX_HASH_LEGACY:
+		*hash = dx_hack_hash(name, len, unsigned_char);
+		break;
+	case DX_HASH_HALF_MD4_UNSIGNED:
+		unsigned_char = 1;
+		/* fall through */
+	case DX_HASH_HALF_MD4:
+		for (p = name; len > 0; len -= 32, p += 32) {
+			str2hashbuf(p, len, in, 8, unsigned_char);
+			half_md4_transform(buf, in);
+		}
+		*hash = buf[1];
+		break;
+	case DX_HASH_TEA_UNSIGNED:
+		unsigned_char = 1;
+		/* fall through */
+	case DX_HASH_TEA:
+		for (p = name; len > 0; len -= 16, p += 16) {
+			str2hashbuf(p, len, in, 4, unsigned_char);
+			tea_transform(buf, in);
+		}
+		*hash = buf[0];
+		break;
+	default:
+		return -1;
+	}
+
+	*hash &= ~1;
+	if (*hash == (EXT4_HTREE_EOF_32BIT << 1))
+		*hash = (EXT4_HTREE_EOF_32BIT - 1) << 1;
+
+	return 0;
+}
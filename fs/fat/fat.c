@@ -18,6 +18,7 @@
 #include <part.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <div64.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
 
@@ -60,10 +61,36 @@ static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 	return ret;
 }
 
+static void disk_init_request(struct blk_request *req, __u32 block,
+			      __u32 nr_blocks, void *buf)
+{
+	blk_init_request(req, BLK_REQ_READ, cur_part_info.start + block,
+			 nr_blocks, buf);
+}
+
+static int disk_submit(struct blk_request *req)
+{
+	if (!cur_dev)
+		return -1;
+
+	return blk_submit(cur_dev, req);
+}
+
+static int disk_run_queue(void)
+{
+	if (!cur_dev)
+		return -1;
+
+	return blk_run_queue(cur_dev);
+}
+
+static void fat_umount(void);
+
 int fat_set_blk_dev(struct blk_desc *dev_desc, disk_partition_t *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	fat_umount();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -172,6 +199,157 @@ int flush_dirty_fat_buffer(fsdata *mydata)
 }
 #endif
 
+/*
+ * Set up the FAT cache once the FAT geometry in 'mydata' is known.
+ * Windows are carved from a single buffer, so that in whole-FAT mode
+ * window n holds FAT sectors [n * FATBUFBLOCKS, (n + 1) * FATBUFBLOCKS).
+ */
+static int fat_cache_init(fsdata *mydata)
+{
+	__u32 whole = (CONFIG_FS_FAT_CACHE_WHOLE_KB * 1024) / mydata->sect_size;
+	int wins = CONFIG_FS_FAT_CACHE_WINDOWS;
+	__u8 *buf = NULL;
+	int i;
+
+	mydata->fatwhole = 0;
+	if (mydata->fatlength && mydata->fatlength <= whole) {
+		wins = DIV_ROUND_UP(mydata->fatlength, FATBUFBLOCKS);
+		buf = memalign(ARCH_DMA_MINALIGN, wins * FATBUFSIZE);
+		if (buf)
+			mydata->fatwhole = 1;
+		else
+			wins = CONFIG_FS_FAT_CACHE_WINDOWS;
+	}
+
+	if (wins < 1)
+		wins = 1;
+	if (!buf)
+		buf = memalign(ARCH_DMA_MINALIGN, wins * FATBUFSIZE);
+	mydata->fatwin = calloc(wins, sizeof(*mydata->fatwin));
+	if (!buf || !mydata->fatwin) {
+		free(buf);
+		free(mydata->fatwin);
+		mydata->fatwin = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < wins; i++) {
+		mydata->fatwin[i].buf = buf + i * FATBUFSIZE;
+		mydata->fatwin[i].num = -1;
+	}
+	mydata->fatwins = wins;
+	mydata->fatstamp = 0;
+	mydata->fatcur = NULL;
+	mydata->fatbuf = NULL;
+	mydata->fatbufnum = -1;
+
+	debug("FAT cache: %d windows%s\n", wins,
+	      mydata->fatwhole ? ", whole FAT" : "");
+
+	return 0;
+}
+
+static void fat_cache_free(fsdata *mydata)
+{
+	if (mydata->fatwin)
+		free(mydata->fatwin[0].buf);
+	free(mydata->fatwin);
+	mydata->fatwin = NULL;
+	mydata->fatbuf = NULL;
+}
+
+/*
+ * Return the cache window holding window 'bufnum' of the FAT, or NULL
+ */
+static struct fat_window *fat_cache_find(fsdata *mydata, __u32 bufnum)
+{
+	struct fat_window *win;
+	int i;
+
+	if (mydata->fatwhole) {
+		if (bufnum >= mydata->fatwins)
+			return NULL;
+		win = &mydata->fatwin[bufnum];
+		return win->num == bufnum ? win : NULL;
+	}
+
+	for (i = 0; i < mydata->fatwins; i++) {
+		win = &mydata->fatwin[i];
+		if (win->num == bufnum)
+			return win;
+	}
+
+	return NULL;
+}
+
+/*
+ * Make window 'bufnum' of the FAT the current fatbuf. A window that is
+ * not cached replaces the least recently used one; if that window is
+ * dirty, all dirty windows are written back together first. In
+ * whole-FAT mode the first miss reads the complete table at once.
+ */
+static int fat_cache_select(fsdata *mydata, __u32 bufnum)
+{
+	struct fat_window *win, *lru = NULL;
+	__u32 startblock, getsize;
+	int i;
+
+	if (bufnum == mydata->fatbufnum)
+		return 0;
+
+	win = fat_cache_find(mydata, bufnum);
+	if (win)
+		goto found;
+
+	if (mydata->fatwhole) {
+		if (bufnum >= mydata->fatwins)
+			return -1;
+
+		if (disk_read(mydata->fat_sect, mydata->fatlength,
+			      mydata->fatwin[0].buf) < 0) {
+			debug("Error reading FAT blocks\n");
+			return -1;
+		}
+		for (i = 0; i < mydata->fatwins; i++)
+			mydata->fatwin[i].num = i;
+		win = &mydata->fatwin[bufnum];
+		goto found;
+	}
+
+	for (i = 0; i < mydata->fatwins; i++) {
+		win = &mydata->fatwin[i];
+		if (!lru || win->stamp < lru->stamp)
+			lru = win;
+	}
+	win = lru;
+
+	/* Write back the dirty windows to the disk */
+	if (win->dirty && flush_dirty_fat_buffer(mydata) < 0)
+		return -1;
+
+	startblock = bufnum * FATBUFBLOCKS;
+	getsize = FATBUFBLOCKS;
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > mydata->fatlength)
+		getsize = mydata->fatlength - startblock;
+
+	win->num = -1;
+	mydata->fatbufnum = -1;
+	if (disk_read(mydata->fat_sect + startblock, getsize, win->buf) < 0) {
+		debug("Error reading FAT blocks\n");
+		return -1;
+	}
+	win->num = bufnum;
+
+found:
+	win->stamp = ++mydata->fatstamp;
+	mydata->fatcur = win;
+	mydata->fatbuf = win->buf;
+	mydata->fatbufnum = bufnum;
+
+	return 0;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -210,28 +388,8 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	       mydata->fatsize, entry, entry, offset, offset);
 
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	if (fat_cache_select(mydata, bufnum) < 0)
+		return ret;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
@@ -292,6 +450,29 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 			buffer += mydata->sect_size;
 			size -= mydata->sect_size;
 		}
+	} else if (size % mydata->sect_size) {
+		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+		struct blk_request req[2];
+
+		/*
+		 * Queue the whole sectors and the partial one together, so
+		 * that the block layer can merge them into a single transfer.
+		 */
+		idx = size / mydata->sect_size;
+		disk_init_request(&req[0], startsect, idx, buffer);
+		disk_init_request(&req[1], startsect + idx, 1, tmpbuf);
+		if ((idx && disk_submit(&req[0]) < 0) ||
+		    disk_submit(&req[1]) < 0 || disk_run_queue() < 0 ||
+		    req[0].result != idx || req[1].result != 1) {
+			debug("Error reading data (got %ld, %ld)\n",
+			      req[0].result, req[1].result);
+			return -1;
+		}
+
+		idx *= mydata->sect_size;
+		memcpy(buffer + idx, tmpbuf, size - idx);
+
+		return 0;
 	} else {
 		idx = size / mydata->sect_size;
 		ret = disk_read(startsect, idx, buffer);
@@ -319,6 +500,158 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/*
+ * Cluster chains of recently read files, resolved into runs of contiguous
+ * clusters. A map is kept across reads, so that reading a file at an
+ * offset does not walk the chain from the first cluster again. Maps are
+ * extended on demand. A map is only used while the change_seq of its
+ * device is unchanged, and all are dropped when a FAT filesystem is
+ * written.
+ */
+#define FAT_EXTENT_FILES	4
+
+struct fat_extent {
+	__u32	fclust;		/* Index of the first cluster in the file */
+	__u32	clust;		/* First cluster of the run */
+	__u32	count;		/* Number of clusters in the run */
+};
+
+struct fat_extent_map {
+	struct blk_desc *dev;	/* Device of the file, NULL if unused */
+	unsigned long change_seq; /* dev->change_seq when mapped */
+	lbaint_t part_start;	/* Partition of the file */
+	__u32	vol_id;		/* Volume serial number */
+	__u32	start;		/* First cluster of the file */
+	__u32	size;		/* Size of the file in bytes */
+	__u32	nclust;		/* Number of clusters resolved */
+	int	count;		/* Number of extents in use */
+	int	alloc;		/* Number of extents allocated */
+	struct fat_extent *ext;
+	__u32	stamp;		/* Last use, for LRU replacement */
+};
+
+static struct fat_extent_map fat_extent_maps[FAT_EXTENT_FILES];
+static __u32 fat_extent_clock;
+
+static void fat_extent_invalidate(void)
+{
+	struct fat_extent_map *map;
+	int i;
+
+	for (i = 0; i < FAT_EXTENT_FILES; i++) {
+		map = &fat_extent_maps[i];
+		free(map->ext);
+		memset(map, 0, sizeof(*map));
+	}
+}
+
+/*
+ * Return the extent map of the file starting at cluster 'start', set up
+ * an empty one if the file is not known.
+ */
+static struct fat_extent_map *fat_extent_get(fsdata *mydata, __u32 start,
+					     __u32 size)
+{
+	struct fat_extent_map *map, *lru = NULL;
+	int i;
+
+	for (i = 0; i < FAT_EXTENT_FILES; i++) {
+		map = &fat_extent_maps[i];
+		if (map->dev == cur_dev &&
+		    map->change_seq == cur_dev->change_seq &&
+		    map->part_start == cur_part_info.start &&
+		    map->vol_id == mydata->vol_id &&
+		    map->start == start && map->size == size)
+			goto found;
+		if (!lru || map->stamp < lru->stamp)
+			lru = map;
+	}
+
+	map = lru;
+	map->dev = cur_dev;
+	map->change_seq = cur_dev->change_seq;
+	map->part_start = cur_part_info.start;
+	map->vol_id = mydata->vol_id;
+	map->start = start;
+	map->size = size;
+	map->nclust = 0;
+	map->count = 0;
+found:
+	map->stamp = ++fat_extent_clock;
+
+	return map;
+}
+
+/*
+ * Follow the cluster chain until the first 'nclust' clusters of the file
+ * are mapped. Return the number of clusters mapped, which is less than
+ * 'nclust' if the chain ends early, or -1 on fatal errors.
+ */
+static int fat_extent_resolve(fsdata *mydata, struct fat_extent_map *map,
+			      __u32 nclust)
+{
+	struct fat_extent *ext;
+	__u32 clust;
+	int alloc;
+
+	while (map->nclust < nclust) {
+		if (map->count) {
+			ext = &map->ext[map->count - 1];
+			clust = get_fatent(mydata, ext->clust + ext->count - 1);
+		} else {
+			clust = map->start;
+		}
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			debug("Invalid FAT entry\n");
+			break;
+		}
+
+		ext = map->count ? &map->ext[map->count - 1] : NULL;
+		if (!ext || ext->clust + ext->count != clust) {
+			if (map->count == map->alloc) {
+				alloc = map->alloc ? map->alloc * 2 : 16;
+				ext = realloc(map->ext, alloc * sizeof(*ext));
+				if (!ext) {
+					printf("Error: allocating memory\n");
+					return -1;
+				}
+				map->ext = ext;
+				map->alloc = alloc;
+			}
+			ext = &map->ext[map->count++];
+			ext->fclust = map->nclust;
+			ext->clust = clust;
+			ext->count = 0;
+		}
+
+		ext->count++;
+		map->nclust++;
+	}
+
+	return map->nclust;
+}
+
+/*
+ * Return the extent holding cluster 'fclust' of the file, which must
+ * already be mapped
+ */
+static struct fat_extent *fat_extent_find(struct fat_extent_map *map,
+					  __u32 fclust)
+{
+	int lo = 0, hi = map->count - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (map->ext[mid].fclust <= fclust)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return &map->ext[lo];
+}
+
 /*
  * Read at most 'maxsize' bytes from 'pos' in the file associated with 'dentptr'
  * into 'buffer'.
@@ -332,9 +665,11 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	struct fat_extent_map *map;
+	struct fat_extent *ext;
+	__u32 fclust, nclust;
+	loff_t actsize, offset;
+	int ret;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -349,92 +684,57 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
+	/* map the clusters up to the end of the read */
+	map = fat_extent_get(mydata, START(dentptr), FAT2CPU32(dentptr->size));
+	nclust = lldiv(filesize + bytesperclust - 1, bytesperclust);
+	ret = fat_extent_resolve(mydata, map, nclust);
+	if (ret < 0)
+		return -1;
+	if (ret < nclust) {
+		/* read up to the broken link, like the chain walk did */
+		filesize = (loff_t)ret * bytesperclust;
+		if (pos >= filesize)
 			return 0;
-		}
-		actsize += bytesperclust;
 	}
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
+	fclust = lldiv(pos, bytesperclust);
+	offset = pos - (loff_t)fclust * bytesperclust;
 
 	/* align to beginning of next cluster if any */
-	if (pos) {
-		actsize = min(filesize, (loff_t)bytesperclust);
-		if (get_cluster(mydata, curclust, get_contents_vfatname_block,
+	if (offset) {
+		ext = fat_extent_find(map, fclust);
+		actsize = min(filesize - (pos - offset), (loff_t)bytesperclust);
+		if (get_cluster(mydata, ext->clust + fclust - ext->fclust,
+				get_contents_vfatname_block,
 				(int)actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, get_contents_vfatname_block + pos, actsize);
+		actsize -= offset;
+		memcpy(buffer, get_contents_vfatname_block + offset, actsize);
 		*gotsize += actsize;
-		if (!filesize)
-			return 0;
 		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
+		pos += actsize;
+		fclust++;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+	/* read each run of contiguous clusters at once */
+	while (pos < filesize) {
+		ext = fat_extent_find(map, fclust);
+		nclust = ext->count - (fclust - ext->fclust);
+		actsize = min((loff_t)nclust * bytesperclust, filesize - pos);
+		if (get_cluster(mydata, ext->clust + fclust - ext->fclust,
+				buffer, (unsigned long)actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
 		buffer += actsize;
+		pos += actsize;
+		fclust += nclust;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -808,39 +1108,64 @@ exit:
 	return ret;
 }
 
-__u8 do_fat_read_at_block[MAX_CLUSTSIZE]
-	__aligned(ARCH_DMA_MINALIGN);
+/*
+ * The volume of cur_dev stays mounted between reads: its geometry, FAT
+ * cache and cluster extents are kept until fat_close(), the next
+ * fat_set_blk_dev() or a change of the device content.
+ */
+static fsdata fat_mount_data;
+static int fat_mounted;
+static unsigned long fat_mount_seq;
 
-int do_fat_read_at(const char *filename, loff_t pos, void *buffer,
-		   loff_t maxsize, int dols, int dogetsize, loff_t *size)
+/*
+ * Directory entry of the file last found by do_fat_read_at(), and of the
+ * file opened by fat_open_file() together with the volume holding it. The
+ * opened file survives a remount of its volume, e.g. after another
+ * partition of the device was written.
+ */
+static dir_entry fat_found_dent;
+static struct {
+	int opened;
+	dir_entry dent;
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	__u32 vol_id;
+} fat_file;
+
+static void fat_umount(void)
 {
-	char fnamecopy[2048];
+	if (!fat_mounted)
+		return;
+
+	fat_cache_free(&fat_mount_data);
+	fat_extent_invalidate();
+	fat_mounted = 0;
+}
+
+/*
+ * Return the mounted volume of cur_dev, reading its boot sector unless
+ * that was done since the device last changed. Return NULL on errors.
+ */
+static fsdata *fat_mount(void)
+{
+	fsdata *mydata = &fat_mount_data;
 	boot_sector bs;
 	volume_info volinfo;
-	fsdata datablock;
-	fsdata *mydata = &datablock;
-	dir_entry *dentptr = NULL;
-	__u16 prevcksum = 0xffff;
-	char *subname = "";
-	__u32 cursect;
-	int idx, isdir = 0;
-	int files = 0, dirs = 0;
-	int ret = -1;
-	int firsttime;
-	__u32 root_cluster = 0;
-	__u32 read_blk;
-	int rootdir_size = 0;
-	int buffer_blk_cnt;
-	int do_read;
-	__u8 *dir_ptr;
+
+	if (fat_mounted && cur_dev && fat_mount_seq == cur_dev->change_seq)
+		return mydata;
+
+	fat_umount();
+	memset(mydata, 0, sizeof(*mydata));
 
 	if (read_bootsectandvi(&bs, &volinfo, &mydata->fatsize)) {
 		debug("Error: reading boot sector\n");
-		return -1;
+		return NULL;
 	}
+	memcpy(&mydata->vol_id, volinfo.volume_id, sizeof(mydata->vol_id));
 
 	if (mydata->fatsize == 32) {
-		root_cluster = bs.root_cluster;
+		mydata->root_cluster = bs.root_cluster;
 		mydata->fatlength = bs.fat32_length;
 	} else {
 		mydata->fatlength = bs.fat_length;
@@ -848,36 +1173,32 @@ int do_fat_read_at(const char *filename, loff_t pos, void *buffer,
 
 	mydata->fat_sect = bs.reserved;
 
-	cursect = mydata->rootdir_sect
-		= mydata->fat_sect + mydata->fatlength * bs.fats;
+	mydata->rootdir_sect = mydata->fat_sect + mydata->fatlength * bs.fats;
 
 	mydata->sect_size = (bs.sector_size[1] << 8) + bs.sector_size[0];
 	mydata->clust_size = bs.cluster_size;
 	if (mydata->sect_size != cur_part_info.blksz) {
 		printf("Error: FAT sector size mismatch (fs=%hu, dev=%lu)\n",
 				mydata->sect_size, cur_part_info.blksz);
-		return -1;
+		return NULL;
 	}
 
 	if (mydata->fatsize == 32) {
 		mydata->data_begin = mydata->rootdir_sect -
 					(mydata->clust_size * 2);
 	} else {
-		rootdir_size = ((bs.dir_entries[1]  * (int)256 +
-				 bs.dir_entries[0]) *
-				 sizeof(dir_entry)) /
-				 mydata->sect_size;
+		mydata->rootdir_size = ((bs.dir_entries[1]  * (int)256 +
+					 bs.dir_entries[0]) *
+					 sizeof(dir_entry)) /
+					 mydata->sect_size;
 		mydata->data_begin = mydata->rootdir_sect +
-					rootdir_size -
+					mydata->rootdir_size -
 					(mydata->clust_size * 2);
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN, FATBUFSIZE);
-	if (mydata->fatbuf == NULL) {
+	if (fat_cache_init(mydata)) {
 		debug("Error: allocating memory\n");
-		return -1;
+		return NULL;
 	}
 
 	if (vfat_enabled)
@@ -887,12 +1208,49 @@ int do_fat_read_at(const char *filename, loff_t pos, void *buffer,
 	       mydata->fatsize, mydata->fat_sect, mydata->fatlength);
 	debug("Rootdir begins at cluster: %d, sector: %d, offset: %x\n"
 	       "Data begins at: %d\n",
-	       root_cluster,
+	       mydata->root_cluster,
 	       mydata->rootdir_sect,
 	       mydata->rootdir_sect * mydata->sect_size, mydata->data_begin);
 	debug("Sector size: %d, cluster size: %d\n", mydata->sect_size,
 	      mydata->clust_size);
 
+	fat_mount_seq = cur_dev->change_seq;
+	fat_mounted = 1;
+
+	return mydata;
+}
+
+__u8 do_fat_read_at_block[MAX_CLUSTSIZE]
+	__aligned(ARCH_DMA_MINALIGN);
+
+int do_fat_read_at(const char *filename, loff_t pos, void *buffer,
+		   loff_t maxsize, int dols, int dogetsize, loff_t *size)
+{
+	char fnamecopy[2048];
+	fsdata *mydata;
+	dir_entry *dentptr = NULL;
+	__u16 prevcksum = 0xffff;
+	char *subname = "";
+	__u32 cursect;
+	int idx, isdir = 0;
+	int files = 0, dirs = 0;
+	int ret = -1;
+	int firsttime;
+	__u32 root_cluster = 0;
+	__u32 read_blk;
+	int rootdir_size = 0;
+	int buffer_blk_cnt;
+	int do_read;
+	__u8 *dir_ptr;
+
+	mydata = fat_mount();
+	if (!mydata)
+		return -1;
+
+	root_cluster = mydata->root_cluster;
+	rootdir_size = mydata->rootdir_size;
+	cursect = mydata->rootdir_sect;
+
 	/* "cwd" is always the root... */
 	while (ISDIRDELIM(*filename))
 		filename++;
@@ -1221,6 +1579,7 @@ rootdir_done:
 
 	if (dogetsize) {
 		*size = FAT2CPU32(dentptr->size);
+		fat_found_dent = *dentptr;
 		ret = 0;
 	} else {
 		ret = get_contents(mydata, dentptr, pos, buffer, maxsize, size);
@@ -1228,7 +1587,6 @@ rootdir_done:
 	debug("Size: %u, got: %llu\n", FAT2CPU32(dentptr->size), *size);
 
 exit:
-	free(mydata->fatbuf);
 	return ret;
 }
 
@@ -1353,6 +1711,43 @@ int fat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 	return ret;
 }
 
+int fat_open_file(const char *filename, loff_t *size)
+{
+	fat_file.opened = 0;
+	if (do_fat_read_at(filename, 0, NULL, 0, LS_NO, 1, size))
+		return -1;
+
+	fat_file.dent = fat_found_dent;
+	fat_file.dev = cur_dev;
+	fat_file.part_start = cur_part_info.start;
+	fat_file.vol_id = fat_mount_data.vol_id;
+	fat_file.opened = 1;
+
+	return 0;
+}
+
+int fat_read_next(void *buf, loff_t pos, loff_t len, loff_t *actread)
+{
+	fsdata *mydata = fat_mount();
+
+	if (!mydata || !fat_file.opened)
+		return -1;
+
+	/* another volume was selected since the file was opened */
+	if (fat_file.dev != cur_dev ||
+	    fat_file.part_start != cur_part_info.start ||
+	    fat_file.vol_id != mydata->vol_id)
+		return -1;
+
+	return get_contents(mydata, &fat_file.dent, pos, buf, len, actread);
+}
+
+void fat_close_file(void)
+{
+	fat_file.opened = 0;
+}
+
 void fat_close(void)
 {
+	fat_umount();
 }
@@ -102,25 +102,12 @@ static void set_name(dir_entry *dirent, const char *filename)
 
 static __u8 num_of_fats;
 /*
- * Write fat buffer into block device
+ * Write 'getsize' FAT sectors starting at FAT sector 'startblock' to all
+ * copies of the FAT
  */
-static int flush_dirty_fat_buffer(fsdata *mydata)
+static int write_fat_blocks(fsdata *mydata, __u32 startblock, __u32 getsize,
+			    __u8 *bufptr)
 {
-	int getsize = FATBUFBLOCKS;
-	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
-
-	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
-	      (int)mydata->fat_dirty);
-
-	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
-		return 0;
-
-	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-	if (startblock + getsize > fatlength)
-		getsize = fatlength - startblock;
-
 	startblock += mydata->fat_sect;
 
 	/* Write FAT buf */
@@ -137,11 +124,81 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 			return -1;
 		}
 	}
-	mydata->fat_dirty = 0;
 
 	return 0;
 }
 
+/*
+ * Write the dirty windows of the FAT cache into block device. Dirty
+ * windows that follow each other in the FAT go out in a single write,
+ * lowest window first.
+ */
+static int flush_dirty_fat_buffer(fsdata *mydata)
+{
+	struct fat_window *first, *win;
+	__u32 fatlength = mydata->fatlength;
+	__u32 startblock, getsize;
+	__u8 *bounce = NULL;
+	__u8 *bufptr;
+	int i, count;
+	int ret = 0;
+
+	for (;;) {
+		first = NULL;
+		for (i = 0; i < mydata->fatwins; i++) {
+			win = &mydata->fatwin[i];
+			if (win->dirty && (!first || win->num < first->num))
+				first = win;
+		}
+		if (!first)
+			break;
+
+		count = 1;
+		while ((win = fat_cache_find(mydata, first->num + count)) &&
+		       win->dirty)
+			count++;
+
+		debug("debug: evicting %d..%d\n", first->num,
+		      first->num + count - 1);
+
+		bufptr = first->buf;
+		if (count > 1 && !mydata->fatwhole) {
+			/* Windows are scattered in memory, gather them */
+			if (!bounce)
+				bounce = memalign(ARCH_DMA_MINALIGN,
+						  mydata->fatwins * FATBUFSIZE);
+			if (bounce) {
+				for (i = 0; i < count; i++) {
+					win = fat_cache_find(mydata,
+							     first->num + i);
+					memcpy(bounce + i * FATBUFSIZE,
+					       win->buf, FATBUFSIZE);
+				}
+				bufptr = bounce;
+			} else {
+				count = 1;
+			}
+		}
+
+		startblock = first->num * FATBUFBLOCKS;
+		getsize = count * FATBUFBLOCKS;
+		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+		if (startblock + getsize > fatlength)
+			getsize = fatlength - startblock;
+
+		if (write_fat_blocks(mydata, startblock, getsize, bufptr) < 0) {
+			ret = -1;
+			break;
+		}
+
+		for (i = 0; i < count; i++)
+			fat_cache_find(mydata, first->num + i)->dirty = 0;
+	}
+
+	free(bounce);
+	return ret;
+}
+
 /*
  * Set the file name information from 'name' into 'slotptr',
  */
@@ -387,30 +444,11 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	}
 
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		startblock += mydata->fat_sect;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return -1;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	if (fat_cache_select(mydata, bufnum) < 0)
+		return -1;
 
 	/* Mark as dirty */
-	mydata->fat_dirty = 1;
+	mydata->fatcur->dirty = 1;
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
@@ -920,6 +958,9 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 	*actwrite = size;
 	dir_curclust = 0;
 
+	/* the FAT and cluster chains may change */
+	fat_umount();
+
 	if (read_bootsectandvi(&bs, &volinfo, &mydata->fatsize)) {
 		debug("error: reading boot sector\n");
 		return -1;
@@ -958,10 +999,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 					(mydata->clust_size * 2);
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN, FATBUFSIZE);
-	if (mydata->fatbuf == NULL) {
+	if (fat_cache_init(mydata)) {
 		debug("Error: allocating memory\n");
 		return -1;
 	}
@@ -1073,7 +1111,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		printf("Error: writing directory entry\n");
 
 exit:
-	free(mydata->fatbuf);
+	fat_cache_free(mydata);
 	return ret;
 }
 
@@ -24,6 +24,40 @@ static struct blk_desc *fs_dev_desc;
 static disk_partition_t fs_partition;
 static int fs_type = FS_TYPE_ANY;
 
+/*
+ * The filesystem last probed on a block device stays mounted between
+ * commands, so that e.g. 'test -e', 'size' and 'load' on one partition
+ * only parse its superblock once. The filesystem drivers keep their state
+ * in globals, hence a single mount is cached. It is dropped when another
+ * partition is selected, when the device changes (see blk_changed()) and
+ * by fs_flush().
+ */
+static struct {
+	int fstype;			/* FS_TYPE_ANY if nothing is mounted */
+	struct blk_desc *dev_desc;
+	enum if_type if_type;
+	int devnum;
+	int hwpart;
+	unsigned long change_seq;
+	lbaint_t part_start;
+	lbaint_t part_size;
+} fs_mount = {
+	.fstype = FS_TYPE_ANY,
+};
+
+/*
+ * The file opened by fs_open_file(). The filesystem driver keeps the
+ * resolved file (directory entry, inode) so that reading on does not look
+ * up the path again; the position is tracked here.
+ */
+static struct {
+	int fstype;			/* FS_TYPE_ANY if no file is open */
+	loff_t pos;
+	loff_t size;
+} fs_file = {
+	.fstype = FS_TYPE_ANY,
+};
+
 static inline int fs_probe_unsupported(struct blk_desc *fs_dev_desc,
 				      disk_partition_t *fs_partition)
 {
@@ -60,6 +94,18 @@ static inline int fs_write_unsupported(const char *filename, void *buf,
 	return -1;
 }
 
+static inline int fs_open_file_unsupported(const char *filename,
+					    loff_t *size)
+{
+	return -1;
+}
+
+static inline int fs_read_next_unsupported(void *buf, loff_t pos, loff_t len,
+					   loff_t *actread)
+{
+	return -1;
+}
+
 static inline void fs_close_unsupported(void)
 {
 }
@@ -92,6 +138,10 @@ struct fstype_info {
 		     loff_t len, loff_t *actwrite);
 	void (*close)(void);
 	int (*uuid)(char *uuid_str);
+	/* read a file in chunks, see fs_open_file() */
+	int (*open_file)(const char *filename, loff_t *size);
+	int (*read_next)(void *buf, loff_t pos, loff_t len, loff_t *actread);
+	void (*close_file)(void);
 };
 
 static struct fstype_info fstypes[] = {
@@ -112,6 +162,9 @@ static struct fstype_info fstypes[] = {
 		.write = fs_write_unsupported,
 #endif
 		.uuid = fs_uuid_unsupported,
+		.open_file = fat_open_file,
+		.read_next = fat_read_next,
+		.close_file = fat_close_file,
 	},
 #endif
 #ifdef CONFIG_FS_EXT4
@@ -131,6 +184,9 @@ static struct fstype_info fstypes[] = {
 		.write = fs_write_unsupported,
 #endif
 		.uuid = ext4fs_uuid,
+		.open_file = ext4fs_open_file,
+		.read_next = ext4fs_read_next,
+		.close_file = ext4fs_close_file,
 	},
 #endif
 #ifdef CONFIG_SANDBOX
@@ -146,6 +202,9 @@ static struct fstype_info fstypes[] = {
 		.read = fs_read_sandbox,
 		.write = fs_write_sandbox,
 		.uuid = fs_uuid_unsupported,
+		.open_file = fs_open_file_unsupported,
+		.read_next = fs_read_next_unsupported,
+		.close_file = fs_close_unsupported,
 	},
 #endif
 #ifdef CONFIG_CMD_UBIFS
@@ -161,6 +220,9 @@ static struct fstype_info fstypes[] = {
 		.read = ubifs_read,
 		.write = fs_write_unsupported,
 		.uuid = fs_uuid_unsupported,
+		.open_file = ubifs_open_file,
+		.read_next = ubifs_read_next,
+		.close_file = ubifs_close_file,
 	},
 #endif
 	{
@@ -175,6 +237,9 @@ static struct fstype_info fstypes[] = {
 		.read = fs_read_unsupported,
 		.write = fs_write_unsupported,
 		.uuid = fs_uuid_unsupported,
+		.open_file = fs_open_file_unsupported,
+		.read_next = fs_read_next_unsupported,
+		.close_file = fs_close_unsupported,
 	},
 };
 
@@ -192,6 +257,35 @@ static struct fstype_info *fs_get_info(int fstype)
 	return info;
 }
 
+/* Check that the cached mount is on the partition just selected */
+static bool fs_mount_valid(void)
+{
+	return fs_mount.fstype != FS_TYPE_ANY && fs_dev_desc &&
+	       fs_mount.dev_desc == fs_dev_desc &&
+	       fs_mount.if_type == fs_dev_desc->if_type &&
+	       fs_mount.devnum == fs_dev_desc->devnum &&
+	       fs_mount.hwpart == fs_dev_desc->hwpart &&
+	       fs_mount.change_seq == fs_dev_desc->change_seq &&
+	       fs_mount.part_start == fs_partition.start &&
+	       fs_mount.part_size == fs_partition.size;
+}
+
+static void fs_mount_save(void)
+{
+	/* virtual filesystems are not cached */
+	if (!fs_dev_desc)
+		return;
+
+	fs_mount.fstype = fs_type;
+	fs_mount.dev_desc = fs_dev_desc;
+	fs_mount.if_type = fs_dev_desc->if_type;
+	fs_mount.devnum = fs_dev_desc->devnum;
+	fs_mount.hwpart = fs_dev_desc->hwpart;
+	fs_mount.change_seq = fs_dev_desc->change_seq;
+	fs_mount.part_start = fs_partition.start;
+	fs_mount.part_size = fs_partition.size;
+}
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -218,6 +312,13 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	if (fs_mount_valid() &&
+	    (fstype == FS_TYPE_ANY || fstype == fs_mount.fstype)) {
+		fs_type = fs_mount.fstype;
+		return 0;
+	}
+	fs_flush();
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -228,6 +329,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
+			fs_mount_save();
 			return 0;
 		}
 	}
@@ -235,10 +337,33 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	return -1;
 }
 
+void fs_flush(void)
+{
+	struct fstype_info *info;
+
+	fs_close_file();
+
+	if (fs_mount.fstype == FS_TYPE_ANY)
+		return;
+
+	info = fs_get_info(fs_mount.fstype);
+	fs_mount.fstype = FS_TYPE_ANY;
+	info->close();
+}
+
 static void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
+	/* keep the filesystem mounted for the next command */
+	if (fs_type != FS_TYPE_ANY && fs_type == fs_mount.fstype &&
+	    fs_mount_valid()) {
+		fs_type = FS_TYPE_ANY;
+		return;
+	}
+
+	if (fs_type == fs_mount.fstype)
+		fs_mount.fstype = FS_TYPE_ANY;
 	info->close();
 
 	fs_type = FS_TYPE_ANY;
@@ -259,7 +384,6 @@ int fs_ls(const char *dirname)
 
 	ret = info->ls(dirname);
 
-	fs_type = FS_TYPE_ANY;
 	fs_close();
 
 	return ret;
@@ -334,6 +458,70 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	return ret;
 }
 
+int fs_open_file(const char *filename, loff_t *size)
+{
+	struct fstype_info *info = fs_get_info(fs_type);
+	int ret;
+
+	/* drop a file still open, its filesystem has been selected again */
+	if (fs_file.fstype != FS_TYPE_ANY) {
+		fs_get_info(fs_file.fstype)->close_file();
+		fs_file.fstype = FS_TYPE_ANY;
+	}
+
+	ret = info->open_file(filename, size);
+	if (ret) {
+		printf("** Unable to open file %s **\n", filename);
+		fs_close();
+		return -1;
+	}
+
+	fs_file.fstype = fs_type;
+	fs_file.pos = 0;
+	fs_file.size = *size;
+
+	return 0;
+}
+
+int fs_read_next(ulong addr, loff_t len, loff_t *actread)
+{
+	struct fstype_info *info = fs_get_info(fs_file.fstype);
+	void *buf;
+	int ret;
+
+	*actread = 0;
+	if (fs_file.fstype == FS_TYPE_ANY)
+		return -1;
+
+	if (len > fs_file.size - fs_file.pos)
+		len = fs_file.size - fs_file.pos;
+	if (!len)
+		return 0;
+
+	buf = map_sysmem(addr, len);
+	ret = info->read_next(buf, fs_file.pos, len, actread);
+	unmap_sysmem(buf);
+	if (ret)
+		return -1;
+
+	fs_file.pos += *actread;
+
+	return 0;
+}
+
+void fs_close_file(void)
+{
+	struct fstype_info *info;
+
+	if (fs_file.fstype == FS_TYPE_ANY)
+		return;
+
+	info = fs_get_info(fs_file.fstype);
+	fs_file.fstype = FS_TYPE_ANY;
+	info->close_file();
+	fs_close();
+}
+
 int do_size(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 		int fstype)
 {
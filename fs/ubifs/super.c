@@ -117,6 +117,23 @@ void iput(struct inode *inode)
 	inodes_locked_down[i] = ino;
 }
 
+/*
+ * Free the inodes locked down for a superblock being unmounted
+ */
+static void unlock_inodes(struct super_block *sb)
+{
+	int i, j = 0;
+
+	for (i = 0; i < INODE_LOCKED_MAX && inodes_locked_down[i]; i++) {
+		if (inodes_locked_down[i]->i_sb == sb)
+			free(inodes_locked_down[i]);
+		else
+			inodes_locked_down[j++] = inodes_locked_down[i];
+	}
+	while (j < i)
+		inodes_locked_down[j++] = NULL;
+}
+
 /* from fs/inode.c */
 /**
  * clear_nlink - directly zero an inode's link count
@@ -262,7 +279,8 @@ struct inode *ubifs_iget(struct super_block *sb, unsigned long inum)
 		if (inodes_locked_down[i] == NULL)
 			break;
 
-		if (inodes_locked_down[i]->i_ino == inum) {
+		if (inodes_locked_down[i]->i_ino == inum &&
+		    inodes_locked_down[i]->i_sb == sb) {
 			/*
 			 * We found the locked down inode in our array,
 			 * so just return this pointer instead of creating
@@ -1732,9 +1750,9 @@ void ubifs_umount(struct ubifs_info *c)
 #ifndef __UBOOT__
 	if (c->bgt)
 		kthread_stop(c->bgt);
+#endif
 
 	destroy_journal(c);
-#endif
 	free_wbufs(c);
 	free_orphans(c);
 	ubifs_lpt_free(c, 0);
@@ -1748,13 +1766,6 @@ void ubifs_umount(struct ubifs_info *c)
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
 	ubifs_debugging_exit(c);
-#ifdef __UBOOT__
-	/* Finally free U-Boot's global copy of superblock */
-	if (ubifs_sb != NULL) {
-		free(ubifs_sb->s_fs_info);
-		free(ubifs_sb);
-	}
-#endif
 }
 
 #ifndef __UBOOT__
@@ -2277,6 +2288,9 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 		goto out_bdi;
 
 	sb->s_bdi = &c->bdi;
+#else
+	/* Files are read with bulk-reads of the data nodes */
+	c->bulk_read = 1;
 #endif
 	sb->s_fs_info = c;
 	sb->s_magic = UBIFS_SUPER_MAGIC;
@@ -2498,6 +2512,9 @@ static struct dentry *ubifs_mount(struct file_system_type *fs_type, int flags,
 	ubi_close_volume(ubi);
 
 #ifdef __UBOOT__
+	/* The file opened on the previous current volume is closed */
+	if (sb != ubifs_sb)
+		ubifs_close_file();
 	ubifs_sb = sb;
 	return 0;
 #else
@@ -2507,6 +2524,9 @@ static struct dentry *ubifs_mount(struct file_system_type *fs_type, int flags,
 out_deact:
 #ifndef __UBOOT__
 	deactivate_locked_super(sb);
+#else
+	kfree(sb->s_fs_info);
+	kfree(sb);
 #endif
 out_close:
 	ubi_close_volume(ubi);
@@ -2677,30 +2697,120 @@ MODULE_VERSION(__stringify(UBIFS_VERSION));
 MODULE_AUTHOR("Artem Bityutskiy, Adrian Hunter");
 MODULE_DESCRIPTION("UBIFS - UBI File System");
 #else
+/*
+ * Volumes stay mounted, with their TNC and LPT caches, until they are
+ * unmounted or the UBI device is detached, so that switching between them
+ * does not replay the journal and rebuild the TNC each time. The mounts are
+ * kept most recently used first; the first one is the current volume, the
+ * one the ubifs commands work on. The least recently used volumes are
+ * unmounted when there are too many, or when the TNC they cache takes more
+ * than CONFIG_UBIFS_MAX_CACHE bytes.
+ */
+static struct super_block *ubifs_mounts[CONFIG_UBIFS_MAX_MOUNTS];
+static int ubifs_mount_cnt;
+
+/* Bytes of memory taken by the TNC cached for a mounted volume */
+static unsigned long tnc_cache_size(struct super_block *sb)
+{
+	struct ubifs_info *c = sb->s_fs_info;
+
+	return atomic_long_read(&c->clean_zn_cnt) * c->max_znode_sz;
+}
+
+/*
+ * Makes mount i the current volume. The file opened on the previous current
+ * volume is closed, as file reads go through the current volume.
+ */
+static void use_mount(int i)
+{
+	struct super_block *sb = ubifs_mounts[i];
+
+	if (sb != ubifs_sb)
+		ubifs_close_file();
+	for (; i > 0; i--)
+		ubifs_mounts[i] = ubifs_mounts[i - 1];
+	ubifs_mounts[0] = sb;
+	ubifs_sb = sb;
+}
+
+/* Unmounts mount i and frees everything it holds */
+static void drop_mount(int i)
+{
+	struct super_block *sb = ubifs_mounts[i];
+	struct ubifs_info *c = sb->s_fs_info;
+
+	if (sb == ubifs_sb)
+		ubifs_close_file();
+	printf("Unmounting UBIFS volume %s!\n", c->vi.name);
+	ubifs_umount(c);
+	unlock_inodes(sb);
+	kfree(c);
+	kfree(sb);
+
+	for (ubifs_mount_cnt--; i < ubifs_mount_cnt; i++)
+		ubifs_mounts[i] = ubifs_mounts[i + 1];
+	ubifs_mounts[ubifs_mount_cnt] = NULL;
+	ubifs_sb = ubifs_mounts[0];
+}
+
+/* Returns the mount of volume vol_name, or -1 if it is not mounted */
+static int find_mount(const char *vol_name)
+{
+	struct ubi_volume_desc *ubi;
+	struct ubi_volume_info vi;
+	struct ubifs_info *c;
+	int i;
+
+	if (!ubifs_mount_cnt)
+		return -1;
+
+	ubi = open_ubi(vol_name, UBI_READONLY);
+	if (IS_ERR(ubi))
+		return -1;
+	ubi_get_volume_info(ubi, &vi);
+	ubi_close_volume(ubi);
+
+	for (i = 0; i < ubifs_mount_cnt; i++) {
+		c = ubifs_mounts[i]->s_fs_info;
+		if (c->vi.ubi_num == vi.ubi_num && c->vi.vol_id == vi.vol_id)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Unmounts the least recently used volumes to stay within the limits */
+static void trim_mounts(void)
+{
+	unsigned long cached;
+	int i;
+
+	while (ubifs_mount_cnt > 1) {
+		cached = 0;
+		for (i = 1; i < ubifs_mount_cnt; i++)
+			cached += tnc_cache_size(ubifs_mounts[i]);
+		if (cached <= CONFIG_UBIFS_MAX_CACHE)
+			break;
+		drop_mount(ubifs_mount_cnt - 1);
+	}
+}
+
 int uboot_ubifs_mount(char *vol_name)
 {
 	struct dentry *ret;
 	int flags;
+	int i;
 
-#ifdef CONFIG_MTD_UBI_SKIP_REATTACH
-	if (ubifs_sb) {
-		char *vname = strchr(vol_name, ':');
-		const char *mounted_val_name =
-			((struct ubifs_info *)(ubifs_sb->s_fs_info))->vi.name;
-
-		if (vname != NULL && !strcmp(vname + 1, mounted_val_name)) {
-			printf("Skipping mounting already mounted ubifs fs\n");
-			return 0;
-		}
+	i = find_mount(vol_name);
+	if (i >= 0) {
+		debug("Using already mounted UBIFS volume %s\n", vol_name);
+		use_mount(i);
+		return 0;
 	}
-#else
-	/*
-	 * First unmount if allready mounted
-	 */
-	if (ubifs_sb)
-		ubifs_umount(ubifs_sb->s_fs_info);
 
-#endif
+	/* Make room for the new volume */
+	if (ubifs_mount_cnt == CONFIG_UBIFS_MAX_MOUNTS)
+		drop_mount(ubifs_mount_cnt - 1);
 
 	/*
 	 * Mount in read-only mode
@@ -2713,6 +2823,52 @@ int uboot_ubifs_mount(char *vol_name)
 		return -1;
 	}
 
+	ubifs_mounts[ubifs_mount_cnt++] = ubifs_sb;
+	use_mount(ubifs_mount_cnt - 1);
+	trim_mounts();
+
 	return 0;
 }
+
+/* Unmounts the current volume, the previous one becomes current */
+void uboot_ubifs_umount(void)
+{
+	if (ubifs_mount_cnt)
+		drop_mount(0);
+}
+
+/* Unmounts volume vol_id of UBI device ubi_num if it is mounted */
+void uboot_ubifs_drop(int ubi_num, int vol_id)
+{
+	struct ubifs_info *c;
+	int i;
+
+	for (i = 0; i < ubifs_mount_cnt; i++) {
+		c = ubifs_mounts[i]->s_fs_info;
+		if (c->vi.ubi_num == ubi_num && c->vi.vol_id == vol_id) {
+			drop_mount(i);
+			return;
+		}
+	}
+}
+
+/* Unmounts all the volumes, or all but the current one */
+void uboot_ubifs_flush(int all)
+{
+	while (ubifs_mount_cnt > (all ? 0 : 1))
+		drop_mount(ubifs_mount_cnt - 1);
+}
+
+void uboot_ubifs_list(void)
+{
+	struct ubifs_info *c;
+	int i;
+
+	for (i = 0; i < ubifs_mount_cnt; i++) {
+		c = ubifs_mounts[i]->s_fs_info;
+		printf("%c ubi%d:%-16s TNC cache %lu KiB\n", i ? ' ' : '*',
+		       c->vi.ubi_num, c->vi.name,
+		       tnc_cache_size(ubifs_mounts[i]) >> 10);
+	}
+}
 #endif
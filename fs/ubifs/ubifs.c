@@ -681,22 +681,13 @@ static inline void *kmap(struct page *page)
 	return page->addr;
 }
 
-static int read_block(struct inode *inode, void *addr, unsigned int block,
-		      struct ubifs_data_node *dn)
+/* Decompresses data node dn of block to the UBIFS_BLOCK_SIZE bytes at addr */
+static int decode_block(struct ubifs_info *c, struct inode *inode, void *addr,
+			unsigned int block, struct ubifs_data_node *dn)
 {
-	struct ubifs_info *c = inode->i_sb->s_fs_info;
-	int err, len, out_len;
-	union ubifs_key key;
+	int len, out_len;
 	unsigned int dlen;
-
-	data_key_init(c, &key, inode->i_ino, block);
-	err = ubifs_tnc_lookup(c, &key, dn);
-	if (err) {
-		if (err == -ENOENT)
-			/* Not found, so it must be a hole */
-			memset(addr, 0, UBIFS_BLOCK_SIZE);
-		return err;
-	}
+	int err;
 
 	ubifs_assert(le64_to_cpu(dn->ch.sqnum) > ubifs_inode(inode)->creat_sqnum);
 
@@ -728,6 +719,87 @@ dump:
 	return -EINVAL;
 }
 
+static int read_block(struct inode *inode, void *addr, unsigned int block,
+		      struct ubifs_data_node *dn)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	union ubifs_key key;
+	int err;
+
+	data_key_init(c, &key, inode->i_ino, block);
+	err = ubifs_tnc_lookup(c, &key, dn);
+	if (err) {
+		if (err == -ENOENT)
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		return err;
+	}
+
+	return decode_block(c, inode, addr, block, dn);
+}
+
+/*
+ * Reads up to 'count' whole blocks from 'block' on to 'addr' with a bulk-read,
+ * that is, a single read of the data nodes that follow each other in a LEB,
+ * decompressed straight to the destination. Where there is no such run, the
+ * single block is read through the zbranch found by the lookup, instead of
+ * looking it up again. Returns the number of blocks read, 0 if the blocks
+ * are to be read one at a time, or a negative error code.
+ */
+static int read_bulk(struct ubifs_info *c, struct inode *inode, void *addr,
+		     unsigned int block, int count)
+{
+	struct bu_info *bu = &c->bu;
+	int err, i, n = 0;
+	void *node;
+
+	if (!bu->buf || count < 2)
+		return 0;
+
+	data_key_init(c, &bu->key, inode->i_ino, block);
+	bu->buf_len = c->max_bu_buf_len;
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return err;
+
+	if (bu->cnt < 2) {
+		if (!bu->cnt || key_block(c, &bu->zbranch[0].key) != block) {
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+			return 1;
+		}
+
+		err = ubifs_tnc_read_node(c, &bu->zbranch[0], bu->buf);
+		if (!err)
+			err = decode_block(c, inode, addr, block, bu->buf);
+
+		return err ? err : 1;
+	}
+
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err) {
+		/* The blocks are read one at a time instead */
+		ubifs_warn(c, "ignoring error %d and skipping bulk-read", err);
+		return 0;
+	}
+
+	count = min(count, bu->blk_cnt);
+	node = bu->buf;
+	for (i = 0; i < count; i++, block++, addr += UBIFS_BLOCK_SIZE) {
+		if (n < bu->cnt && key_block(c, &bu->zbranch[n].key) == block) {
+			err = decode_block(c, inode, addr, block, node);
+			if (err)
+				return err;
+			node += ALIGN(bu->zbranch[n++].len, 8);
+		} else {
+			/* Not in the bulk-read, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		}
+	}
+
+	return count;
+}
+
 static int do_readpage(struct ubifs_info *c, struct inode *inode,
 		       struct page *page, int last_block_size)
 {
@@ -839,15 +911,17 @@ error:
 	return err;
 }
 
-int ubifs_read(const char *filename, void *buf, loff_t offset,
-	       loff_t size, loff_t *actread)
+/*
+ * Read 'size' bytes (0 for all) at page aligned 'offset' of an inode.
+ * Returns -EINVAL, after printing why, if the arguments are wrong.
+ */
+static int ubifs_read_inode(struct ubifs_info *c, struct inode *inode,
+			    void *buf, loff_t offset, loff_t size,
+			    loff_t *actread)
 {
-	struct ubifs_info *c = ubifs_sb->s_fs_info;
-	unsigned long inum;
-	struct inode *inode;
 	struct page page;
 	int err = 0;
-	int i;
+	int i, n;
 	int count;
 	int last_block_size = 0;
 
@@ -856,33 +930,13 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	if (offset & (PAGE_SIZE - 1)) {
 		printf("ubifs: Error offset must be a multiple of %d\n",
 		       PAGE_SIZE);
-		return -1;
-	}
-
-	c->ubi = ubi_open_volume(c->vi.ubi_num, c->vi.vol_id, UBI_READONLY);
-	/* ubifs_findfile will resolve symlinks, so we know that we get
-	 * the real file here */
-	inum = ubifs_findfile(ubifs_sb, (char *)filename);
-	if (!inum) {
-		err = -1;
-		goto out;
-	}
-
-	/*
-	 * Read file inode
-	 */
-	inode = ubifs_iget(ubifs_sb, inum);
-	if (IS_ERR(inode)) {
-		printf("%s: Error reading inode %ld!\n", __func__, inum);
-		err = PTR_ERR(inode);
-		goto out;
+		return -EINVAL;
 	}
 
 	if (offset > inode->i_size) {
 		printf("ubifs: Error offset (%lld) > file-size (%lld)\n",
 		       offset, size);
-		err = -1;
-		goto put_inode;
+		return -EINVAL;
 	}
 
 	/*
@@ -897,7 +951,25 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	page.addr = buf;
 	page.index = offset / PAGE_SIZE;
 	page.inode = inode;
-	for (i = 0; i < count; i++) {
+	for (i = 0; i < count; i += n) {
+		/*
+		 * Whole blocks are bulk-read where possible. The last one is
+		 * left to do_readpage(), which does not write beyond the
+		 * requested size.
+		 */
+		n = read_bulk(c, inode, page.addr,
+			      page.index << UBIFS_BLOCKS_PER_PAGE_SHIFT,
+			      count - i - 1);
+		if (n < 0) {
+			err = n;
+			break;
+		}
+		if (n) {
+			page.addr += n * PAGE_SIZE;
+			page.index += n;
+			continue;
+		}
+
 		/*
 		 * Make sure to not read beyond the requested size
 		 */
@@ -910,16 +982,50 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 
 		page.addr += PAGE_SIZE;
 		page.index++;
+		n = 1;
 	}
 
-	if (err) {
-		printf("Error reading file '%s'\n", filename);
+	if (err)
 		*actread = i * PAGE_SIZE;
-	} else {
+	else
 		*actread = size;
+
+	return err;
+}
+
+int ubifs_read(const char *filename, void *buf, loff_t offset,
+	       loff_t size, loff_t *actread)
+{
+	struct ubifs_info *c = ubifs_sb->s_fs_info;
+	unsigned long inum;
+	struct inode *inode;
+	int err = 0;
+
+	*actread = 0;
+
+	c->ubi = ubi_open_volume(c->vi.ubi_num, c->vi.vol_id, UBI_READONLY);
+	/* ubifs_findfile will resolve symlinks, so we know that we get
+	 * the real file here */
+	inum = ubifs_findfile(ubifs_sb, (char *)filename);
+	if (!inum) {
+		err = -1;
+		goto out;
+	}
+
+	/*
+	 * Read file inode
+	 */
+	inode = ubifs_iget(ubifs_sb, inum);
+	if (IS_ERR(inode)) {
+		printf("%s: Error reading inode %ld!\n", __func__, inum);
+		err = PTR_ERR(inode);
+		goto out;
 	}
 
-put_inode:
+	err = ubifs_read_inode(c, inode, buf, offset, size, actread);
+	if (err && err != -EINVAL)
+		printf("Error reading file '%s'\n", filename);
+
 	ubifs_iput(inode);
 
 out:
@@ -927,6 +1033,63 @@ out:
 	return err;
 }
 
+/* Inode of the file opened by ubifs_open_file() */
+static struct inode *ubifs_opened;
+
+int ubifs_open_file(const char *filename, loff_t *size)
+{
+	struct ubifs_info *c = ubifs_sb->s_fs_info;
+	unsigned long inum;
+	struct inode *inode;
+	int err = 0;
+
+	ubifs_close_file();
+
+	c->ubi = ubi_open_volume(c->vi.ubi_num, c->vi.vol_id, UBI_READONLY);
+
+	inum = ubifs_findfile(ubifs_sb, (char *)filename);
+	if (!inum) {
+		err = -1;
+		goto out;
+	}
+
+	inode = ubifs_iget(ubifs_sb, inum);
+	if (IS_ERR(inode)) {
+		printf("%s: Error reading inode %ld!\n", __func__, inum);
+		err = PTR_ERR(inode);
+		goto out;
+	}
+
+	*size = inode->i_size;
+	ubifs_opened = inode;
+out:
+	ubi_close_volume(c->ubi);
+	return err;
+}
+
+int ubifs_read_next(void *buf, loff_t pos, loff_t len, loff_t *actread)
+{
+	struct ubifs_info *c;
+	int err;
+
+	if (!ubifs_sb || !ubifs_opened)
+		return -1;
+
+	c = ubifs_sb->s_fs_info;
+	c->ubi = ubi_open_volume(c->vi.ubi_num, c->vi.vol_id, UBI_READONLY);
+	err = ubifs_read_inode(c, ubifs_opened, buf, pos, len, actread);
+	ubi_close_volume(c->ubi);
+
+	return err;
+}
+
+void ubifs_close_file(void)
+{
+	if (ubifs_opened)
+		ubifs_iput(ubifs_opened);
+	ubifs_opened = NULL;
+}
+
 void ubifs_close(void)
 {
 }
@@ -948,16 +1111,6 @@ int ubifs_load(char *filename, u32 addr, u32 size)
 	return err;
 }
 
-void uboot_ubifs_umount(void)
-{
-	if (ubifs_sb) {
-		printf("Unmounting UBIFS volume %s!\n",
-		       ((struct ubifs_info *)(ubifs_sb->s_fs_info))->vi.name);
-		ubifs_umount(ubifs_sb->s_fs_info);
-		ubifs_sb = NULL;
-	}
-}
-
 char *ubifs_mounted_vol_name(void)
 {
 	if (!ubifs_sb)
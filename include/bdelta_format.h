@@ -0,0 +1,43 @@
+/*
+ * Block delta image format.
+ *
+ * A block delta updates a partition that already holds a base image to a
+ * new image by carrying only the blocks that differ between both. The new
+ * image is split in blocks of blk_sz bytes and the delta consists of:
+ *
+ *   - struct bdelta_header (hdr_sz bytes)
+ *   - total_blks SHA-256 digests, one for every block of the new image
+ *   - delta_blks __le32 block numbers, in increasing order
+ *   - delta_blks blocks of blk_sz bytes, the new data of those blocks
+ *
+ * Blocks that are not in the delta must already be on the target with the
+ * content given by their digest. If image_sz is not a multiple of blk_sz
+ * the digest of the last block only covers its first image_sz % blk_sz
+ * bytes and its data is padded with zeros.
+ *
+ * All fields are little endian.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _BDELTA_FORMAT_H_
+#define _BDELTA_FORMAT_H_
+
+#include <linux/types.h>
+
+#define BDELTA_MAGIC		0x41544c44	/* "DLTA" */
+#define BDELTA_VERSION		1
+#define BDELTA_DIGEST_SIZE	32		/* SHA-256 */
+
+struct bdelta_header {
+	__le32	magic;		/* BDELTA_MAGIC */
+	__le16	version;	/* BDELTA_VERSION */
+	__le16	hdr_sz;		/* size of this header, at least 32 bytes */
+	__le32	blk_sz;		/* block size in bytes */
+	__le32	total_blks;	/* blocks in the new image */
+	__le32	delta_blks;	/* blocks carried in the delta */
+	__le32	reserved;
+	__le64	image_sz;	/* size of the new image in bytes */
+};
+
+#endif /* _BDELTA_FORMAT_H_ */
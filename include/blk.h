@@ -8,6 +8,8 @@
 #ifndef BLK_H
 #define BLK_H
 
+#include <linux/list.h>
+
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
 #define LBAFlength "ll"
@@ -62,6 +64,7 @@ struct blk_desc {
 	char		vendor[40+1];	/* IDE model, SCSI Vendor */
 	char		product[20+1];	/* IDE Serial no, SCSI product */
 	char		revision[8+1];	/* firmware revision */
+	unsigned long	change_seq;	/* updated by blk_changed() */
 #ifdef CONFIG_BLK
 	/*
 	 * For now we have a few functions which take struct blk_desc as a
@@ -69,6 +72,8 @@ struct blk_desc {
 	 * device. Once these functions are removed we can drop this field.
 	 */
 	struct udevice *bdev;
+	struct list_head queue;		/* struct blk_request, not yet issued */
+	int queue_len;			/* number of requests in queue */
 #else
 	unsigned long	(*block_read)(struct blk_desc *block_dev,
 				      lbaint_t start,
@@ -85,6 +90,18 @@ struct blk_desc {
 #endif
 };
 
+/**
+ * blk_changed() - note that the content of a block device changed
+ *
+ * This is called when the device is written, erased, (re)initialised or
+ * removed. It gives @block_dev->change_seq a value that no device had
+ * before, so that state derived from the content, e.g. a mounted
+ * filesystem, can tell that it is stale.
+ *
+ * @block_dev:	Block device descriptor
+ */
+void blk_changed(struct blk_desc *block_dev);
+
 #define BLOCK_CNT(size, blk_desc) (PAD_COUNT(size, blk_desc->blksz))
 #define PAD_TO_BLOCKSIZE(size, blk_desc) \
 	(PAD_SIZE(size, blk_desc->blksz))
@@ -107,8 +124,8 @@ int blkcache_read(int iftype, int dev,
 		  unsigned long blksz, void *buffer);
 
 /**
- * blkcache_fill() - make data read from a block device available
- * to the block cache
+ * blkcache_fill() - make data read from a block device available to the
+ * block cache
  *
  * @param iftype - IF_TYPE_x for type of device
  * @param dev - device index of particular type
@@ -122,6 +139,35 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_readahead() - satisfy a sequential cache miss with a larger read
+ *
+ * If the previous read from this device ended at @start, read the request
+ * plus the configured number of read-ahead blocks in one go, fill the
+ * cache with all of them and copy the requested part to @buffer.
+ *
+ * @param block_dev - block device to read from
+ * @param start - starting block number
+ * @param blkcnt - number of blocks requested
+ * @param buffer - buffer for the requested blocks
+ *
+ * @return - '1' if the request was satisfied, '0' otherwise.
+ */
+int blkcache_readahead(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt, void *buffer);
+
+/**
+ * blkcache_invalidate_range() - discard a range of cached blocks, e.g.
+ * because they were erased
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks to discard
+ */
+void blkcache_invalidate_range(int iftype, int dev,
+			       lbaint_t start, lbaint_t blkcnt);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -134,10 +180,12 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @param blocks - largest read, in blocks, that is cached
+ * @param megabytes - cache budget of each device, 0 disables the cache
+ * @param readahead - blocks to read ahead on sequential access, 0 disables
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(unsigned blocks, unsigned megabytes,
+			unsigned readahead);
 
 /*
  * statistics of the block cache
@@ -145,9 +193,12 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
+	unsigned evictions;
+	unsigned readaheads;
+	unsigned entries; /* current count of cached blocks */
 	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	unsigned max_megabytes; /* per device */
+	unsigned readahead; /* blocks */
 };
 
 /**
@@ -170,10 +221,76 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline int blkcache_readahead(struct blk_desc *block_dev,
+				     lbaint_t start, lbaint_t blkcnt,
+				     void *buffer)
+{
+	return 0;
+}
+
+static inline void blkcache_invalidate_range(int iftype, int dev,
+					     lbaint_t start,
+					     lbaint_t blkcnt) {}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 #endif
 
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+};
+
+/**
+ * struct blk_request - a queued block transfer
+ *
+ * Requests are queued on a block device with blk_submit() and issued by
+ * blk_run_queue(). Until then the request and its buffer must stay valid.
+ *
+ * @list:	Entry in the device queue (used by the block uclass)
+ * @op:		BLK_REQ_READ or BLK_REQ_WRITE
+ * @start:	Start block number (0=first)
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Data buffer
+ * @result:	Number of blocks transferred, or -ve error number. Valid once
+ *		the request has completed
+ * @complete:	Called when the request has completed, may be NULL
+ * @priv:	Private data for the submitter
+ */
+struct blk_request {
+	struct list_head list;
+	enum blk_req_op op;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	long result;
+	void (*complete)(struct blk_request *req);
+	void *priv;
+};
+
+/**
+ * blk_init_request() - set up a request before passing it to blk_submit()
+ *
+ * @req:	Request to set up
+ * @op:		BLK_REQ_READ or BLK_REQ_WRITE
+ * @start:	Start block number (0=first)
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Data buffer
+ */
+static inline void blk_init_request(struct blk_request *req,
+				    enum blk_req_op op, lbaint_t start,
+				    lbaint_t blkcnt, void *buffer)
+{
+	INIT_LIST_HEAD(&req->list);
+	req->op = op;
+	req->start = start;
+	req->blkcnt = blkcnt;
+	req->buffer = buffer;
+	req->result = 0;
+	req->complete = NULL;
+	req->priv = NULL;
+}
+
 #ifdef CONFIG_BLK
 struct udevice;
 
@@ -235,6 +352,27 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - transfer a batch of queued writes
+	 *
+	 * This method is optional. The block uclass sorts queued reads and
+	 * merges requests for adjacent blocks into runs. If the buffers of a
+	 * run are not contiguous in memory, the run goes through a bounce
+	 * buffer and a single call to read() or write().
+	 *
+	 * Queued writes that do not form a single run are all handed to
+	 * this method in one call, in queue order, so that a device able to
+	 * pack them (e.g. eMMC packed commands) can write them with one
+	 * command. Without it, they are written one run at a time.
+	 *
+	 * @dev:	Device to transfer with
+	 * @reqs:	List of struct blk_request, all writes, possibly for
+	 *		unrelated blocks
+	 * @return number of blocks transferred, counted from the start of
+	 * the list, or -ve error number
+	 */
+	long (*submit)(struct udevice *dev, struct list_head *reqs);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -252,6 +390,32 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_submit() - queue a request on a block device
+ *
+ * Reads that can be served from the block cache complete immediately. The
+ * queue is run automatically once it holds CONFIG_BLK_QUEUE_DEPTH requests,
+ * and before any synchronous transfer through blk_dread()/blk_dwrite().
+ *
+ * @block_dev:	Block device to queue on
+ * @req:	Request, set up with blk_init_request()
+ * @return 0 if OK, -ve on error while running the queue
+ */
+int blk_submit(struct blk_desc *block_dev, struct blk_request *req);
+
+/**
+ * blk_run_queue() - issue all queued requests of a block device
+ *
+ * Reads are sorted by block number and requests for adjacent blocks are
+ * merged, so that each run is sent to the device as a single transfer. The
+ * requests are completed in the order in which they are issued.
+ *
+ * @block_dev:	Block device whose queue should be run
+ * @return 0 if all requests transferred all their blocks, else the first
+ * -ve error number
+ */
+int blk_run_queue(struct blk_desc *block_dev);
+
 /**
  * blk_get_device() - Find and probe a block device ready for use
  *
@@ -379,6 +543,8 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
+	if (blkcache_readahead(block_dev, start, blkcnt, buffer))
+		return blkcnt;
 
 	/*
 	 * We could check if block_read is NULL and return -ENOSYS. But this
@@ -396,17 +562,53 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt, const void *buffer)
 {
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
-	return block_dev->block_write(block_dev, start, blkcnt, buffer);
+	ulong blks_written;
+
+	blk_changed(block_dev);
+	blks_written = block_dev->block_write(block_dev, start, blkcnt, buffer);
+	/*
+	 * Written blocks are not cached, so that reading them back reads
+	 * the media.
+	 */
+	blkcache_invalidate_range(block_dev->if_type, block_dev->devnum,
+				  start, blkcnt);
+
+	return blks_written;
 }
 
 static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt)
 {
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_changed(block_dev);
+	blkcache_invalidate_range(block_dev->if_type, block_dev->devnum,
+				  start, blkcnt);
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
+/*
+ * Without driver model there is no request queue, so each request is
+ * transferred as soon as it is submitted.
+ */
+static inline int blk_submit(struct blk_desc *block_dev,
+			     struct blk_request *req)
+{
+	if (req->op == BLK_REQ_READ)
+		req->result = blk_dread(block_dev, req->start, req->blkcnt,
+					req->buffer);
+	else
+		req->result = blk_dwrite(block_dev, req->start, req->blkcnt,
+					 req->buffer);
+	if (req->complete)
+		req->complete(req);
+
+	return req->result == req->blkcnt ? 0 : -EIO;
+}
+
+static inline int blk_run_queue(struct blk_desc *block_dev)
+{
+	return 0;
+}
+
 /**
  * struct blk_driver - Driver for block interface types
  *
@@ -28,6 +28,7 @@
 
 #define CONFIG_SOURCE
 #define CONFIG_AUTO_BOOTSCRIPT
+
 #define CONFIG_BOOTSCRIPT		CONFIG_SYS_BOARD "-boot.scr"
 
 #define DEFAULT_MAC_ETHADDR	"00:04:f3:ff:ff:fa"
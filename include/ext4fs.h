@@ -34,6 +34,8 @@
 #define EXT4_FEATURE_RO_COMPAT_GDT_CSUM	0x0010
 #define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
 #define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
+#define EXT4_FEATURE_COMPAT_DIR_INDEX	0x0020
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
 #define EXT4_INDIRECT_BLOCKS		12
 
 #define EXT4_BG_INODE_UNINIT		0x0001
@@ -78,6 +80,41 @@ struct ext4_extent_header {
 	__le32	eh_generation;	/* generation of the tree */
 };
 
+/* Hash versions of the directory index */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
+#define EXT4_HTREE_EOF_32BIT		((1UL << (32 - 1)) - 1)
+#define EXT4_HTREE_LEVEL		3
+
+/*
+ * Directory index (htree) on-disk structures. The root lives in the first
+ * block of the directory, behind fake "." and ".." entries; interior nodes
+ * hide behind a single empty dirent covering the whole block.
+ */
+struct dx_root_info {
+	__le32	reserved_zero;
+	__u8	hash_version;
+	__u8	info_length;	/* 8 */
+	__u8	indirect_levels;
+	__u8	unused_flags;
+};
+
+struct dx_entry {
+	__le32	hash;
+	__le32	block;
+};
+
+/* overlays the hash of the first dx_entry of each node */
+struct dx_countlimit {
+	__le16	limit;
+	__le16	count;
+};
+
 struct ext_filesystem {
 	/* Total Sector of partition */
 	uint64_t total_sect;
@@ -136,6 +173,9 @@ int ext4_write_file(const char *filename, void *buf, loff_t offset, loff_t len,
 struct ext_filesystem *get_fs(void);
 int ext4fs_open(const char *filename, loff_t *len);
 int ext4fs_read(char *buf, loff_t offset, loff_t len, loff_t *actread);
+int ext4fs_open_file(const char *filename, loff_t *size);
+int ext4fs_read_next(void *buf, loff_t pos, loff_t len, loff_t *actread);
+void ext4fs_close_file(void);
 int ext4fs_mount(unsigned part_length);
 void ext4fs_close(void);
 void ext4fs_reinit_global(void);
@@ -146,6 +186,8 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot);
 int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock);
+long int read_allocated_extent(struct ext2_inode *inode, int fileblock,
+			       int *count);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 disk_partition_t *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
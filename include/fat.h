@@ -160,6 +160,16 @@ typedef struct dir_slot {
 	__u8	name11_12[4];	/* Last 2 characters in name */
 } dir_slot;
 
+/*
+ * A window of FATBUFBLOCKS sectors of the FAT held in memory
+ */
+struct fat_window {
+	__u8	*buf;
+	int	num;		/* Window number in the FAT, -1 if unused */
+	__u8	dirty;		/* Set if buf has been modified */
+	__u32	stamp;		/* Last use, for LRU replacement */
+};
+
 /*
  * Private filesystem parameters
  *
@@ -171,12 +181,19 @@ typedef struct {
 	int	fatsize;	/* Size of FAT in bits */
 	__u32	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
-	__u8	fat_dirty;      /* Set if fatbuf has been modified */
 	__u32	rootdir_sect;	/* Start sector of root directory */
+	__u32	root_cluster;	/* First cluster of root directory (FAT32) */
+	int	rootdir_size;	/* Root directory sectors (FAT12/16) */
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
 	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	struct fat_window *fatwin;	/* FAT cache windows */
+	struct fat_window *fatcur;	/* Window holding fatbuf */
+	int	fatwins;	/* Number of windows in fatwin */
+	int	fatwhole;	/* Set if fatwin covers the whole FAT */
+	__u32	fatstamp;	/* LRU clock of the FAT cache */
+	__u32	vol_id;		/* Volume serial number */
 } fsdata;
 
 typedef int	(file_detectfs_func)(void);
@@ -213,5 +230,8 @@ int file_fat_write(const char *filename, void *buf, loff_t offset, loff_t len,
 		   loff_t *actwrite);
 int fat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		  loff_t *actread);
+int fat_open_file(const char *filename, loff_t *size);
+int fat_read_next(void *buf, loff_t pos, loff_t len, loff_t *actread);
+void fat_close_file(void);
 void fat_close(void);
 #endif /* _FAT_H_ */
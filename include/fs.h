@@ -26,6 +26,18 @@
  */
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype);
 
+/*
+ * The filesystem found by fs_set_blk_dev() stays mounted after the command
+ * until another partition is selected or the device is written. Unmount it
+ * now, e.g. because the medium was replaced without U-Boot noticing or the
+ * filesystem driver is about to be used directly.
+ */
+#ifndef CONFIG_SPL_BUILD
+void fs_flush(void);
+#else
+static inline void fs_flush(void) {}
+#endif
+
 /*
  * Print the list of files on the partition previously set by fs_set_blk_dev(),
  * in directory "dirname".
@@ -78,6 +90,34 @@ int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	     loff_t *actwrite);
 
+/*
+ * fs_open_file - Open a file on the partition previously set by
+ * fs_set_blk_dev() to read it in chunks with fs_read_next(). Unlike with
+ * fs_read(), the path is resolved once, and each chunk continues where
+ * the previous one ended. The filesystem stays mounted until
+ * fs_close_file(), fs_flush() or the next fs_open_file().
+ *
+ * @filename: Name of file to open
+ * @size: Returns the size of the file
+ * @return 0 if ok, -1 on error
+ */
+int fs_open_file(const char *filename, loff_t *size);
+
+/*
+ * fs_read_next - Read the next chunk of the file opened by fs_open_file()
+ *
+ * @addr: The address to read into
+ * @len: The number of bytes to read
+ * @actread: Returns the actual number of bytes read, 0 at the end of file
+ * @return 0 if ok with valid *actread, -1 on error conditions
+ */
+int fs_read_next(ulong addr, loff_t len, loff_t *actread);
+
+/*
+ * fs_close_file - Close the file opened by fs_open_file()
+ */
+void fs_close_file(void);
+
 /*
  * Common implementation for various filesystem commands, optionally limited
  * to a specific filesystem type via the fstype parameter.
@@ -26,6 +26,14 @@ struct sparse_storage {
 	lbaint_t	(*reserve)(struct sparse_storage *info,
 				 lbaint_t blk,
 				 lbaint_t blkcnt);
+
+	/*
+	 * Optional: makes blkcnt blocks read back as zeros without writing
+	 * them, e.g. by erasing them. Returns blkcnt, or 0 if it cannot.
+	 */
+	lbaint_t	(*erase)(struct sparse_storage *info,
+				 lbaint_t blk,
+				 lbaint_t blkcnt);
 };
 
 static inline int is_sparse_image(void *buf)
@@ -64,9 +64,11 @@
 #define MMC_MODE_4BIT		(1 << 29)
 #define MMC_MODE_1BIT		(1 << 28)
 #define MMC_MODE_SPI		(1 << 27)
+#define MMC_MODE_CMD23		(1 << 26)	/* host can issue CMD23 */
 
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_DATA_STAT_AFTER_ERASE	0x00800000
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -210,6 +212,7 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define EXT_CSD_WR_REL_SET		167	/* R/W */
 #define EXT_CSD_RPMB_MULT		168	/* RO */
 #define EXT_CSD_ERASE_GROUP_DEF		175	/* R/W */
+#define EXT_CSD_ERASED_MEM_CONT		181	/* RO */
 #define EXT_CSD_BOOT_BUS_WIDTH		177
 #define EXT_CSD_PART_CONF		179	/* R/W */
 #define EXT_CSD_BUS_WIDTH		183	/* R/W */
@@ -221,6 +224,8 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define EXT_CSD_HC_WP_GRP_SIZE		221	/* RO */
 #define EXT_CSD_HC_ERASE_GRP_SIZE	224	/* RO */
 #define EXT_CSD_BOOT_MULT		226	/* RO */
+#define EXT_CSD_MAX_PACKED_WRITES	500	/* RO */
+#define EXT_CSD_MAX_PACKED_READS	501	/* RO */
 #define EXT_CSD_BKOPS_SUPPORT		502	/* RO */
 
 /*
@@ -304,6 +309,19 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define MMC_RSP_R6	(MMC_RSP_PRESENT|MMC_RSP_CRC|MMC_RSP_OPCODE)
 #define MMC_RSP_R7	(MMC_RSP_PRESENT|MMC_RSP_CRC|MMC_RSP_OPCODE)
 
+/* SET_BLOCK_COUNT (CMD23) argument */
+#define MMC_CMD23_ARG_REL_WR	(1 << 31)
+#define MMC_CMD23_ARG_PACKED	(1 << 30)
+#define MMC_CMD23_MAX_BLOCKS	0xffff
+
+/* Packed command header */
+#define MMC_PACKED_CMD_VER	0x01
+#define MMC_PACKED_CMD_WR	0x02
+
+/* Commands supported by both the card and the host, see mmc->cmd_caps */
+#define MMC_CMD_CAP_SBC		(1 << 0)	/* CMD23 SET_BLOCK_COUNT */
+#define MMC_CMD_CAP_PACKED_WR	(1 << 1)	/* packed write commands */
+
 #define MMCPART_NOAVAILABLE	(0xff)
 #define PART_ACCESS_MASK	(0x7)
 #define PART_SUPPORT		(0x1)
@@ -540,6 +558,16 @@ static inline bool supports_uhs(uint caps)
  *
  * TODO struct mmc should be in mmc_private but it's hard to fix right now
  */
+/* Block transfer statistics of a device, see CONFIG_MMC_STATS */
+struct mmc_stats {
+	u64 read_bytes;
+	u64 write_bytes;
+	u64 read_us;
+	u64 write_us;
+	ulong read_cmds;
+	ulong write_cmds;
+};
+
 struct mmc {
 #ifndef CONFIG_BLK
 	struct list_head link;
@@ -564,12 +592,15 @@ struct mmc {
 	u8 part_support;
 	u8 part_attr;
 	u8 wr_rel_set;
+	u8 max_packed_writes;	/* entries in a packed write */
+	uint cmd_caps;		/* MMC_CMD_CAP_... */
 	char part_config;
 	uint tran_speed;
 	uint legacy_speed;
 	uint read_bl_len;
 	uint write_bl_len;
 	uint erase_grp_size;	/* in 512-byte sectors */
+	u8 erased_byte;		/* content of the erased blocks */
 	uint hc_wp_grp_size;	/* in 512-byte sectors */
 	struct sd_ssr	ssr;	/* SD status register */
 	u64 capacity;
@@ -592,6 +623,9 @@ struct mmc {
 	u8 *ext_csd;
 	enum bus_mode selected_mode;
 	enum bus_mode best_mode;
+#ifdef CONFIG_MMC_STATS
+	struct mmc_stats stats;
+#endif
 };
 
 struct mmc_hwpart_conf {
@@ -659,6 +693,21 @@ int mmc_switch_part(struct mmc *mmc, unsigned int part_num);
 int mmc_hwpart_config(struct mmc *mmc, const struct mmc_hwpart_conf *conf,
 		      enum mmc_hwpart_conf_mode mode);
 
+/**
+ * mmc_erase_zeroes() - make a range of blocks read back as zeros
+ *
+ * The erase groups entirely in the range are erased and the blocks at
+ * either end are written with zeros.
+ *
+ * @block_dev:	block device of the MMC, or of one of its hardware partitions
+ * @start:	first block
+ * @blkcnt:	number of blocks
+ * @return blkcnt, or 0 if the device does not read back zeros after an
+ * erase or on error
+ */
+ulong mmc_erase_zeroes(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt);
+
 #ifndef CONFIG_DM_MMC_OPS
 int mmc_getcd(struct mmc *mmc);
 int board_mmc_getcd(struct mmc *mmc);
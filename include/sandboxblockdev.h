@@ -13,6 +13,7 @@ struct host_block_dev {
 #endif
 	char *filename;
 	int fd;
+	unsigned long cmd_count;	/* device commands issued, for tests */
 };
 
 int host_dev_bind(int dev, char *filename);
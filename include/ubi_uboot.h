@@ -82,6 +82,9 @@ extern int ubi_volume_off_write(char *volume, void *buf, size_t size,
 extern int ubi_volume_off_write_break(char *volume);
 extern const char *ubi_get_volume_name(int index);
 #endif /* CONFIG_DIGI_UBI */
+#ifdef CONFIG_CMD_UBIFS
+extern void cmd_ubifs_volume_changed(int ubi_num, int vol_id);
+#endif
 
 extern struct ubi_device *ubi_devices[];
 
@@ -18,6 +18,10 @@
 int ubifs_init(void);
 int uboot_ubifs_mount(char *vol_name);
 void uboot_ubifs_umount(void);
+void uboot_ubifs_flush(int all);
+void uboot_ubifs_drop(int ubi_num, int vol_id);
+void uboot_ubifs_list(void);
+char *ubifs_mounted_vol_name(void);
 int ubifs_is_mounted(void);
 int ubifs_load(char *filename, u32 addr, u32 size);
 
@@ -27,6 +31,9 @@ int ubifs_exists(const char *filename);
 int ubifs_size(const char *filename, loff_t *size);
 int ubifs_read(const char *filename, void *buf, loff_t offset,
 	       loff_t size, loff_t *actread);
+int ubifs_open_file(const char *filename, loff_t *size);
+int ubifs_read_next(void *buf, loff_t pos, loff_t len, loff_t *actread);
+void ubifs_close_file(void);
 void ubifs_close(void);
 
 #endif /* __UBIFS_UBOOT_H__ */
@@ -137,3 +137,15 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 	*dstn = out - dst;
 	return ret;
 }
+
+/* Decompresses a single block of an LZ4 frame, returns the decompressed size */
+int ulz4_block(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	int ret;
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic(src, dst, srcn, dstn, endOnInputSize,
+				     full, 0, noDict, dst, NULL, 0);
+
+	return ret < 0 ? -EPROTO : ret;
+}
@@ -83,17 +83,15 @@ uint64_t partition_start_address = 0;		/* Start address of partition to flash; s
 uint64_t partition_size = 0;			/* Size of partition to flash; set by cmd_bsp.c */
 const struct nv_param_part* partition_to_write;	/* Partition to flash; set by cmd_bsp.c */
 uint blocks_written_to_flash = 0;
-ulong ram_offset = 0;
-ulong last_ram_addr_written = 0;
 ulong bytes_counter = 0;
+static ulong ram_sectors_written;		/* sectors of the RAM ring in flash */
+static ulong flash_write_ms;			/* time spent writing to flash */
 
 #if defined(CONFIG_CMD_UBI)
 extern int ubi_volume_off_write(char *volume, void *buf, size_t size, int isFirstPart, int isLastPart);
-extern int ubi_volume_verify(char *volume, char *buf, loff_t offset, size_t size, char skipUpdFlagCheck);
 #endif
 
-#define FLASH_SECTORS_BUFFERED_IN_RAM	3	/* define # of flash sectors that are buffered before
-						 * writing to flash */
+#define FLASH_SECTORS_BUFFERED_IN_RAM	3	/* define # of flash sectors in the RAM ring */
 #endif /* CONFIG_TFTP_UPDATE_ONTHEFLY */
 
 enum {
@@ -174,6 +172,17 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * With a window (RFC 7440) the server sends that many blocks per ACK, which
+ * keeps the link busy while the ACK travels back. 1 is lock-step TFTP.
+ */
+static unsigned short tftp_windowsize = 1;
+static unsigned short tftp_windowsize_option = CONFIG_TFTP_WINDOWSIZE;
+/* block that completes the window being received */
+static ulong tftp_next_ack;
+/* last block ACKed to report a gap, TFTP_SEQUENCE_SIZE if none */
+static ulong tftp_last_nack;
+
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
 #define MTFTP_BITMAPSIZE	0x1000
@@ -257,138 +266,184 @@ static inline void store_block(int block, uchar *src, unsigned len)
 }
 
 #ifdef CONFIG_TFTP_UPDATE_ONTHEFLY
+/*
+ * The image is received into a ring of FLASH_SECTORS_BUFFERED_IN_RAM flash
+ * sectors at load_addr. Complete sectors are written to flash one at a time
+ * after acknowledging a block, so the write overlaps the transfer of the
+ * next one. The flash is only written from the receive path when the ring
+ * is full.
+ */
 static __inline__ void
-store_block_to_ram (ulong ramAddress, uchar * src, unsigned len)
+store_block_to_ram (uchar * src, unsigned len)
 {
+	ulong ring_size = flash_erase_size * FLASH_SECTORS_BUFFERED_IN_RAM;
+	ulong pos = bytes_counter % ring_size;
+	unsigned n = min_t(ulong, len, ring_size - pos);
+
+	/* copy TftpBlock into the RAM ring, wrapping around at its end */
+	(void)memcpy((void *)(load_addr + pos), src, n);
+	(void)memcpy((void *)load_addr, src + n, len - n);
+
 	/* count received bytes here to calculate FileSize later */
 	bytes_counter += len;
-	/*copy TftpBlock into RAM buffer*/
-	(void)memcpy( (void *)(ramAddress), src, len );
 
 	if( net_boot_file_size < bytes_counter)
 		net_boot_file_size = bytes_counter;
 }
 
-static __inline__ void
-store_block_to_flash (void)
+/* Number of complete sectors in the RAM ring not yet written to flash */
+static __inline__ ulong ram_sectors_pending(void)
 {
-	ulong offset = blocks_written_to_flash * flash_erase_size;
-	ulong tempRamOff = 0;
-	int iRes = 0, i;
+	return bytes_counter / flash_erase_size - ram_sectors_written;
+}
+
+/*
+ * Write and verify size bytes at ram to the next good flash sector. UBI
+ * volumes take several sectors at once, rely on the program status of the
+ * data and read back the VID header that records its CRC; raw partitions are
+ * written a sector at a time and compared with the data in RAM.
+ */
+static int write_sector_to_flash(ulong ram, size_t size, int isLastPart)
+{
+	int iRes = 0;
 #if defined(CONFIG_CMD_NAND)
+	ulong offset = blocks_written_to_flash * flash_erase_size;
 	struct mtd_info *nand = nand_info[0];
-#endif
+	ulong start = get_timer(0);
 
-	for(i = 0; i < FLASH_SECTORS_BUFFERED_IN_RAM; i++){
-#if defined(CONFIG_CMD_NAND)
 #if defined(CONFIG_CMD_UBI)
-		if (tftp_to_flash_status & B_PARTITION_IS_UBIFS) {
-			iRes = !ubi_volume_off_write((char *)otfd.part->name, (void *)(load_addr + tempRamOff),
-					     flash_erase_size, blocks_written_to_flash == 0, 0);
-			if (iRes) {
-				iRes = !ubi_volume_verify((char *)otfd.part->name, (char *)(load_addr + tempRamOff),
-							 offset, flash_erase_size, 1);
-			}
-		}
-		else
+	if (tftp_to_flash_status & B_PARTITION_IS_UBIFS) {
+		iRes = !ubi_volume_off_write((char *)otfd.part->name, (void *)ram,
+					     size, blocks_written_to_flash == 0,
+					     isLastPart);
+		/* count the sectors written, not the sector calls */
+		if (iRes && size > flash_erase_size)
+			blocks_written_to_flash += size / flash_erase_size - 1;
+	}
+	else
 #endif
-		{
-			if (nand_block_isbad(nand, partition_start_address +
-						(uint64_t)offset) ){
-				/* skip the bad blocks here, not in PartWrite()
-				* because we need to write block after block
-				* and need to know if we skiped a block for the next loop */
-				offset += flash_erase_size;
-				blocks_written_to_flash++;
-			}
-
-			/* Write RAM buffer to partition and verify it */
-			iRes = nand_write(nand, partition_start_address + (uint64_t)offset,
-					  &flash_erase_size, (void *)(load_addr + tempRamOff));
-			iRes = nand_verify(nand, partition_start_address + (uint64_t)offset,
-					flash_erase_size, (void *)(load_addr + tempRamOff));
+	{
+		if (nand_block_isbad(nand, partition_start_address +
+					(uint64_t)offset) ){
+			/* skip the bad blocks here, not in PartWrite()
+			* because we need to write block after block
+			* and need to know if we skiped a block for the next loop */
+			offset += flash_erase_size;
+			blocks_written_to_flash++;
 		}
-#endif /* CONFIG_CMD_NAND */
-		if(!iRes)
-			goto error;
 
-		offset += flash_erase_size;
-		tempRamOff += flash_erase_size;
-		blocks_written_to_flash++;
+		/* Write RAM buffer to partition and verify it */
+		iRes = !nand_write(nand, partition_start_address + (uint64_t)offset,
+				   &size, (void *)ram) &&
+		       !nand_verify(nand, partition_start_address + (uint64_t)offset,
+				    size, (void *)ram);
 	}
+	flash_write_ms += get_timer(start);
+#endif /* CONFIG_CMD_NAND */
+	if (!iRes)
+		return -1;
 
-	/* calculate buffer offset (bytes that were received but don't fit into flash sector anymore)*/
-	ram_offset = last_ram_addr_written - (uint)flash_erase_size * FLASH_SECTORS_BUFFERED_IN_RAM ;
-	/* then copy them to the start of buffer to flash them in the next loop */
-	(void)memcpy( (void *)load_addr,
-			(void *)(load_addr + (flash_erase_size * FLASH_SECTORS_BUFFERED_IN_RAM)),
-			(ram_offset - load_addr) );
+	blocks_written_to_flash++;
+	return 0;
+}
 
-	/* finally remember the last address of RAM buffer */
-	last_ram_addr_written = ram_offset;
+/*
+ * Write the oldest complete sector of the RAM ring to flash. UBI volumes
+ * take all the complete sectors up to the end of the ring in one call.
+ */
+static __inline__ void
+store_block_to_flash (void)
+{
+	ulong slot = ram_sectors_written % FLASH_SECTORS_BUFFERED_IN_RAM;
+	ulong ram = load_addr + slot * flash_erase_size;
+	ulong sectors = 1;
 
-	return;
-error:
-	tftp_to_flash_status |= B_ERROR_DURING_FLASH;
+#if defined(CONFIG_CMD_UBI)
+	if (tftp_to_flash_status & B_PARTITION_IS_UBIFS)
+		sectors = min_t(ulong, ram_sectors_pending(),
+				FLASH_SECTORS_BUFFERED_IN_RAM - slot);
+#endif
+	if (write_sector_to_flash(ram, sectors * flash_erase_size, 0)) {
+		tftp_to_flash_status |= B_ERROR_DURING_FLASH;
+		return;
+	}
+	ram_sectors_written += sectors;
 }
 
-
 static __inline__ void
 store_last_block_to_flash (void)
 {
-	int iRes = 0;
-#if defined(CONFIG_CMD_NAND)
 	/* we received the last Tftp package, now handle it */
-	ulong offset = blocks_written_to_flash * flash_erase_size;
-	struct mtd_info *nand = nand_info[0];
-#endif
+	ulong ram;
+	size_t size;
 
-#if defined(CONFIG_CMD_NAND)
-#if defined(CONFIG_CMD_UBI)
-	if (tftp_to_flash_status & B_PARTITION_IS_UBIFS) {
-		size_t size = last_ram_addr_written - load_addr;
-
-		iRes = !ubi_volume_off_write((char *)otfd.part->name, (void *)load_addr,
-					    last_ram_addr_written - load_addr, blocks_written_to_flash == 0, 1);
-		if (iRes && (size != 0)) {
-			iRes = !ubi_volume_verify((char *)otfd.part->name, (char *)load_addr,
-						 offset, size, 1);
-		}
+	/* first the complete sectors still in RAM */
+	while (ram_sectors_pending()) {
+		store_block_to_flash();
+		if (tftp_to_flash_status & B_ERROR_DURING_FLASH)
+			return;
 	}
-	else
+
+	ram = load_addr + (ram_sectors_written %
+			   FLASH_SECTORS_BUFFERED_IN_RAM) * flash_erase_size;
+	size = bytes_counter % flash_erase_size;
+#if defined(CONFIG_CMD_UBI)
+	if (!(tftp_to_flash_status & B_PARTITION_IS_UBIFS))
 #endif
 	{
 		/* do the padding in the RAM buffer */
-		int iFreeBytesInBlock = flash_page_size - ( (last_ram_addr_written - load_addr) % flash_page_size);
-		if( iFreeBytesInBlock > 0 ){
+		int iFreeBytesInBlock = flash_page_size - (size % flash_page_size);
+		if( size && iFreeBytesInBlock < flash_page_size ){
 			if( (tftp_to_flash_status & B_PARTITION_IS_JFFS2) == B_PARTITION_IS_JFFS2 )
-				memset( (void *) last_ram_addr_written, 0x0, iFreeBytesInBlock);
+				memset( (void *)(ram + size), 0x0, iFreeBytesInBlock);
 			else
-				memset( (void *) last_ram_addr_written, 0xff, iFreeBytesInBlock);
-			last_ram_addr_written += iFreeBytesInBlock;
+				memset( (void *)(ram + size), 0xff, iFreeBytesInBlock);
+			size += iFreeBytesInBlock;
 		}
+		if (!size)
+			goto done;
+	}
 
-		/* then write the last bytes to flash and verify */
-		size_t off = last_ram_addr_written - load_addr;
-		iRes = nand_write(nand, partition_start_address + (uint64_t)offset,
-				  &off, (void *)(load_addr));
-		iRes = nand_verify(nand, partition_start_address + (uint64_t)offset,
-				   last_ram_addr_written - load_addr, (void *)(load_addr));
+	/* then write the last bytes to flash and verify */
+	if (write_sector_to_flash(ram, size, 1)) {
+		tftp_to_flash_status |= B_ERROR_DURING_FLASH;
+		return;
 	}
-#endif /* CONFIG_CMD_NAND */
-	if(!iRes)
-		goto error;
 
+done:
 	printf( "\nWriting blocks:   complete                                      " );
 	printf( "\nVerifying blocks: complete                                      " );
+	if (flash_write_ms)
+		printf("\nFlash write:      %lu KiB in %lu ms (%lu KiB/s)",
+		       bytes_counter >> 10, flash_write_ms,
+		       bytes_counter / flash_write_ms * 1000 / 1024);
+}
 
-	return;
-
-error:
-	tftp_to_flash_status |= B_ERROR_DURING_FLASH;
+static void otf_flash_failed(void)
+{
+	printf("\nERROR: occurred during update of partition at offset 0x%lx.\n",
+	       (ulong)blocks_written_to_flash * flash_erase_size);
+	blocks_written_to_flash = 0;
+	ram_sectors_written = 0;
+	bytes_counter = 0;
+	tftp_to_flash_status &= ~B_PARTITION_IS_JFFS2;
+	tftp_to_flash_status &= ~B_WRITE_IMG_TO_FLASH;
+	net_set_state(NETLOOP_FAIL);
 }
 #endif /* CONFIG_TFTP_UPDATE_ONTHEFLY */
 
+/* Let the OTF hook write pending data while the next block is on its way */
+static void tftp_otf_idle(void)
+{
+	otfd.buf = NULL;
+	otfd.len = 0;
+	otfd.flags |= OTF_FLAG_IDLE;
+	if (otf_update_hook(&otfd)) {
+		printf("Error writing on-the-fly. Aborting\n");
+		net_set_state(NETLOOP_FAIL);
+	}
+}
+
 /* Clear our state ready for a new transfer */
 static void new_transfer(void)
 {
@@ -521,11 +576,14 @@ static void tftp_complete(void)
 			if( (tftp_to_flash_status & B_WRITE_IMG_TO_FLASH) == B_WRITE_IMG_TO_FLASH ){
 				/* TFTP transfer complete, write last received TftpBlocks to flash */
 				store_last_block_to_flash();
+				if (tftp_to_flash_status & B_ERROR_DURING_FLASH) {
+					otf_flash_failed();
+					return;
+				}
 				/* and reset counters and flags */
-				last_ram_addr_written = 0;
 				blocks_written_to_flash = 0;
+				ram_sectors_written = 0;
 				bytes_counter = 0;
-				ram_offset = 0;
 				tftp_to_flash_status &= ~B_PARTITION_IS_JFFS2;
 			}
 #endif /* CONFIG_TFTP_UPDATE_ONTHEFLY */
@@ -539,6 +597,7 @@ static void tftp_send(void)
 	uchar *xp;
 	int len = 0;
 	ushort *s;
+	int windowsize = tftp_windowsize_option;
 
 #ifdef CONFIG_MCAST_TFTP
 	/* Multicast TFTP.. non-MasterClients do not ACK data. */
@@ -589,9 +648,14 @@ static void tftp_send(void)
 				tftp_mcast_bitmap = NULL;
 				pkt += sprintf((char *)pkt, "multicast%c%c",
 					0, 0);
+				/* the master client ACKs for the group */
+				windowsize = 1;
 			}
 		}
 #endif /* CONFIG_MCAST_TFTP */
+		if (tftp_state == STATE_SEND_RRQ && windowsize > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+				       0, windowsize, 0);
 		len = pkt - xp;
 		break;
 
@@ -665,11 +729,31 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+/*
+ * A block other than the next one arrived while receiving a window, so a
+ * block was lost or the server is sending again. ACK the last block received
+ * in order, once for each gap, so that the server goes back to the next one.
+ */
+static void window_gap(void)
+{
+	debug("Unexpected block %lu, expected %lu\n", tftp_cur_block,
+	      (tftp_prev_block + 1) % TFTP_SEQUENCE_SIZE);
+
+	tftp_cur_block = tftp_prev_block;
+	if (tftp_last_nack == tftp_prev_block)
+		return;
+
+	tftp_last_nack = tftp_prev_block;
+	tftp_next_ack = (unsigned short)(tftp_prev_block + tftp_windowsize);
+	tftp_send();
+}
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
 	__be16 proto;
 	__be16 *s;
+	int ack;
 	int i;
 
 	if (dest != tftp_our_port) {
@@ -756,9 +840,21 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				      (char *)pkt + i + 6, tftp_tsize);
 			}
 #endif
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_windowsize = clamp_t(ulong,
+					simple_strtoul((char *)pkt + i + 11,
+						       NULL, 10),
+					1, tftp_windowsize_option);
+				debug("windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_windowsize);
+			}
 		}
+		/* the ACK of the OACK asks for the first window */
+		tftp_next_ack = tftp_windowsize;
 #ifdef CONFIG_MCAST_TFTP
 		parse_multicast_oack((char *)pkt, len - 1);
+		if (tftp_mcast_active)
+			tftp_windowsize = 1;
 		if ((tftp_mcast_active) && (!tftp_mcast_master_client))
 			tftp_state = STATE_DATA;	/* passive.. */
 		else
@@ -778,6 +874,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		len -= 2;
 		tftp_cur_block = ntohs(*(__be16 *)pkt);
 
+		if (tftp_windowsize > 1 &&
+		    (tftp_state == STATE_DATA || tftp_state == STATE_OACK) &&
+		    tftp_cur_block != (unsigned short)(tftp_prev_block + 1)) {
+			window_gap();
+			break;
+		}
+
 		update_block_number();
 
 		if (tftp_state == STATE_SEND_RRQ)
@@ -817,37 +920,26 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 #ifdef CONFIG_TFTP_UPDATE_ONTHEFLY
 		if( (tftp_to_flash_status & B_WRITE_IMG_TO_FLASH) == B_WRITE_IMG_TO_FLASH ){
 			/* new TFTP on-the-fly update function:
-			 * buffer image in RAM and write it directly to flash */
-
-			if(last_ram_addr_written == 0)
-				last_ram_addr_written = load_addr;
-
-			/* capture packets, buffer it into RAM and remember last RAM address*/
-			store_block_to_ram(last_ram_addr_written, pkt + 2, len);
-			last_ram_addr_written += len;
-
-			if( (load_addr + flash_erase_size * FLASH_SECTORS_BUFFERED_IN_RAM) <= last_ram_addr_written){
-				/* we received enough packets to write in a flash sector,
-				 * so do it unless the partition is full*/
-				if( partition_size < (tftp_block_size * tftp_cur_block) ){
-					printf("\nERROR: Image does not fit into partition!");
-					tftp_to_flash_status &= ~B_WRITE_IMG_TO_FLASH;
-					net_set_state(NETLOOP_FAIL);
-					return;
-				}
-				store_block_to_flash();
+			 * buffer image in a RAM ring and write it to flash */
+			if( partition_size < bytes_counter + len ){
+				printf("\nERROR: Image does not fit into partition!");
+				tftp_to_flash_status &= ~B_WRITE_IMG_TO_FLASH;
+				net_set_state(NETLOOP_FAIL);
+				return;
+			}
 
-				if( (tftp_to_flash_status & B_ERROR_DURING_FLASH) == B_ERROR_DURING_FLASH ){
-					printf("\nERROR: occurred during update of partition at RAM address 0x%lx.\n", last_ram_addr_written);
-					last_ram_addr_written = 0;
-					blocks_written_to_flash = 0;
-					bytes_counter = 0;
-					tftp_to_flash_status &= ~B_PARTITION_IS_JFFS2;
-					tftp_to_flash_status &= ~B_WRITE_IMG_TO_FLASH;
-					net_set_state(NETLOOP_FAIL);
+			/* if flash writes fell behind, make room in the ring */
+			while (bytes_counter + len > (ram_sectors_written +
+			       FLASH_SECTORS_BUFFERED_IN_RAM) * flash_erase_size) {
+				store_block_to_flash();
+				if (tftp_to_flash_status & B_ERROR_DURING_FLASH) {
+					otf_flash_failed();
 					return;
 				}
 			}
+
+			/* capture packets and buffer them into the RAM ring */
+			store_block_to_ram(pkt + 2, len);
 		} else
 #endif /* CONFIG_TFTP_UPDATE_ONTHEFLY */
 		{
@@ -856,8 +948,16 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one, or for the next window if
+		 *	it completes the current one.
 		 */
+		ack = tftp_windowsize == 1 || len < tftp_block_size ||
+		      tftp_cur_block == tftp_next_ack;
+		if (ack) {
+			tftp_next_ack = (unsigned short)(tftp_cur_block +
+							 tftp_windowsize);
+			tftp_last_nack = TFTP_SEQUENCE_SIZE;
+		}
 #ifdef CONFIG_MCAST_TFTP
 		/* if I am the MasterClient, actively calculate what my next
 		 * needed block is; else I'm passive; not ACKING
@@ -884,8 +984,30 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			}
 		}
 #endif
+		if (!ack)
+			break;
 		tftp_send();
 
+		/*
+		 * Write buffered data to media while the next block (or
+		 * window) is on its way; the last one is written by
+		 * tftp_complete().
+		 */
+		if (len == tftp_block_size && net_state == NETLOOP_CONTINUE) {
+#ifdef CONFIG_TFTP_UPDATE_ONTHEFLY
+			if ((tftp_to_flash_status & B_WRITE_IMG_TO_FLASH) &&
+			    ram_sectors_pending()) {
+				store_block_to_flash();
+				if (tftp_to_flash_status & B_ERROR_DURING_FLASH) {
+					otf_flash_failed();
+					return;
+				}
+			}
+#endif
+			if (otf_update_hook != NULL)
+				tftp_otf_idle();
+		}
+
 #ifdef CONFIG_MCAST_TFTP
 		if (tftp_mcast_active) {
 			if (tftp_mcast_master_client &&
@@ -936,6 +1058,10 @@ static void tftp_timeout_handler(void)
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		/* the server resends the window after the block we ACK */
+		if (tftp_state == STATE_DATA && !tftp_put_active)
+			tftp_next_ack = (unsigned short)(tftp_cur_block +
+							 tftp_windowsize);
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
 	}
@@ -956,6 +1082,10 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	ep = getenv("tftpwindowsize");
+	if (ep != NULL)
+		tftp_windowsize_option = simple_strtol(ep, NULL, 10);
+
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -977,8 +1107,8 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_windowsize_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (net_boot_file_name[0] == '\0') {
@@ -1051,10 +1181,10 @@ void tftp_start(enum proto_t protocol)
 		printf("Load address: 0x%lx\n", load_addr);
 #if defined(CONFIG_TFTP_UPDATE_ONTHEFLY)
 		if( (tftp_to_flash_status & B_WRITE_IMG_TO_FLASH) == B_WRITE_IMG_TO_FLASH ){
-			last_ram_addr_written = 0;
 			blocks_written_to_flash = 0;
+			ram_sectors_written = 0;
+			flash_write_ms = 0;
 			bytes_counter = 0;
-			ram_offset = 0;
 
 			printf("Loading and updating on-the-fly: \n\t");
 		}
@@ -1104,11 +1234,14 @@ void tftp_start(enum proto_t protocol)
 		tftp_our_port = simple_strtol(ep, NULL, 10);
 #endif
 	tftp_cur_block = 0;
+	tftp_prev_block = 0;
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
+	tftp_last_nack = TFTP_SEQUENCE_SIZE;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -1136,8 +1269,9 @@ void tftp_start_server(void)
 	timeout_ms = TIMEOUT;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
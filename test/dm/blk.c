@@ -6,8 +6,14 @@
 
 #include <common.h>
 #include <dm.h>
+#include <fs.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <os.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/state.h>
+#include <asm/unaligned.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -94,3 +100,288 @@ static int dm_test_blk_usb(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_usb, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that queued requests for adjacent blocks are merged */
+static int dm_test_blk_queue(struct unit_test_state *uts)
+{
+	const char *fname = "blk_queue_test.img";
+	/* clusters of a fragmented file, in the order the FAT lists them */
+	static const lbaint_t frag[] = { 10, 12, 30, 14, 32, 16, 50 };
+	struct blk_request req[ARRAY_SIZE(frag)];
+	struct host_block_dev *host_dev;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	char *buf, *disk;
+	int fd, i;
+
+	buf = malloc(ARRAY_SIZE(frag) * 2 * 512);
+	disk = malloc(64 * 512);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(disk);
+	for (i = 0; i < 64 * 512; i++)
+		disk[i] = i / 512 + i;
+
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT);
+	ut_assert(fd >= 0);
+	ut_asserteq(64 * 512, os_write(fd, disk, 64 * 512));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	ut_assertok(blk_get_device(IF_TYPE_HOST, 0, &dev));
+	desc = dev_get_uclass_platdata(dev);
+	host_dev = dev_get_priv(dev);
+
+	/* Queue two blocks per cluster, each into its own part of buf */
+	host_dev->cmd_count = 0;
+	for (i = 0; i < ARRAY_SIZE(frag); i++) {
+		blk_init_request(&req[i], BLK_REQ_READ, frag[i], 2,
+				 buf + i * 2 * 512);
+		ut_assertok(blk_submit(desc, &req[i]));
+	}
+	ut_asserteq(0, host_dev->cmd_count);
+	ut_assertok(blk_run_queue(desc));
+
+	/* 10-17, 30-33 and 50-51 are each read with one command */
+	ut_asserteq(3, host_dev->cmd_count);
+	for (i = 0; i < ARRAY_SIZE(frag); i++) {
+		ut_asserteq(2, req[i].result);
+		ut_assertok(memcmp(buf + i * 2 * 512, disk + frag[i] * 512,
+				   2 * 512));
+	}
+
+	/* Synchronous reads still issue one command each */
+	host_dev->cmd_count = 0;
+	ut_asserteq(2, blk_dread(desc, 40, 2, buf));
+	ut_asserteq(1, host_dev->cmd_count);
+	ut_assertok(memcmp(buf, disk + 40 * 512, 2 * 512));
+
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+	free(disk);
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_queue, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Put entry 'clust' of a FAT12 table */
+static void fat12_set(u8 *fat, int clust, int val)
+{
+	u8 *p = fat + clust * 3 / 2;
+
+	if (clust & 1) {
+		p[0] = (p[0] & 0x0f) | (val << 4);
+		p[1] = val >> 4;
+	} else {
+		p[0] = val;
+		p[1] = (p[1] & 0xf0) | ((val >> 8) & 0x0f);
+	}
+}
+
+/* Add a file of 'nclust' one-sector clusters from 'clust' to a FAT12 image */
+static void fat12_add_file(u8 *disk, int slot, const char *name, int clust,
+			   int nclust)
+{
+	u8 *dent = disk + 3 * 512 + slot * 32;
+	int i;
+
+	memcpy(dent, name, 11);
+	dent[11] = 0x20;			/* archive */
+	dent[26] = clust;
+	dent[27] = clust >> 8;
+	put_unaligned_le32(nclust * 512, dent + 28);
+	for (i = 0; i < nclust; i++) {
+		fat12_set(disk + 512, clust + i,
+			  i == nclust - 1 ? 0xfff : clust + i + 1);
+		fat12_set(disk + 2 * 512, clust + i,
+			  i == nclust - 1 ? 0xfff : clust + i + 1);
+	}
+}
+
+/*
+ * Make a 64 sector FAT12 image: boot sector, two FATs, root directory and
+ * data, holding ZIMAGE in sectors 4-19 and BOARD.DTB in sectors 20-21
+ */
+static u8 *fat12_make_disk(void)
+{
+	u8 *disk;
+	int i;
+
+	disk = calloc(64, 512);
+	if (!disk)
+		return NULL;
+	memcpy(disk, "\xeb\x3c\x90" "MSWIN4.1", 11);
+	disk[11] = 512 & 0xff;			/* bytes per sector */
+	disk[12] = 512 >> 8;
+	disk[13] = 1;				/* sectors per cluster */
+	disk[14] = 1;				/* reserved sectors */
+	disk[16] = 2;				/* FATs */
+	disk[17] = 16;				/* root directory entries */
+	disk[19] = 64;				/* sectors */
+	disk[21] = 0xf8;			/* media */
+	disk[22] = 1;				/* sectors per FAT */
+	disk[38] = 0x29;			/* extended boot signature */
+	memcpy(disk + 43, "NO NAME    FAT12   ", 19);
+	disk[446] = 0xf4;			/* boot code, not an MBR */
+	disk[510] = 0x55;
+	disk[511] = 0xaa;
+	for (i = 0; i < 2; i++) {
+		fat12_set(disk + (1 + i) * 512, 0, 0xff8);
+		fat12_set(disk + (1 + i) * 512, 1, 0xfff);
+	}
+	fat12_add_file(disk, 0, "ZIMAGE     ", 2, 16);
+	fat12_add_file(disk, 1, "BOARD   DTB", 18, 2);
+	for (i = 4 * 512; i < 64 * 512; i++)
+		disk[i] = i / 512 + i;
+
+	return disk;
+}
+
+/* Test that a boot script probes the filesystem only once */
+static int dm_test_blk_fs_mount(struct unit_test_state *uts)
+{
+	const char *fname = "blk_fs_mount_test.img";
+	const char *script =
+		"test -e host 0 zimage && size host 0 zimage && "
+		"load host 0 100000 zimage && load host 0 200000 board.dtb";
+	/* the same, mounting the filesystem for each command */
+	const char *script_nocache =
+		"fsflush && test -e host 0 zimage && "
+		"fsflush && size host 0 zimage && "
+		"fsflush && load host 0 100000 zimage && "
+		"fsflush && load host 0 200000 board.dtb";
+	/* a mount reads the boot sector twice: to probe and to mount */
+	const int mount_reads = 2;
+	/* the FAT of the test disk is one sector */
+	const int fat_reads = 1;
+	struct host_block_dev *host_dev;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	unsigned long uncached, cached;
+	u8 *disk;
+	int fd;
+
+	disk = fat12_make_disk();
+	ut_assertnonnull(disk);
+
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT);
+	ut_assert(fd >= 0);
+	ut_asserteq(64 * 512, os_write(fd, disk, 64 * 512));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	ut_assertok(blk_get_device(IF_TYPE_HOST, 0, &dev));
+	desc = dev_get_uclass_platdata(dev);
+	host_dev = dev_get_priv(dev);
+
+	host_dev->cmd_count = 0;
+	ut_assertok(run_command(script_nocache, 0));
+	uncached = host_dev->cmd_count;
+	ut_assertok(memcmp(map_sysmem(0x100000, 0), disk + 4 * 512, 16 * 512));
+	ut_assertok(memcmp(map_sysmem(0x200000, 0), disk + 20 * 512, 2 * 512));
+
+	/*
+	 * Only the first command mounts the filesystem. The others neither
+	 * probe it nor read its boot sector, and the second load finds the
+	 * FAT in the cache.
+	 */
+	ut_assertok(run_command("fsflush", 0));
+	host_dev->cmd_count = 0;
+	ut_assertok(run_command(script, 0));
+	cached = host_dev->cmd_count;
+	ut_asserteq(uncached - 3 * mount_reads - fat_reads, cached);
+
+	/* Once mounted, only directories and file data are read */
+	host_dev->cmd_count = 0;
+	ut_assertok(run_command(script, 0));
+	ut_asserteq(uncached - 4 * mount_reads - 2 * fat_reads,
+		    host_dev->cmd_count);
+
+	/* Writing to the device drops the mount */
+	ut_asserteq(1, blk_dwrite(desc, 63, 1, disk));
+	host_dev->cmd_count = 0;
+	ut_assertok(run_command(script, 0));
+	ut_asserteq(cached, host_dev->cmd_count);
+
+	ut_assertok(run_command("fsflush", 0));
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+	free(disk);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_fs_mount, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test reading a file in chunks through a file handle */
+static int dm_test_blk_fs_open_file(struct unit_test_state *uts)
+{
+	const char *fname = "blk_fs_open_file_test.img";
+	/* the root directory and the FAT of the test disk are one sector */
+	const int dir_reads = 1, fat_reads = 1;
+	const int chunks = 3;
+	struct host_block_dev *host_dev;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	loff_t size, actread, pos;
+	unsigned long cmds;
+	u8 *disk, *buf;
+	int fd;
+
+	disk = fat12_make_disk();
+	ut_assertnonnull(disk);
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT);
+	ut_assert(fd >= 0);
+	ut_asserteq(64 * 512, os_write(fd, disk, 64 * 512));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	ut_assertok(blk_get_device(IF_TYPE_HOST, 0, &dev));
+	desc = dev_get_uclass_platdata(dev);
+	host_dev = dev_get_priv(dev);
+
+	ut_assertok(fs_set_blk_dev("host", "0", FS_TYPE_ANY));
+	ut_assertok(fs_open_file("zimage", &size));
+	ut_asserteq(16 * 512, size);
+
+	/* Chunks not aligned to clusters, only file data is read */
+	buf = map_sysmem(0x100000, 0);
+	host_dev->cmd_count = 0;
+	for (pos = 0; pos < chunks * 3000; pos += 3000) {
+		ut_assertok(fs_read_next(0x100000 + pos, 3000, &actread));
+		ut_asserteq(min(size - pos, (loff_t)3000), actread);
+	}
+	cmds = host_dev->cmd_count;
+	ut_assertok(memcmp(buf, disk + 4 * 512, 16 * 512));
+	ut_assertok(fs_read_next(0x100000, 3000, &actread));
+	ut_asserteq(0, actread);
+
+	/*
+	 * Reading the same chunks with fs_read() looks up the file in the
+	 * root directory for each chunk, where fs_read_next() only had to
+	 * read the FAT once
+	 */
+	host_dev->cmd_count = 0;
+	for (pos = 0; pos < chunks * 3000; pos += 3000) {
+		ut_assertok(fs_set_blk_dev("host", "0", FS_TYPE_ANY));
+		ut_assertok(fs_read("zimage", 0x100000 + pos, pos,
+				    min(size - pos, (loff_t)3000), &actread));
+	}
+	ut_asserteq(cmds + chunks * dir_reads - fat_reads,
+		    host_dev->cmd_count);
+
+	/* Writing elsewhere on the device does not break the open file */
+	memset(buf, 0, 16 * 512);
+	ut_assertok(fs_set_blk_dev("host", "0", FS_TYPE_ANY));
+	ut_assertok(fs_open_file("zimage", &size));
+	ut_assertok(fs_read_next(0x100000, 1000, &actread));
+	ut_asserteq(1, blk_dwrite(desc, 63, 1, disk));
+	ut_assertok(fs_read_next(0x100000 + 1000, 7192, &actread));
+	ut_asserteq(7192, actread);
+	ut_assertok(memcmp(buf, disk + 4 * 512, 16 * 512));
+	fs_close_file();
+
+	ut_assertok(run_command("fsflush", 0));
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+	free(disk);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_fs_open_file, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
@@ -11,6 +11,7 @@
 #include <dm.h>
 #include <fdtdec.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
@@ -259,3 +260,190 @@ static int dm_test_net_retry(struct unit_test_state *uts)
 	return retval;
 }
 DM_TEST(dm_test_net_retry, DM_TESTF_SCAN_FDT);
+
+/* TFTP server stand-in for dm_test_eth_tftp_window */
+#define SB_TFTP_PORT		7000
+#define SB_TFTP_BLKSIZE		1024
+#define SB_TFTP_BLOCKS		40
+#define SB_TFTP_LAST_LEN	100
+#define SB_TFTP_SIZE		((SB_TFTP_BLOCKS - 1) * SB_TFTP_BLKSIZE + \
+				 SB_TFTP_LAST_LEN)
+
+static struct {
+	unsigned int windowsize;	/* granted in the OACK */
+	unsigned int drop;		/* block lost the first time, or 0 */
+	unsigned int data;		/* DATA packets received by the client */
+	unsigned int acks;		/* ACKs sent by the client */
+} sb_tftp;
+
+static uchar sb_tftp_byte(unsigned int block, unsigned int i)
+{
+	return block * 7 + i;
+}
+
+/* Queue a UDP reply from the server port to the sender of req */
+static void sb_tftp_reply(struct udevice *dev, void *req, const void *data,
+			  unsigned int len)
+{
+	uchar pkt[PKTSIZE_ALIGN];
+	struct ethernet_hdr *eth = req;
+	struct ip_udp_hdr *ip = req + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_r = (void *)pkt;
+	struct ip_udp_hdr *ip_r = (void *)pkt + ETHER_HDR_SIZE;
+
+	memcpy(eth_r->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_r->et_src, eth->et_dest, ARP_HLEN);
+	eth_r->et_protlen = htons(PROT_IP);
+
+	memcpy(ip_r, ip, IP_UDP_HDR_SIZE);
+	ip_r->ip_len = htons(IP_UDP_HDR_SIZE + len);
+	net_copy_ip((void *)&ip_r->ip_src, &ip->ip_dst);
+	net_copy_ip((void *)&ip_r->ip_dst, &ip->ip_src);
+	ip_r->ip_sum = 0;
+	ip_r->ip_sum = compute_ip_checksum(ip_r, IP_HDR_SIZE);
+	ip_r->udp_src = htons(SB_TFTP_PORT);
+	ip_r->udp_dst = ip->udp_src;
+	ip_r->udp_len = htons(UDP_HDR_SIZE + len);
+	ip_r->udp_xsum = 0;
+	memcpy(pkt + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE, data, len);
+
+	if (!sandbox_eth_recv_packet(dev, pkt,
+				     ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len) &&
+	    ntohs(((__be16 *)data)[0]) == 3)
+		sb_tftp.data++;
+}
+
+/* Send the window of blocks following the one ACKed */
+static void sb_tftp_send_window(struct udevice *dev, void *req,
+				unsigned int acked)
+{
+	uchar data[4 + SB_TFTP_BLKSIZE];
+	unsigned int block, len, i;
+
+	for (block = acked + 1;
+	     block <= acked + sb_tftp.windowsize && block <= SB_TFTP_BLOCKS;
+	     block++) {
+		if (block == sb_tftp.drop) {
+			sb_tftp.drop = 0;
+			continue;
+		}
+		len = block == SB_TFTP_BLOCKS ? SB_TFTP_LAST_LEN :
+						SB_TFTP_BLKSIZE;
+		((__be16 *)data)[0] = htons(3);		/* DATA */
+		((__be16 *)data)[1] = htons(block);
+		for (i = 0; i < len; i++)
+			data[4 + i] = sb_tftp_byte(block, i);
+		sb_tftp_reply(dev, req, data, 4 + len);
+	}
+}
+
+static bool sb_tftp_tx_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *tftp = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	char oack[64], *p, *end;
+	unsigned int windowsize = 1;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return false;
+
+	if (ntohs(ip->udp_dst) == 69 && ntohs(tftp[0]) == 1) {
+		/* RRQ: grant the window asked for, up to 16 */
+		p = (char *)&tftp[1];
+		end = (char *)packet + len;
+		while (p < end) {
+			if (!strcmp(p, "windowsize"))
+				windowsize = simple_strtoul(p + 11, NULL, 10);
+			p += strlen(p) + 1;
+		}
+		sb_tftp.windowsize = min(windowsize, 16U);
+
+		p = oack;
+		*(__be16 *)p = htons(6);		/* OACK */
+		p += 2;
+		p += sprintf(p, "blksize%c%d%c", 0, SB_TFTP_BLKSIZE, 0);
+		if (windowsize > 1)
+			p += sprintf(p, "windowsize%c%d%c", 0,
+				     sb_tftp.windowsize, 0);
+		sb_tftp_reply(dev, packet, oack, p - oack);
+		return true;
+	}
+
+	if (ntohs(ip->udp_dst) == SB_TFTP_PORT && ntohs(tftp[0]) == 4) {
+		/* ACK: carry on after the block ACKed */
+		sb_tftp.acks++;
+		sb_tftp_send_window(dev, packet, ntohs(tftp[1]));
+		return true;
+	}
+
+	return false;
+}
+
+/* Fetch the file and check its content */
+static int sb_tftp_get(struct unit_test_state *uts, const char *windowsize,
+		       unsigned int drop)
+{
+	uchar *buf;
+	unsigned int i;
+
+	memset(&sb_tftp, 0, sizeof(sb_tftp));
+	sb_tftp.drop = drop;
+	setenv("tftpwindowsize", windowsize);
+
+	buf = map_sysmem(load_addr, SB_TFTP_SIZE);
+	memset(buf, 0, SB_TFTP_SIZE);
+	ut_asserteq(SB_TFTP_SIZE, net_loop(TFTPGET));
+	for (i = 0; i < SB_TFTP_SIZE; i++)
+		ut_asserteq(sb_tftp_byte(i / SB_TFTP_BLKSIZE + 1,
+					 i % SB_TFTP_BLKSIZE), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	/* Lock-step: one ACK for the OACK and one for each block */
+	ut_assertok(sb_tftp_get(uts, "1", 0));
+	ut_asserteq(SB_TFTP_BLOCKS, sb_tftp.data);
+	ut_asserteq(SB_TFTP_BLOCKS + 1, sb_tftp.acks);
+
+	/* Window: one ACK for the OACK and one for each window */
+	ut_assertok(sb_tftp_get(uts, "8", 0));
+	ut_asserteq(SB_TFTP_BLOCKS, sb_tftp.data);
+	ut_asserteq(1 + SB_TFTP_BLOCKS / 8, sb_tftp.acks);
+
+	/*
+	 * Lost block 13: the ACK of block 12 restarts the window there, so
+	 * blocks 14 to 16 are sent twice and one more window is needed
+	 */
+	ut_assertok(sb_tftp_get(uts, "8", 13));
+	ut_asserteq(SB_TFTP_BLOCKS + 3, sb_tftp.data);
+	ut_asserteq(1 + SB_TFTP_BLOCKS / 8 + 1, sb_tftp.acks);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	int retval;
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	copy_filename(net_boot_file_name, "window.bin",
+		      sizeof(net_boot_file_name));
+	sandbox_eth_set_tx_handler(0, sb_tftp_tx_handler);
+
+	retval = _dm_test_eth_tftp_window(uts);
+
+	/* Restore the env */
+	sandbox_eth_set_tx_handler(0, NULL);
+	setenv("tftpwindowsize", NULL);
+	setenv("ethact", NULL);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp_window, DM_TESTF_SCAN_FDT);
@@ -7,6 +7,7 @@
 #include <common.h>
 #include <dm.h>
 #include <mmc.h>
+#include <asm/test.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -44,3 +45,72 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* The emulated eMMC supports CMD23 and packed writes */
+static int dm_test_mmc_cmd23(struct unit_test_state *uts)
+{
+	struct blk_request reqs[10];
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	struct mmc *mmc;
+	char buf[16 * 512], cmp[16 * 512];
+	int i;
+
+	/* probe in order so that the mmc numbers match the block devices */
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(uclass_get_device(UCLASS_MMC, 1, &dev));
+	ut_asserteq(1, blk_get_device_by_str("mmc", "1", &dev_desc));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_asserteq(MMC_CMD_CAP_SBC | MMC_CMD_CAP_PACKED_WR, mmc->cmd_caps);
+	ut_asserteq(8, mmc->max_packed_writes);
+
+	/* bounded transfers do without CMD12 */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i % 251;
+	sandbox_mmc_reset_counts(dev);
+	ut_asserteq(16, blk_dwrite(dev_desc, 100, 16, buf));
+	blkcache_invalidate(IF_TYPE_MMC, dev_desc->devnum);
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(16, blk_dread(dev_desc, 100, 16, cmp));
+	ut_assertok(memcmp(buf, cmp, sizeof(buf)));
+	ut_asserteq(2, sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT));
+	ut_asserteq(0, sandbox_mmc_get_cmd_count(dev,
+						 MMC_CMD_STOP_TRANSMISSION));
+
+	/* adjacent reads into separate buffers go out as one command */
+	blkcache_invalidate(IF_TYPE_MMC, dev_desc->devnum);
+	memset(cmp, '\0', sizeof(cmp));
+	sandbox_mmc_reset_counts(dev);
+	for (i = 0; i < 4; i++) {
+		blk_init_request(&reqs[i], BLK_REQ_READ, 100 + i * 4, 4,
+				 cmp + (3 - i) * 4 * 512);
+		ut_assertok(blk_submit(dev_desc, &reqs[i]));
+	}
+	ut_assertok(blk_run_queue(dev_desc));
+	ut_asserteq(1, sandbox_mmc_get_cmd_count(dev,
+						 MMC_CMD_READ_MULTIPLE_BLOCK));
+	for (i = 0; i < 4; i++)
+		ut_assertok(memcmp(buf + i * 4 * 512, cmp + (3 - i) * 4 * 512,
+				   4 * 512));
+
+	/* ten scattered writes go out as two packed commands */
+	sandbox_mmc_reset_counts(dev);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		blk_init_request(&reqs[i], BLK_REQ_WRITE, 300 + i * 3, 1,
+				 buf + (i % 16) * 512);
+		ut_assertok(blk_submit(dev_desc, &reqs[i]));
+	}
+	ut_assertok(blk_run_queue(dev_desc));
+	ut_asserteq(2, sandbox_mmc_get_packed_count(dev));
+	ut_asserteq(2, sandbox_mmc_get_cmd_count(dev,
+						 MMC_CMD_WRITE_MULTIPLE_BLOCK));
+
+	blkcache_invalidate(IF_TYPE_MMC, dev_desc->devnum);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		ut_asserteq(1, blk_dread(dev_desc, 300 + i * 3, 1, cmp));
+		ut_assertok(memcmp(buf + (i % 16) * 512, cmp, 512));
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
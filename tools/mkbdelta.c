@@ -0,0 +1,241 @@
+/*
+ * Generate a block delta image for the Digi 'update' command.
+ *
+ * The delta carries the digest of every block of the new image and the
+ * data of the blocks that differ from the base image installed on the
+ * target (see include/bdelta_format.h). Without a base image every block
+ * is carried, which still lets the target skip the blocks it already holds
+ * and so saves writes to the media.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "compiler.h"
+#include <u-boot/sha256.h>
+#include <bdelta_format.h>
+#include <version.h>
+
+#define DEFAULT_BLK_SZ	(64 * 1024)
+
+static void usage(const char *exec_name)
+{
+	fprintf(stderr, "%s [-h] [-V] [-b <block size>] [-B <base image>] -o <output> <image>\n"
+	       "\n"
+	       "This tool generates a block delta of <image>, to update a partition that\n"
+	       "holds <base image> by writing only the blocks that differ.\n"
+	       "\n"
+	       "\t-b <block size> : size of the blocks compared, a multiple of the\n"
+	       "\t                  media block size (default %d)\n"
+	       "\t-B <base image> : image installed on the target. If not given, every\n"
+	       "\t                  block is carried in the delta\n"
+	       "\t-o <output> : delta image to generate\n"
+	       "\t-V : print version information and exit\n",
+	       exec_name, DEFAULT_BLK_SZ);
+}
+
+static long int xstrtol(const char *s)
+{
+	long int tmp;
+
+	errno = 0;
+	tmp = strtol(s, NULL, 0);
+	if (!errno)
+		return tmp;
+
+	if (errno == ERANGE)
+		fprintf(stderr, "Bad integer format: %s\n",  s);
+	else
+		fprintf(stderr, "Error while parsing %s: %s\n", s,
+				strerror(errno));
+
+	exit(EXIT_FAILURE);
+}
+
+static const uint8_t *map_file(const char *filename, size_t *size)
+{
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Can't open \"%s\": %s\n", filename,
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "Can't stat() on \"%s\": %s\n", filename,
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	*size = st.st_size;
+	if (!*size) {
+		close(fd);
+		return NULL;
+	}
+
+	ptr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		fprintf(stderr, "mmap (%zu bytes) failed: %s\n", *size,
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+
+	return ptr;
+}
+
+static void xwrite(FILE *fp, const void *buf, size_t len)
+{
+	if (fwrite(buf, 1, len, fp) != len) {
+		fprintf(stderr, "Write error: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *img_filename, *base_filename = NULL, *out_filename = NULL;
+	const uint8_t *img, *base = NULL;
+	size_t img_size, base_size = 0;
+	uint32_t blk_sz = DEFAULT_BLK_SZ;
+	uint32_t total, delta = 0, blk, i;
+	struct bdelta_header hdr;
+	uint8_t *digests;
+	uint32_t *index;
+	uint8_t *pad;
+	FILE *fp;
+	int option;
+	const char *prg;
+
+	prg = basename(argv[0]);
+
+	/* Turn off getopt()'s internal error message */
+	opterr = 0;
+
+	while ((option = getopt(argc, argv, ":b:B:o:hV")) != -1) {
+		switch (option) {
+		case 'b':
+			blk_sz = xstrtol(optarg);
+			break;
+		case 'B':
+			base_filename = optarg;
+			break;
+		case 'o':
+			out_filename = optarg;
+			break;
+		case 'h':
+			usage(prg);
+			return EXIT_SUCCESS;
+		case 'V':
+			printf("%s version %s\n", prg, PLAIN_VERSION);
+			return EXIT_SUCCESS;
+		case ':':
+			fprintf(stderr, "Missing argument for option -%c\n",
+				optopt);
+			usage(prg);
+			return EXIT_FAILURE;
+		default:
+			fprintf(stderr, "Wrong option -%c\n", optopt);
+			usage(prg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1 || !out_filename) {
+		usage(prg);
+		return EXIT_FAILURE;
+	}
+	img_filename = argv[optind];
+
+	if (!blk_sz || blk_sz % 512) {
+		fprintf(stderr, "The block size must be a multiple of 512 bytes\n");
+		return EXIT_FAILURE;
+	}
+
+	img = map_file(img_filename, &img_size);
+	if (!img) {
+		fprintf(stderr, "\"%s\" is empty\n", img_filename);
+		return EXIT_FAILURE;
+	}
+	if (base_filename)
+		base = map_file(base_filename, &base_size);
+
+	total = (img_size + blk_sz - 1) / blk_sz;
+	digests = malloc((size_t)total * BDELTA_DIGEST_SIZE);
+	index = malloc((size_t)total * sizeof(*index));
+	pad = calloc(1, blk_sz);
+	if (!digests || !index || !pad) {
+		fprintf(stderr, "Can't allocate memory for %u blocks\n", total);
+		return EXIT_FAILURE;
+	}
+
+	/* Carry the blocks that are not the same in the base image */
+	for (blk = 0; blk < total; blk++) {
+		size_t off = (size_t)blk * blk_sz;
+		size_t len = img_size - off < blk_sz ? img_size - off : blk_sz;
+
+		sha256_csum_wd(img + off, len,
+			       digests + (size_t)blk * BDELTA_DIGEST_SIZE,
+			       CHUNKSZ_SHA256);
+		if (!base || off + len > base_size ||
+		    memcmp(img + off, base + off, len))
+			index[delta++] = blk;
+	}
+
+	fp = fopen(out_filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "Can't open \"%s\": %s\n", out_filename,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = cpu_to_le32(BDELTA_MAGIC);
+	hdr.version = cpu_to_le16(BDELTA_VERSION);
+	hdr.hdr_sz = cpu_to_le16(sizeof(hdr));
+	hdr.blk_sz = cpu_to_le32(blk_sz);
+	hdr.total_blks = cpu_to_le32(total);
+	hdr.delta_blks = cpu_to_le32(delta);
+	hdr.image_sz = cpu_to_le64(img_size);
+	xwrite(fp, &hdr, sizeof(hdr));
+	xwrite(fp, digests, (size_t)total * BDELTA_DIGEST_SIZE);
+
+	for (i = 0; i < delta; i++) {
+		uint32_t le = cpu_to_le32(index[i]);
+
+		xwrite(fp, &le, sizeof(le));
+	}
+
+	for (i = 0; i < delta; i++) {
+		size_t off = (size_t)index[i] * blk_sz;
+		size_t len = img_size - off < blk_sz ? img_size - off : blk_sz;
+
+		xwrite(fp, img + off, len);
+		xwrite(fp, pad, blk_sz - len);
+	}
+
+	if (fclose(fp)) {
+		fprintf(stderr, "Write error: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf("%u of %u blocks of %u bytes carried in the delta\n",
+	       delta, total, blk_sz);
+
+	return EXIT_SUCCESS;
+}